@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Helpers shared by the harnesses in this directory. Each harness is a
+ * standalone program that prints the rows of one table in
+ * benchmark_results.md.
+ */
+
+static inline uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/*
+ * Resident set size of the process from /proc/self/statm, 0 if unavailable.
+ */
+static inline size_t bench_rss_bytes(void) {
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (!file) {
+        return 0;
+    }
+    unsigned long pages = 0, resident = 0;
+    const int fields = fscanf(file, "%lu %lu", &pages, &resident);
+    fclose(file);
+    return fields == 2 ? (size_t) resident * (size_t) sysconf(_SC_PAGESIZE) : 0;
+}
+
+/*
+ * xorshift64*: deterministic, so every run of a harness replays the same
+ * sequence.
+ */
+static inline uint64_t bench_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545f4914f6cdd1dull;
+}
+
+static inline int bench_compare_double(const void *a, const void *b) {
+    const double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
@@ -0,0 +1,128 @@
+#include "bench.h"
+#include "coarse_clock.h"
+#include "storage.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/*
+ * Latency of regular operations while keys expire: 200 000 persistent keys
+ * and 2 000 000 keys with a TTL of 2-5 s in 16 shards. One thread keeps
+ * doing GET and SET on the persistent keys while a maintenance thread runs
+ * the same cycle as app.c ten times a second, until every key with a TTL is
+ * gone. Prints the latency percentiles of one run.
+ *
+ * Usage: expire_bench
+ */
+
+#define PERSISTENT_KEYS 200000
+#define VOLATILE_KEYS 2000000
+#define TTL_MIN_MS 2000
+#define TTL_SPREAD_MS 3000
+#define MAINTENANCE_HZ 10
+#define MAINTENANCE_REHASH_BUDGET_US 1000
+#define MAX_SAMPLES (64 * 1024 * 1024)
+#define TIMEOUT_NS (30ull * 1000000000ull)
+
+static atomic_int g_stop;
+
+static void *maintenance_thread(void *arg) {
+    storage_t *storage = arg;
+    const struct timespec pause = {.tv_nsec = 1000000000L / MAINTENANCE_HZ};
+    while (!atomic_load(&g_stop)) {
+        nanosleep(&pause, NULL);
+        storage_rehash_for(storage, MAINTENANCE_REHASH_BUDGET_US);
+        storage_cleanup_expired(storage);
+    }
+    return NULL;
+}
+
+static int compare_u32(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_us(const uint32_t *samples, const size_t count, const double percent) {
+    size_t index = (size_t) ((double) count * percent / 100.0);
+    if (index >= count) {
+        index = count - 1;
+    }
+    return samples[index] / 1000.0;
+}
+
+int main(void) {
+    if (coarse_clock_start() != 0) {
+        fprintf(stderr, "Failed to start the clock ticker\n");
+        return EXIT_FAILURE;
+    }
+
+    stats_t stats;
+    if (stats_init(&stats, 0) != 0) {
+        return EXIT_FAILURE;
+    }
+    const storage_options_t storage_options = {
+        .shards = STORAGE_DEFAULT_SHARDS,
+        .index = STORAGE_INDEX_CHAIN,
+        .eviction_samples = STORAGE_EVICTION_SAMPLES,
+        .policy = STORAGE_POLICY_NOEVICTION,
+        .expire_budget_us = STORAGE_EXPIRE_BUDGET_US,
+    };
+    storage_t *storage = storage_create(&storage_options, &stats);
+    uint32_t *samples = malloc(MAX_SAMPLES * sizeof(uint32_t));
+    if (!storage || !samples) {
+        return EXIT_FAILURE;
+    }
+
+    uint64_t rng = 7;
+    char key[32];
+    for (int i = 0; i < PERSISTENT_KEYS; i++) {
+        const int key_len = snprintf(key, sizeof(key), "persistent:%d", i);
+        storage_set(storage, key, (size_t) key_len, "value:00", 8, 0);
+    }
+    for (int i = 0; i < VOLATILE_KEYS; i++) {
+        const int key_len = snprintf(key, sizeof(key), "volatile:%d", i);
+        const int64_t ttl_ms = TTL_MIN_MS + (int64_t) (bench_random(&rng) % TTL_SPREAD_MS);
+        storage_set(storage, key, (size_t) key_len, "value:00", 8, ttl_ms);
+    }
+
+    pthread_t maintenance;
+    if (pthread_create(&maintenance, NULL, maintenance_thread, storage) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    size_t count = 0;
+    const uint64_t deadline = bench_now_ns() + TIMEOUT_NS;
+    while (count < MAX_SAMPLES && storage_get_count(storage) > PERSISTENT_KEYS && bench_now_ns() < deadline) {
+        const int key_len = snprintf(key, sizeof(key), "persistent:%d",
+                                     (int) (bench_random(&rng) % PERSISTENT_KEYS));
+        const uint64_t start = bench_now_ns();
+        if (count % 4 == 0) {
+            storage_set(storage, key, (size_t) key_len, "value:01", 8, 0);
+        } else {
+            size_t value_len;
+            free(storage_get(storage, key, (size_t) key_len, &value_len));
+        }
+        const uint64_t elapsed = bench_now_ns() - start;
+        samples[count++] = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t) elapsed;
+    }
+
+    atomic_store(&g_stop, 1);
+    pthread_join(maintenance, NULL);
+
+    if (count == 0) {
+        return EXIT_FAILURE;
+    }
+    qsort(samples, count, sizeof(uint32_t), compare_u32);
+    printf("| | p50 | p99 | p99.9 | p99.99 | max |\n|---|---|---|---|---|---|\n");
+    printf("| Очередь истечения | %.2f мкс | %.2f мкс | %.1f мкс | %.1f мкс | %.1f мс |\n",
+           percentile_us(samples, count, 50), percentile_us(samples, count, 99),
+           percentile_us(samples, count, 99.9), percentile_us(samples, count, 99.99),
+           samples[count - 1] / 1000000.0);
+    printf("operations: %zu, keys left: %zu\n", count, storage_get_count(storage));
+
+    free(samples);
+    storage_destroy(storage);
+    stats_destroy(&stats);
+    coarse_clock_stop();
+    return EXIT_SUCCESS;
+}
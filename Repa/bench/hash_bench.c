@@ -0,0 +1,109 @@
+#include "bench.h"
+#include "hash.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Key hash cost: 4096 keys of the form user:session:NNNNNNNN:... padded to
+ * the given length, hashed 4000 times over. The storage hash includes
+ * strlen, as storage.c pays for it on every lookup; djb2 is the function the
+ * store used before and is kept here as the baseline. Prints the median of
+ * three runs in ns per key.
+ *
+ * Usage: hash_bench [key lengths...]   (default: 16 24 32 48 64)
+ */
+
+#define KEYS 4096
+#define PASSES 4000
+#define RUNS 3
+
+static uint64_t djb2(const char *key) {
+    uint64_t hash = 5381;
+    for (const unsigned char *p = (const unsigned char *) key; *p; p++) {
+        hash = hash * 33 + *p;
+    }
+    return hash;
+}
+
+static volatile uint64_t g_sink;
+
+static double time_djb2(char *const *keys) {
+    uint64_t sum = 0;
+    const uint64_t start = bench_now_ns();
+    for (int pass = 0; pass < PASSES; pass++) {
+        for (int i = 0; i < KEYS; i++) {
+            sum += djb2(keys[i]);
+        }
+    }
+    const uint64_t elapsed = bench_now_ns() - start;
+    g_sink = sum;
+    return (double) elapsed / ((double) PASSES * KEYS);
+}
+
+static double time_storage_hash(char *const *keys, const uint64_t seed) {
+    uint64_t sum = 0;
+    const uint64_t start = bench_now_ns();
+    for (int pass = 0; pass < PASSES; pass++) {
+        for (int i = 0; i < KEYS; i++) {
+            sum += hash_bytes(keys[i], strlen(keys[i]), seed);
+        }
+    }
+    const uint64_t elapsed = bench_now_ns() - start;
+    g_sink = sum;
+    return (double) elapsed / ((double) PASSES * KEYS);
+}
+
+static int run_length(const size_t length) {
+    char **keys = calloc(KEYS, sizeof(char *));
+    if (!keys) {
+        return -1;
+    }
+    for (int i = 0; i < KEYS; i++) {
+        keys[i] = malloc(length + 1);
+        if (!keys[i]) {
+            return -1;
+        }
+        char prefix[32];
+        const int prefix_len = snprintf(prefix, sizeof(prefix), "user:session:%08d:", i);
+        for (size_t j = 0; j < length; j++) {
+            keys[i][j] = j < (size_t) prefix_len ? prefix[j] : (char) ('a' + (i + j) % 26);
+        }
+        keys[i][length] = '\0';
+    }
+
+    const uint64_t seed = hash_random_seed();
+    double djb2_ns[RUNS], hash_ns[RUNS];
+    for (int run = 0; run < RUNS; run++) {
+        djb2_ns[run] = time_djb2(keys);
+        hash_ns[run] = time_storage_hash(keys, seed);
+    }
+    qsort(djb2_ns, RUNS, sizeof(double), bench_compare_double);
+    qsort(hash_ns, RUNS, sizeof(double), bench_compare_double);
+    printf("| %zu | %.1f | %.1f |\n", length, djb2_ns[RUNS / 2], hash_ns[RUNS / 2]);
+
+    for (int i = 0; i < KEYS; i++) {
+        free(keys[i]);
+    }
+    free(keys);
+    return 0;
+}
+
+int main(const int argc, char *argv[]) {
+    static const size_t defaults[] = {16, 24, 32, 48, 64};
+
+    printf("| Длина ключа, байт | djb2 (старый) | wyhash с seed (новый) |\n|---|---|---|\n");
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            if (run_length((size_t) strtoul(argv[i], NULL, 10)) != 0) {
+                return EXIT_FAILURE;
+            }
+        }
+        return EXIT_SUCCESS;
+    }
+    for (size_t i = 0; i < sizeof(defaults) / sizeof(defaults[0]); i++) {
+        if (run_length(defaults[i]) != 0) {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,391 @@
+#include "bench.h"
+#include "coarse_clock.h"
+#include "storage.h"
+#include <getopt.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Hit ratio of the eviction policies on a cache-aside trace: every request
+ * is a GET, and a miss is followed by a SET of the same key. Keys are drawn
+ * from a Zipf distribution over --keys keys; the generator has a fixed seed,
+ * so every run replays the same trace. Time is modelled at 100 000 requests
+ * a second by setting the coarse clock directly, and the maintenance tick of
+ * app.c runs every 100 ms of model time.
+ *
+ * Scenarios:
+ *   zipf  - the distribution stays the same;
+ *   scan  - four times during the trace every second request goes to a new
+ *           key that is never seen again, until --keys such keys have passed;
+ *   shift - four times during the trace the popularity of keys is reshuffled.
+ *
+ * The first 10% of requests warm the cache up and are not counted, and only
+ * requests to the main key set count. The exact LRU reference is a model
+ * holding as many keys as the storage held on average.
+ *
+ * Usage: hit_ratio_bench [--alpha A] [--keys N] [--requests N] [--max-memory-kb N]
+ *                        [--policy P] [--samples N] [--scenario zipf|scan|shift]
+ */
+
+#define REQUESTS_PER_MS 100
+#define MAINTENANCE_MS 100
+#define MAINTENANCE_BUDGET_US 1000
+#define PHASES 4
+#define WARMUP_PERCENT 10
+#define VALUE "value:00"
+
+typedef enum {
+    SCENARIO_ZIPF,
+    SCENARIO_SCAN,
+    SCENARIO_SHIFT
+} scenario_t;
+
+typedef struct {
+    double alpha;
+    size_t keys;
+    size_t requests;
+    size_t max_memory_kb;
+    storage_policy_t policy;
+    unsigned samples;
+    scenario_t scenario;
+} hit_ratio_options_t;
+
+/*
+ * Produces the request stream: key ids below options->keys belong to the
+ * main set, larger ids are one-off scan keys.
+ */
+typedef struct {
+    const hit_ratio_options_t *options;
+    double *cdf;
+    uint32_t *rank_to_key;
+    uint64_t rng;
+    size_t position;
+    size_t next_scan_key;
+} trace_t;
+
+static void shuffle(uint32_t *keys, const size_t count, uint64_t *rng) {
+    for (size_t i = count - 1; i > 0; i--) {
+        const size_t j = bench_random(rng) % (i + 1);
+        const uint32_t tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+}
+
+static int trace_init(trace_t *trace, const hit_ratio_options_t *options) {
+    memset(trace, 0, sizeof(*trace));
+    trace->options = options;
+    trace->rng = 0x9e3779b97f4a7c15ull;
+    trace->next_scan_key = options->keys;
+    trace->cdf = malloc(options->keys * sizeof(double));
+    trace->rank_to_key = malloc(options->keys * sizeof(uint32_t));
+    if (!trace->cdf || !trace->rank_to_key) {
+        return -1;
+    }
+
+    double sum = 0;
+    for (size_t i = 0; i < options->keys; i++) {
+        sum += 1.0 / pow((double) (i + 1), options->alpha);
+        trace->cdf[i] = sum;
+        trace->rank_to_key[i] = (uint32_t) i;
+    }
+    for (size_t i = 0; i < options->keys; i++) {
+        trace->cdf[i] /= sum;
+    }
+    shuffle(trace->rank_to_key, options->keys, &trace->rng);
+    return 0;
+}
+
+static void trace_destroy(trace_t *trace) {
+    free(trace->cdf);
+    free(trace->rank_to_key);
+}
+
+static size_t zipf_key(trace_t *trace) {
+    const double u = (double) (bench_random(&trace->rng) >> 11) / (double) (1ull << 53);
+    size_t low = 0, high = trace->options->keys - 1;
+    while (low < high) {
+        const size_t mid = (low + high) / 2;
+        if (trace->cdf[mid] < u) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return trace->rank_to_key[low];
+}
+
+/*
+ * The trace is split into PHASES equal parts; a scan runs over the first
+ * 2 * keys requests of each part, a shift happens at its start.
+ */
+static size_t trace_next(trace_t *trace) {
+    const hit_ratio_options_t *options = trace->options;
+    const size_t phase_len = options->requests / PHASES;
+    const size_t offset = trace->position % phase_len;
+    trace->position++;
+
+    if (options->scenario == SCENARIO_SHIFT && offset == 0 && trace->position > 1) {
+        shuffle(trace->rank_to_key, options->keys, &trace->rng);
+    }
+    if (options->scenario == SCENARIO_SCAN && offset < 2 * options->keys && offset % 2 == 1) {
+        return trace->next_scan_key++;
+    }
+    return zipf_key(trace);
+}
+
+/*
+ * Exact LRU over key ids: an intrusive doubly linked list in arrays, with
+ * NIL marking both the list ends and keys that are not cached.
+ */
+#define NIL UINT32_MAX
+
+typedef struct {
+    uint32_t *prev;
+    uint32_t *next;
+    uint8_t *cached;
+    uint32_t head;
+    uint32_t tail;
+    size_t size;
+    size_t capacity;
+} exact_lru_t;
+
+static int exact_lru_init(exact_lru_t *lru, const size_t ids, const size_t capacity) {
+    lru->prev = malloc(ids * sizeof(uint32_t));
+    lru->next = malloc(ids * sizeof(uint32_t));
+    lru->cached = calloc(ids, 1);
+    lru->head = lru->tail = NIL;
+    lru->size = 0;
+    lru->capacity = capacity;
+    return lru->prev && lru->next && lru->cached ? 0 : -1;
+}
+
+static void exact_lru_destroy(exact_lru_t *lru) {
+    free(lru->prev);
+    free(lru->next);
+    free(lru->cached);
+}
+
+static void exact_lru_unlink(exact_lru_t *lru, const uint32_t id) {
+    if (lru->prev[id] != NIL) lru->next[lru->prev[id]] = lru->next[id];
+    else lru->head = lru->next[id];
+    if (lru->next[id] != NIL) lru->prev[lru->next[id]] = lru->prev[id];
+    else lru->tail = lru->prev[id];
+}
+
+static void exact_lru_push_front(exact_lru_t *lru, const uint32_t id) {
+    lru->prev[id] = NIL;
+    lru->next[id] = lru->head;
+    if (lru->head != NIL) lru->prev[lru->head] = id;
+    lru->head = id;
+    if (lru->tail == NIL) lru->tail = id;
+}
+
+static int exact_lru_access(exact_lru_t *lru, const uint32_t id) {
+    if (lru->cached[id]) {
+        exact_lru_unlink(lru, id);
+        exact_lru_push_front(lru, id);
+        return 1;
+    }
+
+    if (lru->size == lru->capacity) {
+        const uint32_t victim = lru->tail;
+        exact_lru_unlink(lru, victim);
+        lru->cached[victim] = 0;
+        lru->size--;
+    }
+    exact_lru_push_front(lru, id);
+    lru->cached[id] = 1;
+    lru->size++;
+    return 0;
+}
+
+static void set_model_time(const uint64_t base_monotonic, const uint64_t base_unix, const size_t request) {
+    const uint64_t elapsed_ms = request / REQUESTS_PER_MS;
+    atomic_store_explicit(&g_coarse_monotonic_ms, base_monotonic + elapsed_ms, memory_order_relaxed);
+    atomic_store_explicit(&g_coarse_unix_ms, base_unix + elapsed_ms, memory_order_relaxed);
+}
+
+/*
+ * Replays the trace against a storage and returns its hit ratio; the
+ * average number of cached keys after the warm-up goes to *avg_keys.
+ */
+static double run_storage(const hit_ratio_options_t *options, double *avg_keys) {
+    stats_t stats;
+    if (stats_init(&stats, options->max_memory_kb * 1024) != 0) {
+        return -1;
+    }
+    const storage_options_t storage_options = {
+        .max_memory = options->max_memory_kb * 1024,
+        .shards = STORAGE_DEFAULT_SHARDS,
+        .index = STORAGE_INDEX_CHAIN,
+        .eviction_samples = options->samples,
+        .policy = options->policy,
+        .expire_budget_us = STORAGE_EXPIRE_BUDGET_US,
+    };
+    storage_t *storage = storage_create(&storage_options, &stats);
+    trace_t trace;
+    if (!storage || trace_init(&trace, options) != 0) {
+        return -1;
+    }
+
+    const uint64_t base_monotonic = coarse_clock_read_monotonic_ms();
+    const uint64_t base_unix = coarse_clock_read_unix_ms();
+    const size_t warmup = options->requests * WARMUP_PERCENT / 100;
+    size_t hits = 0, counted = 0, samples = 0;
+    double keys_sum = 0;
+
+    for (size_t i = 0; i < options->requests; i++) {
+        set_model_time(base_monotonic, base_unix, i);
+        if (i % (MAINTENANCE_MS * REQUESTS_PER_MS) == 0) {
+            storage_rehash_for(storage, MAINTENANCE_BUDGET_US);
+        }
+
+        const size_t id = trace_next(&trace);
+        char key[32];
+        const int key_len = snprintf(key, sizeof(key), "key:%zu", id);
+
+        size_t value_len;
+        char *value = storage_get(storage, key, (size_t) key_len, &value_len);
+        const int hit = value != NULL;
+        free(value);
+        if (!hit) {
+            storage_set(storage, key, (size_t) key_len, VALUE, sizeof(VALUE) - 1, 0);
+        }
+
+        if (i >= warmup) {
+            if (id < options->keys) {
+                hits += (size_t) hit;
+                counted++;
+            }
+            if (i % 1000 == 0) {
+                keys_sum += (double) storage_get_count(storage);
+                samples++;
+            }
+        }
+    }
+
+    *avg_keys = samples ? keys_sum / (double) samples : 0;
+    trace_destroy(&trace);
+    storage_destroy(storage);
+    stats_destroy(&stats);
+    atomic_store(&g_coarse_monotonic_ms, 0);
+    atomic_store(&g_coarse_unix_ms, 0);
+    return counted ? 100.0 * (double) hits / (double) counted : 0;
+}
+
+static double run_exact_lru(const hit_ratio_options_t *options, const size_t capacity) {
+    trace_t trace;
+    exact_lru_t lru;
+    const size_t ids = options->keys * (options->scenario == SCENARIO_SCAN ? PHASES + 1 : 1);
+    if (trace_init(&trace, options) != 0 || exact_lru_init(&lru, ids, capacity) != 0) {
+        return -1;
+    }
+
+    const size_t warmup = options->requests * WARMUP_PERCENT / 100;
+    size_t hits = 0, counted = 0;
+    for (size_t i = 0; i < options->requests; i++) {
+        const size_t id = trace_next(&trace);
+        const int hit = exact_lru_access(&lru, (uint32_t) id);
+        if (i >= warmup && id < options->keys) {
+            hits += (size_t) hit;
+            counted++;
+        }
+    }
+
+    exact_lru_destroy(&lru);
+    trace_destroy(&trace);
+    return counted ? 100.0 * (double) hits / (double) counted : 0;
+}
+
+static void usage(const char *prog_name) {
+    fprintf(stderr, "Usage: %s [--alpha A] [--keys N] [--requests N] [--max-memory-kb N]\n"
+                    "          [--policy P] [--samples N] [--scenario zipf|scan|shift]\n", prog_name);
+}
+
+static int parse_options(hit_ratio_options_t *options, const int argc, char *argv[]) {
+    static struct option long_options[] = {
+        {"alpha", required_argument, 0, 'a'},
+        {"keys", required_argument, 0, 'k'},
+        {"requests", required_argument, 0, 'r'},
+        {"max-memory-kb", required_argument, 0, 'm'},
+        {"policy", required_argument, 0, 'p'},
+        {"samples", required_argument, 0, 's'},
+        {"scenario", required_argument, 0, 'c'},
+        {0, 0, 0, 0}
+    };
+
+    int opt, option_index = 0;
+    while ((opt = getopt_long(argc, argv, "a:k:r:m:p:s:c:", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'a':
+                options->alpha = strtod(optarg, NULL);
+                break;
+            case 'k':
+                options->keys = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                options->requests = strtoul(optarg, NULL, 10);
+                break;
+            case 'm':
+                options->max_memory_kb = strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                if (storage_policy_parse(optarg, &options->policy) != 0) {
+                    return -1;
+                }
+                break;
+            case 's':
+                options->samples = (unsigned) strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                if (strcmp(optarg, "zipf") == 0) options->scenario = SCENARIO_ZIPF;
+                else if (strcmp(optarg, "scan") == 0) options->scenario = SCENARIO_SCAN;
+                else if (strcmp(optarg, "shift") == 0) options->scenario = SCENARIO_SHIFT;
+                else return -1;
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    if (options->keys == 0 || options->requests < PHASES || options->max_memory_kb == 0 ||
+        options->samples == 0 || options->samples > STORAGE_MAX_EVICTION_SAMPLES) {
+        return -1;
+    }
+    return 0;
+}
+
+int main(const int argc, char *argv[]) {
+    hit_ratio_options_t options = {
+        .alpha = 0.99,
+        .keys = 1000000,
+        .requests = 10000000,
+        .max_memory_kb = 6144,
+        .policy = STORAGE_POLICY_ALLKEYS_LRU,
+        .samples = STORAGE_EVICTION_SAMPLES,
+        .scenario = SCENARIO_ZIPF,
+    };
+    if (parse_options(&options, argc, argv) != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    double avg_keys;
+    const double storage_ratio = run_storage(&options, &avg_keys);
+    if (storage_ratio < 0) {
+        fprintf(stderr, "Failed to replay the trace\n");
+        return EXIT_FAILURE;
+    }
+    const double exact_ratio = run_exact_lru(&options, avg_keys > 1 ? (size_t) avg_keys : 1);
+    if (exact_ratio < 0) {
+        fprintf(stderr, "Failed to replay the trace\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("policy=%s samples=%u alpha=%.2f cached_keys=%.0f exact_lru=%.2f%% storage=%.2f%%\n",
+           storage_policy_name(options.policy), options.samples, options.alpha, avg_keys, exact_ratio,
+           storage_ratio);
+    return EXIT_SUCCESS;
+}
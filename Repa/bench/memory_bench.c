@@ -0,0 +1,157 @@
+#include "bench.h"
+#include "slab.h"
+#include "storage.h"
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Memory per key: fills a storage with --keys keys through storage_set (or
+ * storage_incr with --counter) and prints, per key, the used_memory that
+ * STATS reports (entries and index), the growth of the process RSS, the
+ * slab bytes in use and the time of one write. Keys are formatted with
+ * --key-format from their number; with --numeric the value is a number of
+ * --value-len digits instead of letters.
+ *
+ * Usage: memory_bench [--keys N] [--index chain|swiss] [--shards N] [--key-format FMT]
+ *                     [--value-len N [--numeric] | --counter N]
+ */
+
+typedef struct {
+    size_t keys;
+    storage_index_t index;
+    size_t shards;
+    const char *key_format;
+    size_t value_len;
+    int numeric;
+    int counter;
+    int64_t counter_value;
+} memory_bench_options_t;
+
+static void usage(const char *prog_name) {
+    fprintf(stderr, "Usage: %s [--keys N] [--index chain|swiss] [--shards N] [--key-format FMT]\n"
+                    "          [--value-len N [--numeric] | --counter N]\n", prog_name);
+}
+
+static int parse_options(memory_bench_options_t *options, const int argc, char *argv[]) {
+    static struct option long_options[] = {
+        {"keys", required_argument, 0, 'k'},
+        {"index", required_argument, 0, 'i'},
+        {"shards", required_argument, 0, 's'},
+        {"key-format", required_argument, 0, 'f'},
+        {"value-len", required_argument, 0, 'v'},
+        {"numeric", no_argument, 0, 'n'},
+        {"counter", required_argument, 0, 'c'},
+        {0, 0, 0, 0}
+    };
+
+    int opt, option_index = 0;
+    while ((opt = getopt_long(argc, argv, "k:i:s:f:v:nc:", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'k':
+                options->keys = strtoul(optarg, NULL, 10);
+                break;
+            case 'i':
+                if (storage_index_parse(optarg, &options->index) != 0) {
+                    return -1;
+                }
+                break;
+            case 's':
+                options->shards = strtoul(optarg, NULL, 10);
+                break;
+            case 'f':
+                options->key_format = optarg;
+                break;
+            case 'v':
+                options->value_len = strtoul(optarg, NULL, 10);
+                break;
+            case 'n':
+                options->numeric = 1;
+                break;
+            case 'c':
+                options->counter = 1;
+                options->counter_value = strtoll(optarg, NULL, 10);
+                break;
+            default:
+                return -1;
+        }
+    }
+    return options->keys > 0 ? 0 : -1;
+}
+
+int main(const int argc, char *argv[]) {
+    memory_bench_options_t options = {
+        .keys = 1000000,
+        .index = STORAGE_INDEX_CHAIN,
+        .shards = STORAGE_DEFAULT_SHARDS,
+        .key_format = "key:%012zu",
+        .value_len = 8,
+    };
+    if (parse_options(&options, argc, argv) != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    stats_t stats;
+    if (stats_init(&stats, 0) != 0) {
+        return EXIT_FAILURE;
+    }
+    const storage_options_t storage_options = {
+        .shards = options.shards,
+        .index = options.index,
+        .eviction_samples = STORAGE_EVICTION_SAMPLES,
+        .policy = STORAGE_POLICY_NOEVICTION,
+        .expire_budget_us = STORAGE_EXPIRE_BUDGET_US,
+    };
+    storage_t *storage = storage_create(&storage_options, &stats);
+    if (!storage) {
+        fprintf(stderr, "Failed to create storage\n");
+        return EXIT_FAILURE;
+    }
+
+    char *value = malloc(options.value_len + 1);
+    if (!value) {
+        return EXIT_FAILURE;
+    }
+    memset(value, options.numeric ? '1' : 'v', options.value_len);
+    value[options.value_len] = '\0';
+
+    const size_t memory_before = storage_get_memory(storage);
+    const size_t rss_before = bench_rss_bytes();
+    slab_stats_t slab_before;
+    slab_get_stats(&slab_before);
+
+    const uint64_t start = bench_now_ns();
+    for (size_t i = 0; i < options.keys; i++) {
+        char key[64];
+        const int key_len = snprintf(key, sizeof(key), options.key_format, i);
+        int result;
+        if (options.counter) {
+            int64_t counter;
+            result = storage_incr(storage, key, (size_t) key_len, options.counter_value, &counter);
+        } else {
+            result = storage_set(storage, key, (size_t) key_len, value, options.value_len, 0);
+        }
+        if (result != 0) {
+            fprintf(stderr, "Write %zu failed\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+    const uint64_t elapsed = bench_now_ns() - start;
+
+    slab_stats_t slab_after;
+    slab_get_stats(&slab_after);
+    const double keys = (double) options.keys;
+    printf("keys=%zu index=%s value=%s%zu\n", options.keys, storage_index_name(options.index),
+           options.counter ? "counter:" : "", options.counter ? (size_t) options.counter_value : options.value_len);
+    printf("used_memory: %.1f bytes/key\n", (double) (storage_get_memory(storage) - memory_before) / keys);
+    printf("rss: %.1f bytes/key\n", (double) (bench_rss_bytes() - rss_before) / keys);
+    printf("slab used: %.1f bytes/key\n", (double) (slab_after.used_bytes - slab_before.used_bytes) / keys);
+    printf("dataset: %.1f bytes/key\n", (double) storage_get_dataset_memory(storage) / keys);
+    printf("write: %.0f ns/key\n", (double) elapsed / keys);
+
+    free(value);
+    storage_destroy(storage);
+    stats_destroy(&stats);
+    return EXIT_SUCCESS;
+}
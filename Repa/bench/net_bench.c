@@ -0,0 +1,507 @@
+#define _DEFAULT_SOURCE // SO_LINGER, TCP_NODELAY
+
+#include "bench.h"
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+/*
+ * Network load against a running server on 127.0.0.1.
+ *
+ *   pipeline - every connection sends P commands (SET and GET in turn, values
+ *              of --value-len bytes) and waits for all replies; prints
+ *              operations a second and, with --pid, the server's CPU time
+ *              per operation.
+ *   mget     - 10 000 keys key:NNNNN, one connection fetches batches of random
+ *              keys either as a pipeline of GETs or as one MGET.
+ *   storm    - threads open a connection, send PING, read the reply and close
+ *              it with SO_LINGER 0; prints connections a second.
+ *   idle     - opens --idle connections that send nothing; with --pid
+ *              prints the server's CPU usage while they all stay quiet, then
+ *              the mean time of GETs sent one at a time on one more
+ *              connection.
+ *
+ * Client sockets use TCP_NODELAY.
+ *
+ * Usage: net_bench pipeline|mget|storm|idle [--port N] [--conns N] [--pipeline P]
+ *                  [--seconds S] [--batch N] [--idle N] [--pid PID] [--value-len N]
+ */
+
+#define MAX_CONNS 1024
+#define REPLY_BUFFER (64 * 1024)
+#define MGET_KEYS 10000
+
+typedef struct {
+    int port;
+    int conns;
+    int pipeline;
+    int seconds;
+    int batch;
+    int idle;
+    int pid;
+    int value_len;
+} net_bench_options_t;
+
+static net_bench_options_t g_options = {
+    .port = 6380,
+    .conns = 1,
+    .pipeline = 16,
+    .seconds = 3,
+    .batch = 50,
+    .idle = 1000,
+    .pid = 0,
+    .value_len = 8,
+};
+
+static atomic_int g_stop;
+
+typedef struct {
+    int fd;
+    char buffer[REPLY_BUFFER];
+    size_t len;
+    size_t pos;
+} connection_t;
+
+static int open_socket(const int linger) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons((uint16_t) g_options.port),
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    if (linger) {
+        const struct linger off = {.l_onoff = 1, .l_linger = 0};
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &off, sizeof(off));
+    }
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    const int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    return fd;
+}
+
+static int send_all(const int fd, const char *data, size_t len) {
+    while (len > 0) {
+        const ssize_t written = send(fd, data, len, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return -1;
+        }
+        data += written;
+        len -= (size_t) written;
+    }
+    return 0;
+}
+
+static int next_byte(connection_t *conn) {
+    if (conn->pos == conn->len) {
+        ssize_t got;
+        do {
+            got = recv(conn->fd, conn->buffer, sizeof(conn->buffer), 0);
+        } while (got < 0 && errno == EINTR);
+        if (got <= 0) {
+            return -1;
+        }
+        conn->len = (size_t) got;
+        conn->pos = 0;
+    }
+    return (unsigned char) conn->buffer[conn->pos++];
+}
+
+/*
+ * Reads the rest of a reply line and returns the number at its start, which
+ * is all a bulk or array header needs.
+ */
+static long read_line_number(connection_t *conn, int *error) {
+    long value = 0, sign = 1;
+    int c = next_byte(conn);
+    if (c == '-') {
+        sign = -1;
+        c = next_byte(conn);
+    }
+    while (c >= 0 && c != '\r') {
+        if (c >= '0' && c <= '9') {
+            value = value * 10 + (c - '0');
+        }
+        c = next_byte(conn);
+    }
+    if (c < 0 || next_byte(conn) != '\n') {
+        *error = 1;
+    }
+    return value * sign;
+}
+
+static int skip_reply(connection_t *conn) {
+    const int type = next_byte(conn);
+    if (type < 0) {
+        return -1;
+    }
+    int error = 0;
+    const long number = read_line_number(conn, &error);
+    if (error) {
+        return -1;
+    }
+    if (type == '$' && number >= 0) {
+        for (long i = 0; i < number + 2; i++) {
+            if (next_byte(conn) < 0) {
+                return -1;
+            }
+        }
+    } else if (type == '*') {
+        for (long i = 0; i < number; i++) {
+            if (skip_reply(conn) != 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int connect_authenticated(connection_t *conn) {
+    memset(conn, 0, sizeof(*conn));
+    conn->fd = open_socket(0);
+    if (conn->fd < 0) {
+        return -1;
+    }
+    static const char auth[] = "*3\r\n$4\r\nAUTH\r\n$5\r\nadmin\r\n$5\r\nadmin\r\n";
+    if (send_all(conn->fd, auth, sizeof(auth) - 1) != 0 || skip_reply(conn) != 0) {
+        close(conn->fd);
+        return -1;
+    }
+    return 0;
+}
+
+static size_t append_command(char *buffer, const char *name, const char *key, const char *value) {
+    if (value) {
+        return (size_t) sprintf(buffer, "*3\r\n$%zu\r\n%s\r\n$%zu\r\n%s\r\n$%zu\r\n%s\r\n",
+                                strlen(name), name, strlen(key), key, strlen(value), value);
+    }
+    return (size_t) sprintf(buffer, "*2\r\n$%zu\r\n%s\r\n$%zu\r\n%s\r\n", strlen(name), name, strlen(key), key);
+}
+
+typedef struct {
+    long id;
+    uint64_t operations;
+    int failed;
+} worker_result_t;
+
+static void *pipeline_worker(void *arg) {
+    worker_result_t *result = arg;
+    connection_t *conn = malloc(sizeof(connection_t));
+    char *request = malloc((size_t) g_options.pipeline * (96 + (size_t) g_options.value_len));
+    char *value = malloc((size_t) g_options.value_len + 1);
+    if (!conn || !request || !value || connect_authenticated(conn) != 0) {
+        result->failed = 1;
+        free(conn);
+        free(request);
+        free(value);
+        return NULL;
+    }
+    memset(value, 'v', (size_t) g_options.value_len);
+    value[g_options.value_len] = '\0';
+
+    size_t len = 0;
+    for (int i = 0; i < g_options.pipeline; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "k%ld:%d", result->id, i / 2);
+        len += append_command(request + len, i % 2 == 0 ? "SET" : "GET", key, i % 2 == 0 ? value : NULL);
+    }
+    free(value);
+
+    while (!atomic_load_explicit(&g_stop, memory_order_relaxed)) {
+        if (send_all(conn->fd, request, len) != 0) {
+            result->failed = 1;
+            break;
+        }
+        for (int i = 0; i < g_options.pipeline; i++) {
+            if (skip_reply(conn) != 0) {
+                result->failed = 1;
+                break;
+            }
+        }
+        if (result->failed) {
+            break;
+        }
+        result->operations += (uint64_t) g_options.pipeline;
+    }
+
+    close(conn->fd);
+    free(conn);
+    free(request);
+    return NULL;
+}
+
+static void *storm_worker(void *arg) {
+    worker_result_t *result = arg;
+    static const char ping[] = "*1\r\n$4\r\nPING\r\n";
+    char reply[64];
+    while (!atomic_load_explicit(&g_stop, memory_order_relaxed)) {
+        const int fd = open_socket(1);
+        if (fd < 0) {
+            continue;
+        }
+        if (send_all(fd, ping, sizeof(ping) - 1) == 0 && recv(fd, reply, sizeof(reply), 0) > 0) {
+            result->operations++;
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+/*
+ * Runs one worker per connection for --seconds and returns the total count
+ * of operations they reported, or -1 if any of them failed.
+ */
+static long process_cpu_ticks(const int pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    char line[1024];
+    const char *fields = fgets(line, sizeof(line), file) ? strrchr(line, ')') : NULL;
+    fclose(file);
+    unsigned long utime, stime;
+    if (!fields || sscanf(fields, ") %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) {
+        return -1;
+    }
+    return (long) (utime + stime);
+}
+
+static double run_workers(void *(*worker)(void *), const int count) {
+    pthread_t threads[MAX_CONNS];
+    worker_result_t results[MAX_CONNS];
+    memset(results, 0, sizeof(results));
+    atomic_store(&g_stop, 0);
+
+    int started = 0;
+    for (; started < count; started++) {
+        results[started].id = started;
+        if (pthread_create(&threads[started], NULL, worker, &results[started]) != 0) {
+            break;
+        }
+    }
+    sleep((unsigned) g_options.seconds);
+    atomic_store(&g_stop, 1);
+
+    uint64_t total = 0;
+    int failed = started < count;
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        total += results[i].operations;
+        failed |= results[i].failed;
+    }
+    return failed ? -1 : (double) total;
+}
+
+static int run_pipeline(void) {
+    const long ticks_before = g_options.pid ? process_cpu_ticks(g_options.pid) : -1;
+    const double operations = run_workers(pipeline_worker, g_options.conns);
+    const long ticks_after = g_options.pid ? process_cpu_ticks(g_options.pid) : -1;
+    if (operations < 0) {
+        fprintf(stderr, "Pipeline run failed\n");
+        return -1;
+    }
+    printf("conns=%d pipeline=%d ops/s=%.0f", g_options.conns, g_options.pipeline,
+           operations / g_options.seconds);
+    if (ticks_before >= 0 && ticks_after >= 0 && operations > 0) {
+        printf(" server_cpu_us/op=%.2f", 1e6 * (double) (ticks_after - ticks_before) /
+                                         (double) sysconf(_SC_CLK_TCK) / operations);
+    }
+    printf("\n");
+    return 0;
+}
+
+static int run_storm(void) {
+    const double connections = run_workers(storm_worker, g_options.conns);
+    if (connections < 0) {
+        fprintf(stderr, "Connect storm failed\n");
+        return -1;
+    }
+    printf("threads=%d conn/s=%.0f\n", g_options.conns, connections / g_options.seconds);
+    return 0;
+}
+
+/*
+ * Times batches of random keys fetched either as pipelined GETs or as one
+ * MGET for --seconds each.
+ */
+static int run_mget(void) {
+    connection_t *conn = malloc(sizeof(connection_t));
+    char *request = malloc((size_t) g_options.batch * 64 + 64);
+    if (!conn || !request || connect_authenticated(conn) != 0) {
+        free(conn);
+        free(request);
+        return -1;
+    }
+
+    for (int i = 0; i < MGET_KEYS; i++) {
+        char key[32], command[96];
+        snprintf(key, sizeof(key), "key:%05d", i);
+        const size_t len = append_command(command, "SET", key, "value123");
+        if (send_all(conn->fd, command, len) != 0 || skip_reply(conn) != 0) {
+            return -1;
+        }
+    }
+
+    uint64_t rng = 1;
+    for (int mget = 0; mget < 2; mget++) {
+        uint64_t batches = 0;
+        const uint64_t start = bench_now_ns();
+        const uint64_t deadline = start + (uint64_t) g_options.seconds * 1000000000ull;
+        while (bench_now_ns() < deadline) {
+            size_t len = mget ? (size_t) sprintf(request, "*%d\r\n$4\r\nMGET\r\n", g_options.batch + 1) : 0;
+            for (int i = 0; i < g_options.batch; i++) {
+                char key[32];
+                snprintf(key, sizeof(key), "key:%05d", (int) (bench_random(&rng) % MGET_KEYS));
+                len += mget ? (size_t) sprintf(request + len, "$9\r\n%s\r\n", key)
+                            : append_command(request + len, "GET", key, NULL);
+            }
+            if (send_all(conn->fd, request, len) != 0) {
+                return -1;
+            }
+            for (int i = 0; i < (mget ? 1 : g_options.batch); i++) {
+                if (skip_reply(conn) != 0) {
+                    return -1;
+                }
+            }
+            batches++;
+        }
+        const double elapsed = (double) (bench_now_ns() - start) / 1e9;
+        printf("%s batch=%d keys/s=%.0f us/batch=%.0f\n", mget ? "MGET" : "GET pipeline", g_options.batch,
+               (double) batches * g_options.batch / elapsed, elapsed * 1e6 / (double) batches);
+    }
+
+    close(conn->fd);
+    free(conn);
+    free(request);
+    return 0;
+}
+
+/*
+ * utime + stime of a process in clock ticks, from /proc/<pid>/stat.
+ */
+static int run_idle(void) {
+    connection_t *idle = calloc((size_t) g_options.idle, sizeof(connection_t));
+    connection_t *active = malloc(sizeof(connection_t));
+    if (!idle || !active) {
+        return -1;
+    }
+    for (int i = 0; i < g_options.idle; i++) {
+        if (connect_authenticated(&idle[i]) != 0) {
+            fprintf(stderr, "Failed to open idle connection %d\n", i);
+            return -1;
+        }
+    }
+    if (connect_authenticated(active) != 0) {
+        return -1;
+    }
+
+    if (g_options.pid) {
+        const long ticks_before = process_cpu_ticks(g_options.pid);
+        sleep((unsigned) g_options.seconds);
+        const long ticks_after = process_cpu_ticks(g_options.pid);
+        if (ticks_before >= 0 && ticks_after >= 0) {
+            printf("idle_cpu=%.1f%% ", 100.0 * (double) (ticks_after - ticks_before) /
+                                       (double) sysconf(_SC_CLK_TCK) / g_options.seconds);
+        }
+    }
+
+    char request[64];
+    const size_t len = append_command(request, "GET", "idle:key", NULL);
+    const uint64_t start = bench_now_ns();
+    const uint64_t deadline = start + (uint64_t) g_options.seconds * 1000000000ull;
+    uint64_t requests = 0;
+    while (bench_now_ns() < deadline) {
+        if (send_all(active->fd, request, len) != 0 || skip_reply(active) != 0) {
+            return -1;
+        }
+        requests++;
+    }
+    const double elapsed = (double) (bench_now_ns() - start) / 1e9;
+    printf("idle=%d get_us=%.1f\n", g_options.idle, elapsed * 1e6 / (double) requests);
+
+    for (int i = 0; i < g_options.idle; i++) {
+        close(idle[i].fd);
+    }
+    close(active->fd);
+    free(idle);
+    free(active);
+    return 0;
+}
+
+static void usage(const char *prog_name) {
+    fprintf(stderr, "Usage: %s pipeline|mget|storm|idle [--port N] [--conns N] [--pipeline P]\n"
+                    "          [--seconds S] [--batch N] [--idle N] [--pid PID] [--value-len N]\n", prog_name);
+}
+
+int main(const int argc, char *argv[]) {
+    static struct option long_options[] = {
+        {"port", required_argument, 0, 'p'},
+        {"conns", required_argument, 0, 'c'},
+        {"pipeline", required_argument, 0, 'P'},
+        {"seconds", required_argument, 0, 's'},
+        {"batch", required_argument, 0, 'b'},
+        {"idle", required_argument, 0, 'i'},
+        {"pid", required_argument, 0, 'd'},
+        {"value-len", required_argument, 0, 'v'},
+        {0, 0, 0, 0}
+    };
+
+    if (argc < 2) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *mode = argv[1];
+
+    int opt, option_index = 0;
+    optind = 2;
+    while ((opt = getopt_long(argc, argv, "p:c:P:s:b:i:d:v:", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'p': g_options.port = atoi(optarg); break;
+            case 'c': g_options.conns = atoi(optarg); break;
+            case 'P': g_options.pipeline = atoi(optarg); break;
+            case 's': g_options.seconds = atoi(optarg); break;
+            case 'b': g_options.batch = atoi(optarg); break;
+            case 'i': g_options.idle = atoi(optarg); break;
+            case 'd': g_options.pid = atoi(optarg); break;
+            case 'v': g_options.value_len = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (g_options.conns < 1 || g_options.conns > MAX_CONNS || g_options.pipeline < 1 ||
+        g_options.seconds < 1 || g_options.batch < 1 || g_options.idle < 0 ||
+        g_options.value_len < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int result;
+    if (strcmp(mode, "pipeline") == 0) {
+        result = run_pipeline();
+    } else if (strcmp(mode, "mget") == 0) {
+        result = run_mget();
+    } else if (strcmp(mode, "storm") == 0) {
+        result = run_storm();
+    } else if (strcmp(mode, "idle") == 0) {
+        result = run_idle();
+    } else {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -123,8 +123,15 @@ static resp_value_t *parse_bulk_string(const char *buffer, size_t len, size_t *p
     if (!value) return NULL;
 
     value->type = RESP_BULK_STRING;
-    value->data.str = strndup(&buffer[*pos], bulk_len);
+    value->data.str = malloc(bulk_len + 1);
+    if (!value->data.str) {
+        free(value);
+        return NULL;
+    }
+    memcpy(value->data.str, &buffer[*pos], bulk_len);
+    value->data.str[bulk_len] = '\0';
     value->value_len = bulk_len;
+    value->release = NULL;
     *pos += bulk_len + 2;
 
     return value;
@@ -202,12 +209,36 @@ resp_value_t *resp_create_bulk_string(const char *str, size_t len) {
         value->value_len = 0;
     } else {
         value->type = RESP_BULK_STRING;
-        value->data.str = strndup(str, len);
+        value->data.str = malloc(len + 1);
+        if (!value->data.str) {
+            free(value);
+            return NULL;
+        }
+        memcpy(value->data.str, str, len);
+        value->data.str[len] = '\0';
         value->value_len = len;
+        value->release = NULL;
     }
     return value;
 }
 
+/*
+ * Bulk string that points at memory owned by someone else instead of copying
+ * it; resp_free hands the owner back to release rather than freeing str.
+ */
+resp_value_t *resp_create_bulk_string_ref(const char *str, const size_t len, void (*release)(void *owner),
+                                          void *owner) {
+    resp_value_t *value = malloc(sizeof(resp_value_t));
+    if (!value) return NULL;
+
+    value->type = RESP_BULK_STRING;
+    value->data.str = (char *) str;
+    value->value_len = len;
+    value->release = release;
+    value->owner = owner;
+    return value;
+}
+
 resp_value_t *resp_create_null(void) {
     resp_value_t *value = malloc(sizeof(resp_value_t));
     if (!value) return NULL;
@@ -286,9 +317,15 @@ void resp_free(resp_value_t *value) {
     if (!value) return;
 
     switch (value->type) {
+        case RESP_BULK_STRING:
+            if (value->release) {
+                value->release(value->owner);
+            } else {
+                free(value->data.str);
+            }
+            break;
         case RESP_SIMPLE_STRING:
         case RESP_ERROR:
-        case RESP_BULK_STRING:
             free(value->data.str);
             break;
         case RESP_ARRAY:
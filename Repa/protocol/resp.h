@@ -26,6 +26,9 @@ typedef struct resp_value {
     } data;
 
     size_t value_len;
+
+    void (*release)(void *owner);
+    void *owner;
 } resp_value_t;
 
 resp_value_t *resp_parse(const char *buffer, size_t len, size_t *bytes_consumed);
@@ -42,6 +45,8 @@ resp_value_t *resp_create_integer(int64_t value);
 
 resp_value_t *resp_create_bulk_string(const char *str, size_t len);
 
+resp_value_t *resp_create_bulk_string_ref(const char *str, size_t len, void (*release)(void *owner), void *owner);
+
 resp_value_t *resp_create_null(void);
 
 resp_value_t *resp_create_array(size_t count);
@@ -1,12 +1,20 @@
+#define _DEFAULT_SOURCE // SO_REUSEPORT
+
 #include "network_listener.h"
+#include "uring.h"
 #include "../../logger/logger.h"
 #include "../../../protocol/resp.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -17,27 +25,96 @@
 #define MAX_CLIENTS 1024
 #define BUFFER_SIZE 8192
 #define BACKLOG 128
+#define EPOLL_BATCH 256
+#define HANDOFF_SIZE 256
+#define OUTPUT_ZERO_COPY_MIN (16 * 1024)
+#define OUTPUT_ZERO_COPY_LAST_MIN (4 * 1024)
+#define OUTPUT_KEEP_CAPACITY (64 * 1024)
+#define READ_KEEP_CAPACITY (64 * 1024)
+#define URING_ENTRIES 512
+#define URING_BUFFERS 256
+#define URING_BUFFER_SIZE 4096
+#define URING_BUFFER_GROUP 0
+#define URING_OP_ACCEPT 0
+#define URING_OP_RECV 1
+#define URING_OP_SEND 2
+#define URING_OP_WAKE 3
+#define URING_OP_MASK 7
 
 typedef struct {
     int fd;
+    int worker;
     int is_authenticated;
-    char read_buffer[BUFFER_SIZE];
-    size_t read_pos;
     int active;
+
+    /*
+     * Holds input until a whole command has arrived. It starts at
+     * BUFFER_SIZE, doubles for larger requests up to the listener's
+     * max_request, and goes back to BUFFER_SIZE once such a request has been
+     * processed.
+     */
+    char *read_buffer;
+    size_t read_pos;
+    size_t read_cap;
+
+    /*
+     * Replies of one read batch are collected in output and written together.
+     * With epoll, whatever the socket does not take stays there from
+     * output_pos on until EPOLLOUT reports room. With io_uring the previous
+     * batch stays in sending, which the kernel owns until its completion
+     * arrives, so neither buffer moves under a send.
+     */
+    char *output;
+    size_t output_pos;
+    size_t output_len;
+    size_t output_cap;
+    int write_blocked;
+    char *sending;
+    size_t sending_len;
+    size_t sending_pos;
+    size_t sending_cap;
+    int recv_armed;
+    int send_inflight;
+    int closing;
+    int flush_queued;
 } client_session_t;
 
+/*
+ * Everything a worker thread owns. Sessions are only ever touched by their
+ * worker, so the request path runs without locks; the accept thread hands a
+ * new socket over through a single-producer ring and wakes the worker with an
+ * eventfd registered in the same epoll instance.
+ */
+typedef struct {
+    int epoll_fd;
+    int wake_fd;
+    int listen_fd;
+    int pending[HANDOFF_SIZE];
+    size_t pending_head;
+    size_t pending_tail;
+
+    uring_t ring;
+    client_session_t **flush_list;
+    size_t flush_count;
+} worker_loop_t;
+
 struct network_listener {
     int port;
     int server_fd;
     int workers;
+    int reuseport;
+    network_io_backend_t io_backend;
+    size_t max_request;
     command_executor_t *executor;
 
     pthread_t *worker_threads;
     pthread_t accept_thread;
+    int accept_thread_started;
+    worker_loop_t *loops;
+    size_t next_worker;
 
     client_session_t *clients;
     size_t max_clients;
-    pthread_mutex_t clients_mutex;
 
     int running;
     int stop_requested;
@@ -51,17 +128,62 @@ static int set_nonblocking(const int fd) {
 
 static void close_client(const network_listener_t *listener, client_session_t *client) {
     if (client->fd >= 0 && client->active) {
+        if (listener->io_backend == NETWORK_IO_EPOLL) {
+            epoll_ctl(listener->loops[client->worker].epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+        }
         close(client->fd);
         client->fd = -1;
         client->active = 0;
 
+        free(client->read_buffer);
+        client->read_buffer = NULL;
+        client->read_pos = client->read_cap = 0;
+
+        free(client->output);
+        free(client->sending);
+        client->output = NULL;
+        client->sending = NULL;
+        client->output_pos = client->output_len = client->output_cap = 0;
+        client->write_blocked = 0;
+        client->sending_len = client->sending_pos = client->sending_cap = 0;
+
         stats_dec_connections(listener->executor->stats);
     }
 }
 
+/*
+ * Makes room for len more input bytes and the terminating NUL. Fails when
+ * the command being collected would outgrow max_request.
+ */
+static int reserve_input(const network_listener_t *listener, client_session_t *client, const size_t len) {
+    const size_t needed = client->read_pos + len + 1;
+    if (needed <= client->read_cap) {
+        return 0;
+    }
+    if (needed > listener->max_request) {
+        return -1;
+    }
+
+    size_t capacity = client->read_cap ? client->read_cap : BUFFER_SIZE;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    if (capacity > listener->max_request) {
+        capacity = listener->max_request;
+    }
+
+    char *buffer = realloc(client->read_buffer, capacity);
+    if (!buffer) {
+        return -1;
+    }
+    client->read_buffer = buffer;
+    client->read_cap = capacity;
+    return 0;
+}
+
 static ssize_t read_client_data(client_session_t *client) {
     const ssize_t n = read(client->fd, client->read_buffer + client->read_pos,
-                           BUFFER_SIZE - client->read_pos - 1);
+                           client->read_cap - client->read_pos - 1);
 
     if (n <= 0) {
         if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
@@ -75,36 +197,175 @@ static ssize_t read_client_data(client_session_t *client) {
     return n;
 }
 
-static int send_response(const client_session_t *client, const resp_value_t *response) {
+static int append_output(client_session_t *client, const char *data, const size_t len) {
+    if (client->output_pos > 0 && client->output_len + len > client->output_cap) {
+        memmove(client->output, client->output + client->output_pos, client->output_len - client->output_pos);
+        client->output_len -= client->output_pos;
+        client->output_pos = 0;
+    }
+    if (client->output_len + len > client->output_cap) {
+        size_t capacity = client->output_cap ? client->output_cap : BUFFER_SIZE;
+        while (capacity < client->output_len + len) {
+            capacity *= 2;
+        }
+        char *output = realloc(client->output, capacity);
+        if (!output) {
+            return -1;
+        }
+        client->output = output;
+        client->output_cap = capacity;
+    }
+
+    memcpy(client->output + client->output_len, data, len);
+    client->output_len += len;
+    return 0;
+}
+
+static int queue_response(client_session_t *client, const resp_value_t *response) {
+    if (response->type == RESP_BULK_STRING) {
+        char header[32];
+        const int header_len = snprintf(header, sizeof(header), "$%zu\r\n", response->value_len);
+        if (append_output(client, header, (size_t) header_len) != 0 ||
+            append_output(client, response->data.str, response->value_len) != 0) {
+            return -1;
+        }
+        return append_output(client, "\r\n", 2);
+    }
+
     char *output = NULL;
     size_t output_len = 0;
     if (resp_serialize(response, &output, &output_len) != 0) {
         return -1;
     }
 
-    ssize_t sent = 0;
-    while (sent < (ssize_t) output_len) {
-        const ssize_t written = write(client->fd, output + sent, output_len - sent);
-        if (written <= 0) {
-            if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                free(output);
-                return -1;
+    const int result = append_output(client, output, output_len);
+    free(output);
+    return result;
+}
+
+static void reset_output(client_session_t *client) {
+    client->output_pos = 0;
+    client->output_len = 0;
+    if (client->output_cap > OUTPUT_KEEP_CAPACITY) {
+        free(client->output);
+        client->output = NULL;
+        client->output_cap = 0;
+    }
+}
+
+/*
+ * Writes as much of the queued output as the socket takes. Returns 1 when a
+ * tail is left over; the session then waits for EPOLLOUT and reads nothing
+ * until it drains, so a client that does not read its replies cannot make
+ * the worker block or buffer without bound.
+ */
+static int flush_output(client_session_t *client) {
+    while (client->output_pos < client->output_len) {
+        const ssize_t written = write(client->fd, client->output + client->output_pos,
+                                      client->output_len - client->output_pos);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
             }
-            struct pollfd pfd = {.fd = client->fd, .events = POLLOUT};
-            poll(&pfd, 1, 100);
-            continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 1 : -1;
         }
-        sent += written;
+        client->output_pos += (size_t) written;
     }
-    free(output);
+
+    reset_output(client);
+    return 0;
+}
+
+/*
+ * A session with a pending tail is registered for EPOLLOUT only, and goes
+ * back to EPOLLIN once the tail is out.
+ */
+static int watch_output(const network_listener_t *listener, client_session_t *client, const int blocked) {
+    struct epoll_event event = {.events = blocked ? EPOLLOUT : EPOLLIN, .data.ptr = client};
+    if (epoll_ctl(listener->loops[client->worker].epoll_fd, EPOLL_CTL_MOD, client->fd, &event) != 0) {
+        LOG_ERROR_MSG("Failed to update events of fd=%d: %s", client->fd, strerror(errno));
+        return -1;
+    }
+    client->write_blocked = blocked;
     return 0;
 }
 
-static int process_single_command(const network_listener_t *listener, client_session_t *client, resp_value_t *cmd) {
+/*
+ * Keeps the part of a direct writev the socket did not take: the rest of the
+ * queued output stays where it is, and only the unsent end of the value is
+ * copied behind it.
+ */
+static int keep_unsent(client_session_t *client, const resp_value_t *response, size_t sent) {
+    const size_t pending = client->output_len - client->output_pos;
+    if (sent < pending) {
+        client->output_pos += sent;
+        sent = 0;
+    } else {
+        reset_output(client);
+        sent -= pending;
+    }
+
+    if (sent < response->value_len &&
+        append_output(client, response->data.str + sent, response->value_len - sent) != 0) {
+        return -1;
+    }
+    sent = sent > response->value_len ? sent - response->value_len : 0;
+    return append_output(client, "\r\n" + sent, 2 - sent);
+}
+
+/*
+ * Replies are only queued here and written once the read batch has been
+ * processed, so a pipeline of small commands costs one write. A bulk value
+ * is not copied when writing it at once costs no extra system call: it goes
+ * out in one writev right behind the replies queued before it, straight from
+ * the storage entry. That holds from 4 KB for the reply that ends the batch,
+ * which would be written next anyway; in the middle of a pipeline the writev
+ * is an extra call, which only pays for itself from 16 KB. io_uring always
+ * copies: its sends read from the output buffer.
+ */
+static int send_response(const network_listener_t *listener, client_session_t *client,
+                         const resp_value_t *response, const int last) {
+    const size_t zero_copy_min = last ? OUTPUT_ZERO_COPY_LAST_MIN : OUTPUT_ZERO_COPY_MIN;
+    if (listener->io_backend == NETWORK_IO_EPOLL && !client->write_blocked &&
+        response->type == RESP_BULK_STRING && response->value_len >= zero_copy_min) {
+        char header[32];
+        const int header_len = snprintf(header, sizeof(header), "$%zu\r\n", response->value_len);
+        if (append_output(client, header, (size_t) header_len) != 0) {
+            return -1;
+        }
+
+        const size_t pending = client->output_len - client->output_pos;
+        struct iovec iov[3] = {
+            {client->output + client->output_pos, pending},
+            {response->data.str, response->value_len},
+            {"\r\n", 2}
+        };
+        ssize_t written;
+        do {
+            written = writev(client->fd, iov, 3);
+        } while (written < 0 && errno == EINTR);
+        if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            return -1;
+        }
+
+        const size_t sent = written > 0 ? (size_t) written : 0;
+        if (sent == pending + response->value_len + 2) {
+            reset_output(client);
+            return 0;
+        }
+        client->write_blocked = 1;
+        return keep_unsent(client, response, sent);
+    }
+
+    return queue_response(client, response);
+}
+
+static int process_single_command(const network_listener_t *listener, client_session_t *client, resp_value_t *cmd,
+                                  const int last) {
     resp_value_t *response = command_executor_execute(
         listener->executor, cmd, &client->is_authenticated);
 
-    if (send_response(client, response) != 0) {
+    if (send_response(listener, client, response, last) != 0) {
         resp_free(response);
         return -1;
     }
@@ -128,17 +389,17 @@ static void shift_buffer(client_session_t *client, const size_t processed) {
                 client->read_pos - processed);
         client->read_pos -= processed;
     }
-}
 
-static int handle_client_data(const network_listener_t *listener, client_session_t *client) {
-    const ssize_t read_result = read_client_data(client);
-    if (read_result < 0) {
-        return -1;
-    }
-    if (read_result == 0) {
-        return 0;
+    if (client->read_cap > READ_KEEP_CAPACITY && client->read_pos < BUFFER_SIZE) {
+        char *buffer = realloc(client->read_buffer, BUFFER_SIZE);
+        if (buffer) {
+            client->read_buffer = buffer;
+            client->read_cap = BUFFER_SIZE;
+        }
     }
+}
 
+static int process_buffered_commands(const network_listener_t *listener, client_session_t *client) {
     size_t processed = 0;
     while (processed < client->read_pos) {
         size_t bytes_consumed = 0;
@@ -151,7 +412,7 @@ static int handle_client_data(const network_listener_t *listener, client_session
 
         processed += bytes_consumed;
 
-        if (process_single_command(listener, client, cmd) != 0) {
+        if (process_single_command(listener, client, cmd, processed == client->read_pos) != 0) {
             resp_free(cmd);
             return -1;
         }
@@ -164,129 +425,260 @@ static int handle_client_data(const network_listener_t *listener, client_session
     return 0;
 }
 
+/*
+ * Nothing after a command that outgrows max_request can be parsed, so the
+ * client gets an error and the connection is closed once it is sent.
+ */
+static int reject_request(const network_listener_t *listener, client_session_t *client) {
+    static const char reply[] = "-ERR request exceeds max_request_mb\r\n";
+
+    LOG_WARN_MSG("Request from fd=%d is larger than %zu bytes, closing", client->fd, listener->max_request);
+    client->read_pos = 0;
+    append_output(client, reply, sizeof(reply) - 1);
+    return -1;
+}
+
+/*
+ * After QUIT the session lives on only until the replies queued before it
+ * are out.
+ */
+static int handle_client_data(const network_listener_t *listener, client_session_t *client) {
+    int result;
+    if (reserve_input(listener, client, 1) == 0) {
+        const ssize_t read_result = read_client_data(client);
+        if (read_result < 0) {
+            return -1;
+        }
+        if (read_result == 0) {
+            return 0;
+        }
+        result = process_buffered_commands(listener, client);
+    } else {
+        result = reject_request(listener, client);
+    }
+
+    const int flushed = flush_output(client);
+    if (flushed < 0 || (result != 0 && flushed == 0)) {
+        return -1;
+    }
+    if (result != 0) {
+        client->closing = 1;
+    }
+    if (flushed > 0 || client->write_blocked) {
+        return watch_output(listener, client, 1);
+    }
+    return 0;
+}
+
+static int handle_client_writable(const network_listener_t *listener, client_session_t *client) {
+    const int flushed = flush_output(client);
+    if (flushed != 0) {
+        return flushed;
+    }
+    if (client->closing) {
+        return -1;
+    }
+    return watch_output(listener, client, 0);
+}
+
 typedef struct {
     network_listener_t *listener;
     int worker_id;
 } worker_context_t;
 
-static void worker_cleanup_handler(void *arg) {
-    struct pollfd **poll_fds_ptr = arg;
-    if (poll_fds_ptr && *poll_fds_ptr) {
-        free(*poll_fds_ptr);
-        *poll_fds_ptr = NULL;
+/*
+ * Producer side of the handoff ring: only the accept thread pushes, only the
+ * owning worker pops, so head and tail each have a single writer.
+ */
+static int push_pending_client(worker_loop_t *loop, const int client_fd) {
+    const size_t tail = __atomic_load_n(&loop->pending_tail, __ATOMIC_RELAXED);
+    const size_t head = __atomic_load_n(&loop->pending_head, __ATOMIC_ACQUIRE);
+    if (tail - head == HANDOFF_SIZE) {
+        return -1;
     }
+
+    loop->pending[tail % HANDOFF_SIZE] = client_fd;
+    __atomic_store_n(&loop->pending_tail, tail + 1, __ATOMIC_RELEASE);
+
+    const uint64_t one = 1;
+    if (write(loop->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        LOG_WARN_MSG("Failed to wake worker: %s", strerror(errno));
+    }
+    return 0;
 }
 
-static struct pollfd *allocate_poll_fds() {
-    struct pollfd *poll_fds = malloc(sizeof(struct pollfd) * MAX_CLIENTS);
-    if (!poll_fds) {
-        LOG_ERROR_MSG("Failed to allocate poll_fds");
-        return NULL;
+static int pop_pending_client(worker_loop_t *loop) {
+    const size_t head = __atomic_load_n(&loop->pending_head, __ATOMIC_RELAXED);
+    const size_t tail = __atomic_load_n(&loop->pending_tail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return -1;
     }
-    return poll_fds;
+
+    const int client_fd = loop->pending[head % HANDOFF_SIZE];
+    __atomic_store_n(&loop->pending_head, head + 1, __ATOMIC_RELEASE);
+    return client_fd;
 }
 
-static int is_client_owned_by_worker(const size_t client_index, const int worker_id, const int total_workers) {
-    return client_index % total_workers == (size_t) worker_id;
+static uint64_t uring_user_data(client_session_t *client, const int op) {
+    return (uint64_t) (uintptr_t) client | (uint64_t) op;
 }
 
-static nfds_t collect_active_fds(const network_listener_t *listener, struct pollfd *poll_fds, const int worker_id) {
-    nfds_t nfds = 0;
-    for (size_t i = 0; i < listener->max_clients; i++) {
-        if (!is_client_owned_by_worker(i, worker_id, listener->workers)) {
-            continue;
-        }
+static void uring_arm_accept(const network_listener_t *listener, worker_loop_t *loop) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&loop->ring);
+    if (!sqe) {
+        LOG_ERROR_MSG("io_uring submission queue is full, cannot arm accept");
+        return;
+    }
 
-        const client_session_t *client = &listener->clients[i];
-        if (client->active && client->fd >= 0) {
-            poll_fds[nfds].fd = client->fd;
-            poll_fds[nfds].events = POLLIN;
-            poll_fds[nfds].revents = 0;
-            nfds++;
-        }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = loop->listen_fd >= 0 ? loop->listen_fd : listener->server_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = uring_user_data(NULL, URING_OP_ACCEPT);
+}
+
+static void uring_arm_wake(worker_loop_t *loop) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&loop->ring);
+    if (!sqe) {
+        LOG_ERROR_MSG("io_uring submission queue is full, cannot arm wake eventfd");
+        return;
     }
-    return nfds;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = loop->wake_fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = uring_user_data(NULL, URING_OP_WAKE);
 }
 
-static void process_clients_with_data(const network_listener_t *listener, const struct pollfd *poll_fds,
-                                      const nfds_t nfds, const int worker_id) {
-    for (nfds_t j = 0; j < nfds; j++) {
-        if (!(poll_fds[j].revents & POLLIN)) {
-            continue;
-        }
+/*
+ * One multishot recv per session stays armed for its whole life; the kernel
+ * picks a buffer from the worker's provided ring for every chunk it delivers.
+ */
+static int uring_arm_recv(worker_loop_t *loop, client_session_t *client) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&loop->ring);
+    if (!sqe) {
+        return -1;
+    }
 
-        for (size_t i = 0; i < listener->max_clients; i++) {
-            if (!is_client_owned_by_worker(i, worker_id, listener->workers)) {
-                continue;
-            }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = client->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = uring_user_data(client, URING_OP_RECV);
+    client->recv_armed = 1;
+    return 0;
+}
 
-            client_session_t *client = &listener->clients[i];
-            if (client->active && client->fd == poll_fds[j].fd) {
-                if (handle_client_data(listener, client) != 0) {
-                    LOG_INFO_MSG("Client disconnected: fd=%d", client->fd);
-                    close_client(listener, client);
-                }
-                break;
-            }
-        }
+static int uring_submit_send(worker_loop_t *loop, client_session_t *client) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&loop->ring);
+    if (!sqe) {
+        return -1;
     }
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = client->fd;
+    sqe->addr = (uint64_t) (uintptr_t) (client->sending + client->sending_pos);
+    sqe->len = (uint32_t) (client->sending_len - client->sending_pos);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = uring_user_data(client, URING_OP_SEND);
+    client->send_inflight = 1;
+    return 0;
 }
 
-static void *worker_thread_func(void *arg) {
-    worker_context_t *context = arg;
-    network_listener_t *listener = context->listener;
-    const int worker_id = context->worker_id;
+/*
+ * Hands everything queued so far to the kernel as one send by swapping the
+ * output and sending buffers.
+ */
+static int uring_start_send(worker_loop_t *loop, client_session_t *client) {
+    char *buffer = client->sending;
+    const size_t capacity = client->sending_cap;
 
-    LOG_INFO_MSG("Worker thread %d started", worker_id);
+    client->sending = client->output;
+    client->sending_cap = client->output_cap;
+    client->sending_len = client->output_len;
+    client->sending_pos = 0;
 
-    struct pollfd *poll_fds = allocate_poll_fds();
-    if (!poll_fds) {
-        free(context);
-        return NULL;
-    }
+    client->output = buffer;
+    client->output_cap = capacity;
+    client->output_len = 0;
 
-    pthread_cleanup_push(worker_cleanup_handler, &poll_fds);
+    return uring_submit_send(loop, client);
+}
 
-        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-        pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+/*
+ * Worker w owns slots w, w + workers, w + 2 * workers, ... and is the only
+ * thread that reads or changes them while the listener is running.
+ */
+static int adopt_client(network_listener_t *listener, const int worker_id, const int client_fd) {
+    for (size_t i = (size_t) worker_id; i < listener->max_clients; i += (size_t) listener->workers) {
+        client_session_t *client = &listener->clients[i];
+        if (client->active) {
+            continue;
+        }
 
-        while (!listener->stop_requested) {
-            if (pthread_mutex_lock(&listener->clients_mutex) != 0) {
-                LOG_ERROR_MSG("Worker %d: failed to lock clients_mutex", worker_id);
-                continue;
-            }
+        client->fd = client_fd;
+        client->worker = worker_id;
+        client->is_authenticated = 0;
+        client->read_pos = 0;
+        client->closing = 0;
+        client->write_blocked = 0;
 
-            const nfds_t nfds = collect_active_fds(listener, poll_fds, worker_id);
+        const int nodelay = 1;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
 
-            if (pthread_mutex_unlock(&listener->clients_mutex) != 0) {
-                LOG_ERROR_MSG("Worker %d: failed to unlock clients_mutex", worker_id);
+        if (listener->io_backend == NETWORK_IO_URING) {
+            if (uring_arm_recv(&listener->loops[worker_id], client) != 0) {
+                LOG_ERROR_MSG("Failed to arm recv for fd=%d on worker %d", client_fd, worker_id);
+                client->fd = -1;
+                return -1;
             }
+        } else {
+            if (set_nonblocking(client_fd) != 0) {
+                LOG_ERROR_MSG("Failed to make fd=%d non-blocking: %s", client_fd, strerror(errno));
+                client->fd = -1;
+                return -1;
+            }
+            struct epoll_event event = {.events = EPOLLIN, .data.ptr = client};
+            if (epoll_ctl(listener->loops[worker_id].epoll_fd, EPOLL_CTL_ADD, client_fd, &event) != 0) {
+                LOG_ERROR_MSG("Failed to register fd=%d with worker %d: %s", client_fd, worker_id,
+                              strerror(errno));
+                client->fd = -1;
+                return -1;
+            }
+        }
 
-            if (nfds > 0) {
-                const int poll_result = poll(poll_fds, nfds, 100);
-
-                if (poll_result > 0) {
-                    if (pthread_mutex_lock(&listener->clients_mutex) != 0) {
-                        LOG_ERROR_MSG("Worker %d: failed to lock clients_mutex for processing", worker_id);
-                        continue;
-                    }
+        client->active = 1;
+        stats_inc_connections(listener->executor->stats);
+        return 1;
+    }
 
-                    process_clients_with_data(listener, poll_fds, nfds, worker_id);
+    return 0;
+}
 
-                    if (pthread_mutex_unlock(&listener->clients_mutex) != 0) {
-                        LOG_ERROR_MSG("Worker %d: failed to unlock clients_mutex after processing", worker_id);
-                    }
-                }
-            } else {
-                struct pollfd dummy = {.fd = -1, .events = 0};
-                poll(&dummy, 0, 100);
-            }
+static void admit_client(network_listener_t *listener, const int worker_id, const int client_fd) {
+    const int adopted = adopt_client(listener, worker_id, client_fd);
+    if (adopted <= 0) {
+        if (adopted == 0) {
+            LOG_WARN_MSG("Too many clients, rejecting connection");
         }
+        close(client_fd);
+    }
+}
 
-    pthread_cleanup_pop(1);
-    free(context);
-    LOG_INFO_MSG("Worker thread %d finished", worker_id);
-    return NULL;
+static void adopt_pending_clients(network_listener_t *listener, const int worker_id) {
+    worker_loop_t *loop = &listener->loops[worker_id];
+
+    uint64_t wakeups;
+    if (read(loop->wake_fd, &wakeups, sizeof(wakeups)) < 0 && errno != EAGAIN) {
+        LOG_WARN_MSG("Worker %d: failed to read wake eventfd: %s", worker_id, strerror(errno));
+    }
+
+    int client_fd;
+    while ((client_fd = pop_pending_client(loop)) >= 0) {
+        admit_client(listener, worker_id, client_fd);
+    }
 }
 
 static int accept_new_connection(const int server_fd, struct sockaddr_in *client_addr, socklen_t *client_len) {
@@ -300,37 +692,306 @@ static int accept_new_connection(const int server_fd, struct sockaddr_in *client
     return client_fd;
 }
 
-static int initialize_client_slot(network_listener_t *listener, const int client_fd,
-                                  const struct sockaddr_in *client_addr) {
+static void log_new_connection(const int client_fd, const struct sockaddr_in *client_addr) {
     LOG_INFO_MSG("New connection from %s:%d (fd=%d)",
                  inet_ntoa(client_addr->sin_addr),
                  ntohs(client_addr->sin_port), client_fd);
+}
 
-    if (pthread_mutex_lock(&listener->clients_mutex) != 0) {
-        LOG_ERROR_MSG("Failed to lock clients_mutex in initialize_client_slot");
-        return 0;
-    }
+/*
+ * New connections are spread over the workers round-robin. The accept thread
+ * never touches the session table; the receiving worker picks a slot itself.
+ */
+static int hand_off_client(network_listener_t *listener, const int client_fd,
+                           const struct sockaddr_in *client_addr) {
+    log_new_connection(client_fd, client_addr);
 
-    int slot_found = 0;
-    for (size_t i = 0; i < listener->max_clients; i++) {
-        if (!listener->clients[i].active) {
-            listener->clients[i].fd = client_fd;
-            listener->clients[i].is_authenticated = 0;
-            listener->clients[i].read_pos = 0;
-            listener->clients[i].active = 1;
-            memset(listener->clients[i].read_buffer, 0, BUFFER_SIZE);
-            slot_found = 1;
-
-            stats_inc_connections(listener->executor->stats);
+    const size_t worker = listener->next_worker;
+    listener->next_worker = (worker + 1) % (size_t) listener->workers;
+
+    return push_pending_client(&listener->loops[worker], client_fd);
+}
+
+/*
+ * With reuseport every worker has its own listening socket and the kernel
+ * spreads incoming connections between them, so the backlog is drained
+ * straight into the worker's own slots without a handoff.
+ */
+static void accept_ready_clients(network_listener_t *listener, const int worker_id) {
+    const int listen_fd = listener->loops[worker_id].listen_fd;
+
+    while (!listener->stop_requested) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        const int client_fd = accept_new_connection(listen_fd, &client_addr, &client_len);
+        if (client_fd < 0) {
             break;
         }
+
+        log_new_connection(client_fd, &client_addr);
+        admit_client(listener, worker_id, client_fd);
+    }
+}
+
+/*
+ * Each worker waits on its own epoll instance, where every session it owns
+ * is registered with the session pointer as event data, so a wakeup goes
+ * straight to the clients that have input and idle connections cost nothing.
+ * The wake eventfd is registered with a NULL pointer and the worker's own
+ * listening socket, if any, with the pointer to its loop.
+ */
+static void process_ready_clients(network_listener_t *listener, const int worker_id,
+                                  const struct epoll_event *events, const int count) {
+    for (int i = 0; i < count; i++) {
+        client_session_t *client = events[i].data.ptr;
+        if (!client) {
+            adopt_pending_clients(listener, worker_id);
+            continue;
+        }
+        if (events[i].data.ptr == &listener->loops[worker_id]) {
+            accept_ready_clients(listener, worker_id);
+            continue;
+        }
+        if (!client->active) {
+            continue;
+        }
+
+        const int result = client->write_blocked ? handle_client_writable(listener, client)
+                                                  : handle_client_data(listener, client);
+        if (result < 0) {
+            LOG_INFO_MSG("Client disconnected: fd=%d", client->fd);
+            close_client(listener, client);
+        }
+    }
+}
+
+static void run_epoll_loop(network_listener_t *listener, const int worker_id) {
+    const int epoll_fd = listener->loops[worker_id].epoll_fd;
+
+    struct epoll_event events[EPOLL_BATCH];
+    while (!listener->stop_requested) {
+        const int ready = epoll_wait(epoll_fd, events, EPOLL_BATCH, 100);
+        if (ready <= 0) {
+            if (ready < 0 && errno != EINTR) {
+                LOG_ERROR_MSG("Worker %d: epoll_wait failed: %s", worker_id, strerror(errno));
+            }
+            continue;
+        }
+
+        process_ready_clients(listener, worker_id, events, ready);
+    }
+}
+
+/*
+ * A session is closed in two steps: shutdown() ends the multishot recv and
+ * fails any send, and the descriptor is released only once neither operation
+ * is still owned by the kernel. Replies queued before QUIT are sent first.
+ */
+static void uring_close_client(const network_listener_t *listener, worker_loop_t *loop, client_session_t *client) {
+    if (!client->closing) {
+        client->closing = 1;
+        if (client->output_len > 0 && !client->send_inflight && uring_start_send(loop, client) != 0) {
+            client->send_inflight = 0;
+        }
+    }
+
+    if (!client->send_inflight) {
+        shutdown(client->fd, SHUT_RDWR);
+    }
+
+    if (!client->recv_armed && !client->send_inflight) {
+        LOG_INFO_MSG("Client disconnected: fd=%d", client->fd);
+        close_client(listener, client);
+    }
+}
+
+static void uring_queue_flush(worker_loop_t *loop, client_session_t *client) {
+    if (client->output_len > 0 && !client->flush_queued) {
+        client->flush_queued = 1;
+        loop->flush_list[loop->flush_count++] = client;
+    }
+}
+
+/*
+ * Multishot accepts on one shared socket all land in whichever ring armed
+ * first, so without reuseport only worker 0 accepts and spreads connections
+ * through the same handoff rings the accept thread uses with epoll.
+ */
+static void uring_handle_accept(network_listener_t *listener, const int worker_id, const struct io_uring_cqe *cqe) {
+    worker_loop_t *loop = &listener->loops[worker_id];
+
+    if (cqe->res >= 0) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        memset(&client_addr, 0, sizeof(client_addr));
+        getpeername(cqe->res, (struct sockaddr *) &client_addr, &client_len);
+
+        if (listener->reuseport) {
+            log_new_connection(cqe->res, &client_addr);
+            admit_client(listener, worker_id, cqe->res);
+        } else if (hand_off_client(listener, cqe->res, &client_addr) != 0) {
+            LOG_WARN_MSG("Too many pending connections, rejecting fd=%d", cqe->res);
+            close(cqe->res);
+        }
+    } else if (!listener->stop_requested) {
+        LOG_ERROR_MSG("Worker %d: accept failed: %s", worker_id, strerror(-cqe->res));
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_MORE) && !listener->stop_requested) {
+        uring_arm_accept(listener, loop);
+    }
+}
+
+static void uring_handle_recv(const network_listener_t *listener, worker_loop_t *loop, client_session_t *client,
+                              const struct io_uring_cqe *cqe) {
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        client->recv_armed = 0;
+    }
+
+    if (cqe->res > 0) {
+        const unsigned short buffer_id = (unsigned short) (cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        const size_t len = (size_t) cqe->res;
+
+        int result = -1;
+        if (!client->closing && reserve_input(listener, client, len) != 0) {
+            reject_request(listener, client);
+        } else if (!client->closing) {
+            memcpy(client->read_buffer + client->read_pos, uring_buffer(&loop->ring, buffer_id), len);
+            client->read_pos += len;
+            client->read_buffer[client->read_pos] = '\0';
+            result = process_buffered_commands(listener, client);
+        }
+        uring_recycle_buffer(&loop->ring, buffer_id);
+
+        if (result != 0) {
+            uring_close_client(listener, loop, client);
+            return;
+        }
+
+        uring_queue_flush(loop, client);
+        if (!client->recv_armed && uring_arm_recv(loop, client) != 0) {
+            uring_close_client(listener, loop, client);
+        }
+        return;
+    }
+
+    if (cqe->res == -ENOBUFS && !client->closing) {
+        if (!client->recv_armed && uring_arm_recv(loop, client) != 0) {
+            uring_close_client(listener, loop, client);
+        }
+        return;
+    }
+
+    uring_close_client(listener, loop, client);
+}
+
+static void uring_handle_send(const network_listener_t *listener, worker_loop_t *loop, client_session_t *client,
+                              const struct io_uring_cqe *cqe) {
+    client->send_inflight = 0;
+
+    if (cqe->res < 0) {
+        client->output_len = 0;
+        uring_close_client(listener, loop, client);
+        return;
+    }
+
+    client->sending_pos += (size_t) cqe->res;
+    if (client->sending_pos < client->sending_len) {
+        if (uring_submit_send(loop, client) != 0) {
+            uring_close_client(listener, loop, client);
+        }
+        return;
+    }
+
+    client->sending_len = 0;
+    client->sending_pos = 0;
+
+    if (client->output_len > 0) {
+        if (uring_start_send(loop, client) != 0) {
+            uring_close_client(listener, loop, client);
+        }
+    } else if (client->closing) {
+        uring_close_client(listener, loop, client);
+    }
+}
+
+/*
+ * io_uring event loop: completions of a whole wakeup are handled first, then
+ * every session that produced replies gets one send, and all new submissions
+ * go to the kernel together with the next wait.
+ */
+static void run_uring_loop(network_listener_t *listener, const int worker_id) {
+    worker_loop_t *loop = &listener->loops[worker_id];
+
+    uring_arm_wake(loop);
+    if (listener->reuseport || worker_id == 0) {
+        uring_arm_accept(listener, loop);
+    }
+
+    while (!listener->stop_requested) {
+        if (uring_submit_and_wait(&loop->ring, 100) != 0) {
+            LOG_ERROR_MSG("Worker %d: io_uring_enter failed: %s", worker_id, strerror(errno));
+            continue;
+        }
+
+        const struct io_uring_cqe *entry;
+        while ((entry = uring_peek_cqe(&loop->ring)) != NULL) {
+            const struct io_uring_cqe cqe = *entry;
+            uring_cqe_seen(&loop->ring);
+
+            client_session_t *client = (client_session_t *) (uintptr_t) (cqe.user_data & ~(uint64_t) URING_OP_MASK);
+            switch (cqe.user_data & URING_OP_MASK) {
+                case URING_OP_ACCEPT:
+                    uring_handle_accept(listener, worker_id, &cqe);
+                    break;
+                case URING_OP_RECV:
+                    uring_handle_recv(listener, loop, client, &cqe);
+                    break;
+                case URING_OP_SEND:
+                    uring_handle_send(listener, loop, client, &cqe);
+                    break;
+                case URING_OP_WAKE:
+                    adopt_pending_clients(listener, worker_id);
+                    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                        uring_arm_wake(loop);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        for (size_t i = 0; i < loop->flush_count; i++) {
+            client_session_t *client = loop->flush_list[i];
+            client->flush_queued = 0;
+            if (client->active && !client->closing && !client->send_inflight && client->output_len > 0 &&
+                uring_start_send(loop, client) != 0) {
+                uring_close_client(listener, loop, client);
+            }
+        }
+        loop->flush_count = 0;
     }
+}
+
+static void *worker_thread_func(void *arg) {
+    worker_context_t *context = arg;
+    network_listener_t *listener = context->listener;
+    const int worker_id = context->worker_id;
 
-    if (pthread_mutex_unlock(&listener->clients_mutex) != 0) {
-        LOG_ERROR_MSG("Failed to unlock clients_mutex in initialize_client_slot");
+    LOG_INFO_MSG("Worker thread %d started", worker_id);
+
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+
+    if (listener->io_backend == NETWORK_IO_URING) {
+        run_uring_loop(listener, worker_id);
+    } else {
+        run_epoll_loop(listener, worker_id);
     }
 
-    return slot_found;
+    free(context);
+    LOG_INFO_MSG("Worker thread %d finished", worker_id);
+    return NULL;
 }
 
 static void *accept_thread_func(void *arg) {
@@ -354,10 +1015,8 @@ static void *accept_thread_func(void *arg) {
             continue;
         }
 
-        const int slot_found = initialize_client_slot(listener, client_fd, &client_addr);
-
-        if (!slot_found) {
-            LOG_WARN_MSG("Too many clients, rejecting connection");
+        if (hand_off_client(listener, client_fd, &client_addr) != 0) {
+            LOG_WARN_MSG("Too many pending connections, rejecting fd=%d", client_fd);
             close(client_fd);
         }
     }
@@ -366,23 +1025,56 @@ static void *accept_thread_func(void *arg) {
     return NULL;
 }
 
-network_listener_t *network_listener_create(const int port, const int workers, command_executor_t *executor) {
-    if (!executor || port <= 0 || workers <= 0) {
+static int create_worker_loop(worker_loop_t *loop) {
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+        return -1;
+    }
+
+    loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->wake_fd < 0) {
+        close(loop->epoll_fd);
+        return -1;
+    }
+
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &event) != 0) {
+        close(loop->wake_fd);
+        close(loop->epoll_fd);
+        return -1;
+    }
+
+    loop->listen_fd = -1;
+    loop->ring.fd = -1;
+    loop->pending_head = 0;
+    loop->pending_tail = 0;
+    return 0;
+}
+
+network_listener_t *network_listener_create(const network_listener_options_t *options,
+                                            command_executor_t *executor) {
+    if (!options || !executor || options->port <= 0 || options->workers <= 0) {
         return NULL;
     }
+    const int workers = options->workers;
 
     network_listener_t *listener = malloc(sizeof(network_listener_t));
     if (!listener) {
         return NULL;
     }
 
-    listener->port = port;
+    listener->port = options->port;
     listener->server_fd = -1;
     listener->workers = workers;
+    listener->reuseport = options->reuseport;
+    listener->io_backend = options->io_backend;
+    listener->max_request = options->max_request;
     listener->executor = executor;
+    listener->accept_thread_started = 0;
     listener->running = 0;
     listener->stop_requested = 0;
     listener->max_clients = MAX_CLIENTS;
+    listener->next_worker = 0;
 
     listener->clients = calloc(MAX_CLIENTS, sizeof(client_session_t));
     if (!listener->clients) {
@@ -395,59 +1087,161 @@ network_listener_t *network_listener_create(const int port, const int workers, c
         listener->clients[i].active = 0;
     }
 
-    if (pthread_mutex_init(&listener->clients_mutex, NULL) != 0) {
-        LOG_ERROR_MSG("Failed to initialize clients_mutex");
+    listener->worker_threads = malloc(sizeof(pthread_t) * workers);
+    listener->loops = calloc(workers, sizeof(worker_loop_t));
+    if (!listener->worker_threads || !listener->loops) {
+        free(listener->worker_threads);
+        free(listener->loops);
         free(listener->clients);
         free(listener);
         return NULL;
     }
 
-    listener->worker_threads = malloc(sizeof(pthread_t) * workers);
-    if (!listener->worker_threads) {
-        free(listener->clients);
-        free(listener);
-        return NULL;
+    for (int i = 0; i < workers; i++) {
+        if (create_worker_loop(&listener->loops[i]) != 0) {
+            LOG_ERROR_MSG("Failed to create event loop for worker %d: %s", i, strerror(errno));
+            for (int j = 0; j < i; j++) {
+                close(listener->loops[j].epoll_fd);
+                close(listener->loops[j].wake_fd);
+            }
+            free(listener->worker_threads);
+            free(listener->loops);
+            free(listener->clients);
+            free(listener);
+            return NULL;
+        }
     }
 
     return listener;
 }
 
-int network_listener_start(network_listener_t *listener) {
-    if (!listener || listener->running) {
-        return -1;
-    }
-
-    listener->server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (listener->server_fd < 0) {
+static int open_listen_socket(const int port, const int reuseport) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
         LOG_ERROR_MSG("Failed to create socket: %s", strerror(errno));
         return -1;
     }
 
     const int opt = 1;
-    if (setsockopt(listener->server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
         LOG_WARN_MSG("setsockopt SO_REUSEADDR failed: %s", strerror(errno));
     }
+    if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        LOG_ERROR_MSG("setsockopt SO_REUSEPORT failed: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
 
     struct sockaddr_in server_addr;
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(listener->port);
+    server_addr.sin_port = htons(port);
 
-    if (bind(listener->server_fd, (struct sockaddr *) &server_addr, sizeof(server_addr)) < 0) {
-        LOG_ERROR_MSG("Bind failed on port %d: %s", listener->port, strerror(errno));
-        close(listener->server_fd);
+    if (bind(fd, (struct sockaddr *) &server_addr, sizeof(server_addr)) < 0) {
+        LOG_ERROR_MSG("Bind failed on port %d: %s", port, strerror(errno));
+        close(fd);
         return -1;
     }
 
-    if (listen(listener->server_fd, BACKLOG) < 0) {
+    if (listen(fd, BACKLOG) < 0) {
         LOG_ERROR_MSG("Listen failed: %s", strerror(errno));
-        close(listener->server_fd);
+        close(fd);
+        return -1;
+    }
+
+    set_nonblocking(fd);
+    return fd;
+}
+
+static void close_worker_sockets(network_listener_t *listener) {
+    for (int i = 0; i < listener->workers; i++) {
+        if (listener->loops[i].listen_fd >= 0) {
+            close(listener->loops[i].listen_fd);
+            listener->loops[i].listen_fd = -1;
+        }
+    }
+}
+
+static int open_worker_sockets(network_listener_t *listener) {
+    for (int i = 0; i < listener->workers; i++) {
+        worker_loop_t *loop = &listener->loops[i];
+
+        loop->listen_fd = open_listen_socket(listener->port, 1);
+        if (loop->listen_fd < 0) {
+            close_worker_sockets(listener);
+            return -1;
+        }
+
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = loop};
+        if (listener->io_backend == NETWORK_IO_EPOLL &&
+            epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->listen_fd, &event) != 0) {
+            LOG_ERROR_MSG("Failed to register listening socket with worker %d: %s", i, strerror(errno));
+            close_worker_sockets(listener);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void destroy_worker_rings(network_listener_t *listener) {
+    for (int i = 0; i < listener->workers; i++) {
+        uring_destroy(&listener->loops[i].ring);
+        free(listener->loops[i].flush_list);
+        listener->loops[i].flush_list = NULL;
+    }
+}
+
+static int create_worker_rings(network_listener_t *listener) {
+    if (uring_probe_multishot_recv() != 0) {
         return -1;
     }
 
-    set_nonblocking(listener->server_fd);
+    const size_t slots = listener->max_clients / (size_t) listener->workers + 1;
+    for (int i = 0; i < listener->workers; i++) {
+        worker_loop_t *loop = &listener->loops[i];
 
-    LOG_INFO_MSG("Server listening on port %d", listener->port);
+        if (uring_init(&loop->ring, URING_ENTRIES) != 0 ||
+            uring_setup_buffers(&loop->ring, URING_BUFFERS, URING_BUFFER_SIZE, URING_BUFFER_GROUP) != 0) {
+            const int error = errno;
+            destroy_worker_rings(listener);
+            errno = error;
+            return -1;
+        }
+
+        loop->flush_list = malloc(sizeof(client_session_t *) * slots);
+        loop->flush_count = 0;
+        if (!loop->flush_list) {
+            destroy_worker_rings(listener);
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int network_listener_start(network_listener_t *listener) {
+    if (!listener || listener->running) {
+        return -1;
+    }
+
+    if (listener->io_backend == NETWORK_IO_URING && create_worker_rings(listener) != 0) {
+        LOG_WARN_MSG("io_uring backend is not available (%s), falling back to epoll", strerror(errno));
+        listener->io_backend = NETWORK_IO_EPOLL;
+    }
+    LOG_INFO_MSG("Network I/O backend: %s", network_io_backend_name(listener->io_backend));
+
+    if (listener->reuseport) {
+        if (open_worker_sockets(listener) != 0) {
+            return -1;
+        }
+        LOG_INFO_MSG("Server listening on port %d (%d SO_REUSEPORT sockets)", listener->port, listener->workers);
+    } else {
+        listener->server_fd = open_listen_socket(listener->port, 0);
+        if (listener->server_fd < 0) {
+            return -1;
+        }
+        LOG_INFO_MSG("Server listening on port %d", listener->port);
+    }
 
     listener->running = 1;
     listener->stop_requested = 0;
@@ -499,6 +1293,10 @@ int network_listener_start(network_listener_t *listener) {
 
     free(contexts);
 
+    if (listener->io_backend == NETWORK_IO_URING || listener->reuseport) {
+        return 0;
+    }
+
     if (pthread_create(&listener->accept_thread, NULL, accept_thread_func, listener) != 0) {
         LOG_ERROR_MSG("Failed to create accept thread");
         listener->stop_requested = 1;
@@ -511,6 +1309,7 @@ int network_listener_start(network_listener_t *listener) {
         }
         return -1;
     }
+    listener->accept_thread_started = 1;
 
     return 0;
 }
@@ -530,12 +1329,17 @@ void network_listener_stop(network_listener_t *listener, const int timeout_sec)
         close(listener->server_fd);
         listener->server_fd = -1;
     }
+    for (int i = 0; i < listener->workers; i++) {
+        if (listener->loops[i].listen_fd >= 0) {
+            shutdown(listener->loops[i].listen_fd, SHUT_RDWR);
+        }
+    }
 
     LOG_INFO_MSG("Step 2: Waiting for threads to finish (up to %d seconds)", timeout_sec);
 
     const time_t start_time = time(NULL);
 
-    {
+    if (listener->accept_thread_started) {
         LOG_DEBUG_MSG("Waiting for accept thread...");
         const time_t accept_start = time(NULL);
         const time_t elapsed = accept_start - start_time;
@@ -584,14 +1388,23 @@ void network_listener_stop(network_listener_t *listener, const int timeout_sec)
         }
     }
 
+    close_worker_sockets(listener);
+    if (listener->io_backend == NETWORK_IO_URING) {
+        destroy_worker_rings(listener);
+    }
+    listener->accept_thread_started = 0;
+
     LOG_INFO_MSG("Step 3: Closing all client connections");
 
-    if (pthread_mutex_lock(&listener->clients_mutex) != 0) {
-        LOG_ERROR_MSG("Failed to lock clients_mutex in network_listener_stop");
-        return;
+    int closed_count = 0;
+    for (int i = 0; i < listener->workers; i++) {
+        int client_fd;
+        while ((client_fd = pop_pending_client(&listener->loops[i])) >= 0) {
+            close(client_fd);
+            closed_count++;
+        }
     }
 
-    int closed_count = 0;
     for (size_t i = 0; i < listener->max_clients; i++) {
         if (listener->clients[i].active) {
             LOG_DEBUG_MSG("Closing client connection: fd=%d", listener->clients[i].fd);
@@ -600,10 +1413,6 @@ void network_listener_stop(network_listener_t *listener, const int timeout_sec)
         }
     }
 
-    if (pthread_mutex_unlock(&listener->clients_mutex) != 0) {
-        LOG_ERROR_MSG("Failed to unlock clients_mutex in network_listener_stop");
-    }
-
     LOG_INFO_MSG("Closed %d client connections", closed_count);
 
     listener->running = 0;
@@ -620,9 +1429,32 @@ void network_listener_destroy(network_listener_t *listener) {
         network_listener_stop(listener, 5);
     }
 
-    pthread_mutex_destroy(&listener->clients_mutex);
+    for (int i = 0; i < listener->workers; i++) {
+        close(listener->loops[i].epoll_fd);
+        close(listener->loops[i].wake_fd);
+    }
 
+    free(listener->loops);
     free(listener->worker_threads);
     free(listener->clients);
     free(listener);
 }
+
+const char *network_io_backend_name(const network_io_backend_t backend) {
+    return backend == NETWORK_IO_URING ? "io_uring" : "epoll";
+}
+
+int network_io_backend_parse(const char *name, network_io_backend_t *backend) {
+    if (!name || !backend) {
+        return -1;
+    }
+
+    if (strcasecmp(name, "epoll") == 0) {
+        *backend = NETWORK_IO_EPOLL;
+    } else if (strcasecmp(name, "io_uring") == 0) {
+        *backend = NETWORK_IO_URING;
+    } else {
+        return -1;
+    }
+    return 0;
+}
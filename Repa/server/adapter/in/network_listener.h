@@ -4,7 +4,22 @@
 
 typedef struct network_listener network_listener_t;
 
-network_listener_t* network_listener_create(int port, int workers, command_executor_t *executor);
+#define NETWORK_MAX_REQUEST_MB 512
+
+typedef enum {
+    NETWORK_IO_EPOLL,
+    NETWORK_IO_URING
+} network_io_backend_t;
+
+typedef struct {
+    int port;
+    int workers;
+    int reuseport;
+    network_io_backend_t io_backend;
+    size_t max_request;
+} network_listener_options_t;
+
+network_listener_t* network_listener_create(const network_listener_options_t *options, command_executor_t *executor);
 
 int network_listener_start(network_listener_t *listener);
 
@@ -12,3 +27,6 @@ void network_listener_stop(network_listener_t *listener, int timeout_sec);
 
 void network_listener_destroy(network_listener_t *listener);
 
+const char *network_io_backend_name(network_io_backend_t backend);
+
+int network_io_backend_parse(const char *name, network_io_backend_t *backend);
@@ -0,0 +1,290 @@
+#define _DEFAULT_SOURCE // MAP_POPULATE, MAP_ANONYMOUS
+
+#include "uring.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+static int sys_io_uring_setup(const unsigned entries, struct io_uring_params *params) {
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(const int fd, const unsigned to_submit, const unsigned min_complete,
+                              const unsigned flags, const void *arg, const size_t arg_size) {
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static int sys_io_uring_register(const int fd, const unsigned opcode, const void *arg, const unsigned nr_args) {
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/*
+ * Waiting with a timeout goes through IORING_ENTER_EXT_ARG, and both rings
+ * are mapped with one mmap, so kernels without these features are rejected
+ * here and the caller falls back to epoll.
+ */
+int uring_init(uring_t *ring, const unsigned entries) {
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+
+    const int fd = sys_io_uring_setup(entries, &params);
+    if (fd < 0) {
+        return -1;
+    }
+
+    const unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required) != required) {
+        close(fd);
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    ring->fd = fd;
+    ring->sq_map_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (ring->cq_map_len > ring->sq_map_len) {
+        ring->sq_map_len = ring->cq_map_len;
+    }
+    ring->cq_map_len = ring->sq_map_len;
+
+    ring->sq_map = mmap(NULL, ring->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED) {
+        ring->sq_map = NULL;
+        uring_destroy(ring);
+        return -1;
+    }
+    ring->cq_map = ring->sq_map;
+
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        uring_destroy(ring);
+        return -1;
+    }
+
+    char *sq = ring->sq_map;
+    ring->sq_head = (unsigned *) (sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+    ring->sq_mask = *(unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+
+    char *cq = ring->cq_map;
+    ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    for (unsigned i = 0; i < ring->sq_entries; i++) {
+        ring->sq_array[i] = i;
+    }
+    return 0;
+}
+
+void uring_destroy(uring_t *ring) {
+    if (ring->fd >= 0) {
+        close(ring->fd);
+        ring->fd = -1;
+    }
+    if (ring->buf_ring) {
+        munmap(ring->buf_ring, ring->buf_ring_len);
+        ring->buf_ring = NULL;
+    }
+    free(ring->buffers);
+    ring->buffers = NULL;
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_len);
+        ring->sqes = NULL;
+    }
+    if (ring->sq_map) {
+        munmap(ring->sq_map, ring->sq_map_len);
+        ring->sq_map = NULL;
+        ring->cq_map = NULL;
+    }
+}
+
+/*
+ * Registers a provided buffer ring: multishot recv picks a free buffer for
+ * every completion, and the owner hands it back with uring_recycle_buffer once
+ * the data has been copied out. count must be a power of two.
+ */
+int uring_setup_buffers(uring_t *ring, const unsigned count, const unsigned size, const unsigned short group) {
+    ring->buf_ring_len = count * sizeof(struct io_uring_buf);
+    void *map = mmap(NULL, ring->buf_ring_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    ring->buf_ring = map;
+
+    ring->buffers = malloc((size_t) count * size);
+    if (!ring->buffers) {
+        munmap(ring->buf_ring, ring->buf_ring_len);
+        ring->buf_ring = NULL;
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t) (uintptr_t) ring->buf_ring;
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (sys_io_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        free(ring->buffers);
+        ring->buffers = NULL;
+        munmap(ring->buf_ring, ring->buf_ring_len);
+        ring->buf_ring = NULL;
+        return -1;
+    }
+
+    ring->buffer_count = count;
+    ring->buffer_size = size;
+    ring->buffer_group = group;
+    for (unsigned i = 0; i < count; i++) {
+        uring_recycle_buffer(ring, (unsigned short) i);
+    }
+    return 0;
+}
+
+char *uring_buffer(const uring_t *ring, const unsigned short id) {
+    return ring->buffers + (size_t) id * ring->buffer_size;
+}
+
+void uring_recycle_buffer(uring_t *ring, const unsigned short id) {
+    const unsigned short tail = ring->buf_ring->tail;
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[tail & (ring->buffer_count - 1)];
+    buf->addr = (uint64_t) (uintptr_t) uring_buffer(ring, id);
+    buf->len = ring->buffer_size;
+    buf->bid = id;
+    __atomic_store_n(&ring->buf_ring->tail, (unsigned short) (tail + 1), __ATOMIC_RELEASE);
+}
+
+/*
+ * Returns a zeroed SQE, flushing the queue to the kernel first when it is
+ * full; NULL only if even that fails.
+ */
+struct io_uring_sqe *uring_get_sqe(uring_t *ring) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *ring->sq_tail + ring->sq_pending;
+    if (tail - head >= ring->sq_entries) {
+        if (uring_submit_and_wait(ring, 0) < 0) {
+            return NULL;
+        }
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        tail = *ring->sq_tail + ring->sq_pending;
+        if (tail - head >= ring->sq_entries) {
+            return NULL;
+        }
+    }
+
+    struct io_uring_sqe *sqe = &ring->sqes[tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_pending++;
+    return sqe;
+}
+
+/*
+ * Submits everything queued with one io_uring_enter and, unless timeout_ms
+ * is 0, waits until at least one completion arrives or the timeout expires.
+ */
+int uring_submit_and_wait(uring_t *ring, const unsigned timeout_ms) {
+    const unsigned to_submit = ring->sq_pending;
+    if (to_submit > 0) {
+        __atomic_store_n(ring->sq_tail, *ring->sq_tail + to_submit, __ATOMIC_RELEASE);
+        ring->sq_pending = 0;
+    }
+
+    const int cq_ready = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) != *ring->cq_head;
+    if (timeout_ms == 0 || cq_ready) {
+        if (to_submit == 0) {
+            return 0;
+        }
+        const int result = sys_io_uring_enter(ring->fd, to_submit, 0, 0, NULL, 0);
+        return result < 0 && errno != EINTR && errno != EBUSY ? -1 : 0;
+    }
+
+    struct __kernel_timespec ts = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_nsec = (long long) (timeout_ms % 1000) * 1000000
+    };
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t) (uintptr_t) &ts;
+
+    const int result = sys_io_uring_enter(ring->fd, to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                                          &arg, sizeof(arg));
+    if (result < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) {
+        return -1;
+    }
+    return 0;
+}
+
+struct io_uring_cqe *uring_peek_cqe(const uring_t *ring) {
+    const unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+void uring_cqe_seen(const uring_t *ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Multishot recv with provided buffers needs Linux 6.0, while the ring itself
+ * and multishot accept appear earlier, so the only reliable check is to run a
+ * recv over a socketpair and see that it stays armed.
+ */
+int uring_probe_multishot_recv(void) {
+    uring_t ring;
+    if (uring_init(&ring, 4) != 0) {
+        return -1;
+    }
+    if (uring_setup_buffers(&ring, 4, 64, 0) != 0) {
+        uring_destroy(&ring);
+        return -1;
+    }
+
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        uring_destroy(&ring);
+        return -1;
+    }
+
+    int supported = 0;
+    struct io_uring_sqe *sqe = uring_get_sqe(&ring);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = pair[0];
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+
+    if (uring_submit_and_wait(&ring, 0) == 0 && write(pair[1], "x", 1) == 1 &&
+        uring_submit_and_wait(&ring, 100) == 0) {
+        const struct io_uring_cqe *cqe = uring_peek_cqe(&ring);
+        supported = cqe && cqe->res == 1 && (cqe->flags & IORING_CQE_F_MORE);
+    }
+
+    close(pair[0]);
+    close(pair[1]);
+    uring_destroy(&ring);
+
+    if (!supported) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    return 0;
+}
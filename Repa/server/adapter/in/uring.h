@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+/*
+ * Minimal io_uring ring on top of the raw syscalls: submission and completion
+ * queues mapped from the kernel plus one provided buffer ring for multishot
+ * recv. A ring is owned by one thread and needs no locking.
+ */
+typedef struct {
+    int fd;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_pending;
+    struct io_uring_sqe *sqes;
+
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_map;
+    size_t sq_map_len;
+    void *cq_map;
+    size_t cq_map_len;
+    size_t sqes_len;
+
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_len;
+    char *buffers;
+    unsigned buffer_count;
+    unsigned buffer_size;
+    unsigned short buffer_group;
+} uring_t;
+
+int uring_probe_multishot_recv(void);
+
+int uring_init(uring_t *ring, unsigned entries);
+
+void uring_destroy(uring_t *ring);
+
+int uring_setup_buffers(uring_t *ring, unsigned count, unsigned size, unsigned short group);
+
+char *uring_buffer(const uring_t *ring, unsigned short id);
+
+void uring_recycle_buffer(uring_t *ring, unsigned short id);
+
+struct io_uring_sqe *uring_get_sqe(uring_t *ring);
+
+int uring_submit_and_wait(uring_t *ring, unsigned timeout_ms);
+
+struct io_uring_cqe *uring_peek_cqe(const uring_t *ring);
+
+void uring_cqe_seen(const uring_t *ring);
@@ -10,6 +10,7 @@
 #include <errno.h>
 #include <libgen.h>
 #include "../logger/logger.h"
+#include "../model/coarse_clock.h"
 #include "../service/storage.h"
 #include "../service/auth.h"
 #include "../service/command_executor.h"
@@ -60,13 +61,20 @@ typedef struct {
     pthread_cond_t cond;
 } maintenance_ctx_t;
 
+#define MAINTENANCE_HZ 10
+#define MAINTENANCE_REHASH_BUDGET_US 1000
+
 static void *maintenance_thread(void *arg) {
     maintenance_ctx_t *ctx = arg;
 
     while (!*ctx->shutdown_flag) {
         struct timespec ts;
         clock_gettime(CLOCK_REALTIME, &ts);
-        ts.tv_sec += 1;
+        ts.tv_nsec += 1000000000L / MAINTENANCE_HZ;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
 
         pthread_mutex_lock(&ctx->mutex);
         pthread_cond_timedwait(&ctx->cond, &ctx->mutex, &ts);
@@ -74,6 +82,8 @@ static void *maintenance_thread(void *arg) {
 
         if (*ctx->shutdown_flag) break;
 
+        storage_rehash_for(ctx->storage, MAINTENANCE_REHASH_BUDGET_US);
+
         const size_t cleaned = storage_cleanup_expired(ctx->storage);
         if (cleaned > 0) {
             LOG_DEBUG_MSG("Cleaned up %zu expired keys", cleaned);
@@ -141,6 +151,15 @@ int app_run(app_config_t *config) {
     LOG_INFO_MSG("Port: %d", config->port);
     LOG_INFO_MSG("Max memory: %zu MB", config->max_memory_mb);
     LOG_INFO_MSG("Workers: %d", config->workers);
+    LOG_INFO_MSG("I/O backend: %s", config->io_backend);
+    LOG_INFO_MSG("Max request size: %zu MB", config->max_request_mb);
+    LOG_INFO_MSG("Accept mode: %s", config->reuseport ? "SO_REUSEPORT socket per worker" : "single accept thread");
+    LOG_INFO_MSG("Storage shards: %zu", config->shards);
+    LOG_INFO_MSG("Lock-free reads: %s", config->lockfree_reads ? "enabled" : "disabled");
+    LOG_INFO_MSG("Eviction samples: %u", config->eviction_samples);
+    LOG_INFO_MSG("Eviction policy: %s", config->eviction_policy);
+    LOG_INFO_MSG("Active expire budget: %ld us", config->active_expire_budget_us);
+    LOG_INFO_MSG("Storage index: %s", config->storage_index);
     LOG_INFO_MSG("Default TTL: %ld seconds", (long)config->default_ttl);
     LOG_INFO_MSG("Log level: %s", config->log_level);
     LOG_INFO_MSG("Default user: %s", config->default_user);
@@ -154,9 +173,67 @@ int app_run(app_config_t *config) {
         return EXIT_FAILURE;
     }
 
-    storage_t *storage = storage_create(config->max_memory_mb * 1024 * 1024, config->default_ttl, &stats);
+    storage_index_t storage_index;
+    if (storage_index_parse(config->storage_index, &storage_index) != 0) {
+        LOG_ERROR_MSG("Unknown storage index '%s' (expected chain or swiss)", config->storage_index);
+        stats_destroy(&stats);
+        logger_fini();
+        return EXIT_FAILURE;
+    }
+
+    network_io_backend_t io_backend;
+    if (network_io_backend_parse(config->io_backend, &io_backend) != 0) {
+        LOG_ERROR_MSG("Unknown I/O backend '%s' (expected epoll or io_uring)", config->io_backend);
+        stats_destroy(&stats);
+        logger_fini();
+        return EXIT_FAILURE;
+    }
+
+    if (config->max_request_mb == 0 || config->max_request_mb > NETWORK_MAX_REQUEST_MB) {
+        LOG_ERROR_MSG("max_request_mb must be between 1 and %d", NETWORK_MAX_REQUEST_MB);
+        stats_destroy(&stats);
+        logger_fini();
+        return EXIT_FAILURE;
+    }
+
+    storage_policy_t eviction_policy;
+    if (storage_policy_parse(config->eviction_policy, &eviction_policy) != 0) {
+        LOG_ERROR_MSG("Unknown eviction policy '%s' (expected allkeys-lru, allkeys-lfu, volatile-ttl, "
+                      "noeviction or w-tinylfu)", config->eviction_policy);
+        stats_destroy(&stats);
+        logger_fini();
+        return EXIT_FAILURE;
+    }
+
+    if (config->eviction_samples == 0 || config->eviction_samples > STORAGE_MAX_EVICTION_SAMPLES) {
+        LOG_ERROR_MSG("eviction_samples must be between 1 and %d", STORAGE_MAX_EVICTION_SAMPLES);
+        stats_destroy(&stats);
+        logger_fini();
+        return EXIT_FAILURE;
+    }
+
+    if (config->active_expire_budget_us < STORAGE_MIN_EXPIRE_BUDGET_US ||
+        config->active_expire_budget_us > STORAGE_MAX_EXPIRE_BUDGET_US) {
+        LOG_ERROR_MSG("active_expire_budget_us must be between %d and %d",
+                      STORAGE_MIN_EXPIRE_BUDGET_US, STORAGE_MAX_EXPIRE_BUDGET_US);
+        stats_destroy(&stats);
+        logger_fini();
+        return EXIT_FAILURE;
+    }
+
+    const storage_options_t storage_options = {
+        .max_memory = config->max_memory_mb * 1024 * 1024,
+        .default_ttl = config->default_ttl,
+        .shards = config->shards,
+        .lockfree_reads = config->lockfree_reads,
+        .eviction_samples = config->eviction_samples,
+        .policy = eviction_policy,
+        .expire_budget_us = config->active_expire_budget_us,
+        .index = storage_index,
+    };
+    storage_t *storage = storage_create(&storage_options, &stats);
     if (!storage) {
-        LOG_ERROR_MSG("Failed to initialize storage");
+        LOG_ERROR_MSG("Failed to initialize storage (shards must be a power of two up to %d)", STORAGE_MAX_SHARDS);
         stats_destroy(&stats);
         logger_fini();
         return EXIT_FAILURE;
@@ -196,7 +273,14 @@ int app_run(app_config_t *config) {
     }
     LOG_INFO_MSG("Command executor initialized");
 
-    network_listener_t *listener = network_listener_create(config->port, config->workers, executor);
+    const network_listener_options_t listener_options = {
+        .port = config->port,
+        .workers = config->workers,
+        .reuseport = config->reuseport,
+        .io_backend = io_backend,
+        .max_request = config->max_request_mb * 1024 * 1024,
+    };
+    network_listener_t *listener = network_listener_create(&listener_options, executor);
     if (!listener) {
         LOG_ERROR_MSG("Failed to create network listener");
         command_executor_destroy(executor);
@@ -209,8 +293,13 @@ int app_run(app_config_t *config) {
     }
     LOG_INFO_MSG("Network listener created");
 
+    if (coarse_clock_start() != 0) {
+        LOG_WARN_MSG("Failed to start clock ticker, reading the system clock on every operation");
+    }
+
     if (network_listener_start(listener) != 0) {
         LOG_ERROR_MSG("Failed to start network listener");
+        coarse_clock_stop();
         network_listener_destroy(listener);
         command_executor_destroy(executor);
         runtime_config_destroy(runtime_config);
@@ -232,6 +321,7 @@ int app_run(app_config_t *config) {
     if (pthread_create(&maint_thread, NULL, maintenance_thread, &maint_ctx) != 0) {
         LOG_ERROR_MSG("Failed to create maintenance thread");
         network_listener_stop(listener, 5);
+        coarse_clock_stop();
         network_listener_destroy(listener);
         command_executor_destroy(executor);
         runtime_config_destroy(runtime_config);
@@ -256,6 +346,7 @@ int app_run(app_config_t *config) {
     sigwait(&sigset, &sig);
 
     LOG_INFO_MSG("Received shutdown signal");
+    config->shutdown_requested = 1;
 
     pthread_mutex_lock(&maint_ctx.mutex);
     pthread_cond_signal(&maint_ctx.cond);
@@ -266,6 +357,7 @@ int app_run(app_config_t *config) {
     pthread_mutex_destroy(&maint_ctx.mutex);
 
     network_listener_stop(listener, 5);
+    coarse_clock_stop();
 
     network_listener_destroy(listener);
     command_executor_destroy(executor);
@@ -13,6 +13,15 @@ app_config_t* app_config_default(void) {
     config->verbose = 0;
     config->max_memory_mb = 256;
     config->workers = 4;
+    config->reuseport = 0;
+    config->io_backend = strdup("epoll");
+    config->max_request_mb = 8;
+    config->shards = 16;
+    config->lockfree_reads = 0;
+    config->storage_index = strdup("chain");
+    config->eviction_samples = 5;
+    config->eviction_policy = strdup("allkeys-lru");
+    config->active_expire_budget_us = 25000;
     config->default_ttl = 0;
     config->log_path = strdup("repa.log");
     config->default_user = strdup("admin");
@@ -42,6 +51,10 @@ static void trim(char *str) {
     }
 }
 
+static int parse_bool(const char *value) {
+    return strcmp(value, "yes") == 0 || strcmp(value, "true") == 0 || strcmp(value, "1") == 0;
+}
+
 int app_config_load_file(app_config_t *config, const char *path) {
     if (!config || !path) return -1;
 
@@ -81,6 +94,27 @@ int app_config_load_file(app_config_t *config, const char *path) {
             config->max_memory_mb = atoi(value);
         } else if (strcmp(key, "workers") == 0) {
             config->workers = atoi(value);
+        } else if (strcmp(key, "reuseport") == 0) {
+            config->reuseport = parse_bool(value);
+        } else if (strcmp(key, "io_backend") == 0) {
+            free(config->io_backend);
+            config->io_backend = strdup(value);
+        } else if (strcmp(key, "max_request_mb") == 0) {
+            config->max_request_mb = atoi(value);
+        } else if (strcmp(key, "shards") == 0) {
+            config->shards = atoi(value);
+        } else if (strcmp(key, "lockfree_reads") == 0) {
+            config->lockfree_reads = parse_bool(value);
+        } else if (strcmp(key, "index") == 0) {
+            free(config->storage_index);
+            config->storage_index = strdup(value);
+        } else if (strcmp(key, "eviction_samples") == 0) {
+            config->eviction_samples = atoi(value);
+        } else if (strcmp(key, "eviction_policy") == 0) {
+            free(config->eviction_policy);
+            config->eviction_policy = strdup(value);
+        } else if (strcmp(key, "active_expire_budget_us") == 0) {
+            config->active_expire_budget_us = atol(value);
         } else if (strcmp(key, "default_ttl") == 0) {
             config->default_ttl = atoi(value);
         } else if (strcmp(key, "log_level") == 0) {
@@ -113,12 +147,26 @@ static void print_help(const char *prog_name) {
     printf("  --verbose             Enable verbose logging\n");
     printf("  --max-memory-mb <num> Maximum memory in megabytes (default: 256)\n");
     printf("  --workers <num>       Number of worker threads (default: 4)\n");
+    printf("  --reuseport           Give every worker its own SO_REUSEPORT listening socket\n");
+    printf("  --io-backend <type>   Network I/O backend: epoll or io_uring (default: epoll)\n");
+    printf("  --shards <num>        Number of storage shards, power of two (default: 16)\n");
+    printf("  --lockfree-reads      Serve GET/EXISTS/TTL without taking shard locks\n");
+    printf("  --index <type>        Storage hash index: chain or swiss (default: chain)\n");
     printf("  --default-ttl <sec>   Default TTL in seconds, 0 = no expiry (default: 0)\n");
     printf("  --help                Show this help message\n\n");
     printf("Configuration file format (repa.conf):\n");
     printf("  port = 6380\n");
     printf("  max_memory_mb = 256\n");
     printf("  workers = 4\n");
+    printf("  reuseport = no\n");
+    printf("  io_backend = epoll\n");
+    printf("  max_request_mb = 8\n");
+    printf("  shards = 16\n");
+    printf("  lockfree_reads = no\n");
+    printf("  index = chain\n");
+    printf("  eviction_samples = 5\n");
+    printf("  eviction_policy = allkeys-lru\n");
+    printf("  active_expire_budget_us = 25000\n");
     printf("  default_ttl = 0\n");
     printf("  log_level = info\n");
     printf("  log_output = repa.log\n");
@@ -135,13 +183,18 @@ int app_config_parse_args(app_config_t *config, const int argc, char *argv[]) {
         {"verbose", no_argument, 0, 'v'},
         {"max-memory-mb", required_argument, 0, 'm'},
         {"workers", required_argument, 0, 'w'},
+        {"reuseport", no_argument, 0, 'r'},
+        {"io-backend", required_argument, 0, 'b'},
+        {"shards", required_argument, 0, 's'},
+        {"lockfree-reads", no_argument, 0, 'l'},
+        {"index", required_argument, 0, 'i'},
         {"default-ttl", required_argument, 0, 't'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
 
     int opt, option_index = 0;
-    while ((opt = getopt_long(argc, argv, "p:c:vm:w:t:h", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "p:c:vm:w:rb:s:li:t:h", long_options, &option_index)) != -1) {
         switch (opt) {
             case 'p':
                 config->port = atoi(optarg);
@@ -159,6 +212,23 @@ int app_config_parse_args(app_config_t *config, const int argc, char *argv[]) {
             case 'w':
                 config->workers = atoi(optarg);
                 break;
+            case 'r':
+                config->reuseport = 1;
+                break;
+            case 'b':
+                free(config->io_backend);
+                config->io_backend = strdup(optarg);
+                break;
+            case 's':
+                config->shards = atoi(optarg);
+                break;
+            case 'l':
+                config->lockfree_reads = 1;
+                break;
+            case 'i':
+                free(config->storage_index);
+                config->storage_index = strdup(optarg);
+                break;
             case 't':
                 config->default_ttl = atoi(optarg);
                 break;
@@ -182,5 +252,8 @@ void app_config_free(app_config_t *config) {
     free(config->default_user);
     free(config->default_password);
     free(config->log_level);
+    free(config->storage_index);
+    free(config->eviction_policy);
+    free(config->io_backend);
     free(config);
 }
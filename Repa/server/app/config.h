@@ -9,6 +9,15 @@ typedef struct {
     int verbose;
     size_t max_memory_mb;
     int workers;
+    int reuseport;
+    char *io_backend;
+    size_t max_request_mb;
+    size_t shards;
+    int lockfree_reads;
+    char *storage_index;
+    unsigned eviction_samples;
+    char *eviction_policy;
+    long active_expire_budget_us;
     time_t default_ttl;
     char *log_path;
     char *default_user;
@@ -1,4 +1,5 @@
 #include "../logger/logger.h"
+#include "../model/coarse_clock.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,10 +36,19 @@ static const char* level_to_string(const log_level_t level) {
     }
 }
 
-static void get_timestamp(char *buffer) {
-    const time_t now = time(NULL);
-    const struct tm *tm_info = localtime(&now);
-    strftime(buffer, 64, "%Y-%m-%d %H:%M:%S", tm_info);
+/* Called under the logger mutex; the text is rebuilt only when the second changes. */
+static const char *get_timestamp(void) {
+    static time_t cached_second = -1;
+    static char cached[64];
+
+    const time_t now = (time_t) (coarse_clock_unix_ms() / 1000);
+    if (now != cached_second) {
+        struct tm tm_info;
+        localtime_r(&now, &tm_info);
+        strftime(cached, sizeof(cached), "%Y-%m-%d %H:%M:%S", &tm_info);
+        cached_second = now;
+    }
+    return cached;
 }
 
 static void rotate_log_if_needed(void) {
@@ -129,13 +139,10 @@ int logger_write(const log_output_t output, const log_level_t level,
         out = stderr;
     }
 
-    char timestamp[64];
-    get_timestamp(timestamp);
-
     const pthread_t tid = pthread_self();
 
     fprintf(out, "[%s] [%s] [tid:%lu] [%s:%d] ",
-            timestamp, level_to_string(level),
+            get_timestamp(), level_to_string(level),
             (unsigned long)tid, filename, line);
 
     va_list args;
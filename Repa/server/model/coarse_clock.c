@@ -0,0 +1,67 @@
+#include "coarse_clock.h"
+#include <pthread.h>
+#include <time.h>
+
+_Atomic uint64_t g_coarse_monotonic_ms = 0;
+_Atomic uint64_t g_coarse_unix_ms = 0;
+
+static pthread_t g_ticker;
+static atomic_int g_running = 0;
+
+static uint64_t read_ms(const clockid_t id) {
+    struct timespec now;
+    clock_gettime(id, &now);
+    return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
+
+uint64_t coarse_clock_read_monotonic_ms(void) {
+    return read_ms(CLOCK_MONOTONIC);
+}
+
+uint64_t coarse_clock_read_unix_ms(void) {
+    return read_ms(CLOCK_REALTIME);
+}
+
+static void update(void) {
+    atomic_store_explicit(&g_coarse_monotonic_ms, coarse_clock_read_monotonic_ms(), memory_order_relaxed);
+    atomic_store_explicit(&g_coarse_unix_ms, coarse_clock_read_unix_ms(), memory_order_relaxed);
+}
+
+static void *ticker_thread(void *arg) {
+    (void) arg;
+    const struct timespec tick = {0, COARSE_CLOCK_TICK_US * 1000L};
+
+    while (atomic_load_explicit(&g_running, memory_order_relaxed)) {
+        nanosleep(&tick, NULL);
+        update();
+    }
+
+    return NULL;
+}
+
+int coarse_clock_start(void) {
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&g_running, &expected, 1)) {
+        return 0;
+    }
+
+    update();
+    if (pthread_create(&g_ticker, NULL, ticker_thread, NULL) != 0) {
+        atomic_store(&g_running, 0);
+        atomic_store(&g_coarse_monotonic_ms, 0);
+        atomic_store(&g_coarse_unix_ms, 0);
+        return -1;
+    }
+    return 0;
+}
+
+void coarse_clock_stop(void) {
+    int expected = 1;
+    if (!atomic_compare_exchange_strong(&g_running, &expected, 0)) {
+        return;
+    }
+
+    pthread_join(g_ticker, NULL);
+    atomic_store(&g_coarse_monotonic_ms, 0);
+    atomic_store(&g_coarse_unix_ms, 0);
+}
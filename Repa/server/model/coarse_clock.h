@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define COARSE_CLOCK_TICK_US 1000
+
+extern _Atomic uint64_t g_coarse_monotonic_ms;
+extern _Atomic uint64_t g_coarse_unix_ms;
+
+int coarse_clock_start(void);
+
+void coarse_clock_stop(void);
+
+uint64_t coarse_clock_read_monotonic_ms(void);
+
+uint64_t coarse_clock_read_unix_ms(void);
+
+/*
+ * Both readers are a single relaxed load while the ticker runs; before it
+ * starts (or after it stops) the cached value is zero and they fall back to
+ * reading the clock directly.
+ */
+static inline uint64_t coarse_clock_monotonic_ms(void) {
+    const uint64_t now = atomic_load_explicit(&g_coarse_monotonic_ms, memory_order_relaxed);
+    return now ? now : coarse_clock_read_monotonic_ms();
+}
+
+static inline uint64_t coarse_clock_unix_ms(void) {
+    const uint64_t now = atomic_load_explicit(&g_coarse_unix_ms, memory_order_relaxed);
+    return now ? now : coarse_clock_read_unix_ms();
+}
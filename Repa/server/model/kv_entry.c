@@ -1,78 +1,437 @@
 #include "kv_entry.h"
+#include "coarse_clock.h"
+#include "slab.h"
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-kv_entry_t *kv_entry_create(const char *key, const char *value, size_t value_len, const time_t ttl) {
-    kv_entry_t *entry = calloc(1, sizeof(kv_entry_t));
-    if (!entry) {
-        return NULL;
-    }
+static size_t entry_size(const size_t key_len, const size_t value_len) {
+    return KV_ENTRY_HEADER_SIZE + key_len + 1 + value_len;
+}
 
-    entry->key = strdup(key);
-    if (!entry->key) {
-        free(entry);
+kv_entry_t *kv_entry_create(const char *key, const size_t key_len, const char *value, const size_t value_len,
+                            const uint64_t expires_at) {
+    if (key_len > KV_KEY_MAX || value_len > UINT32_MAX) {
         return NULL;
     }
 
-    entry->value = malloc(value_len);
-    if (!entry->value) {
-        free(entry->key);
-        free(entry);
+    kv_entry_t *entry = slab_alloc(entry_size(key_len, value_len));
+    if (!entry) {
         return NULL;
     }
-    memcpy(entry->value, value, value_len);
-    entry->value_len = value_len;
 
-    entry->created_at = time(NULL);
-    entry->last_accessed = entry->created_at;
-    entry->access_count = 0;
+    entry->next = NULL;
+    entry->hash = 0;
+    kv_entry_set_expires_at(entry, expires_at);
+    entry->meta = (uint32_t) KV_LFU_INIT << KV_LRU_BITS | kv_lru_clock();
+    entry->refs = 1;
+    entry->key_len = (uint16_t) key_len;
+    entry->value_len = (uint32_t) value_len;
+    entry->encoding = KV_ENCODING_RAW;
+    memcpy(entry->data, key, key_len);
+    entry->data[key_len] = '\0';
+    memcpy(kv_entry_value(entry), value, value_len);
 
-    if (ttl > 0) {
-        entry->expires_at = entry->created_at + ttl;
-    } else {
-        entry->expires_at = 0;
+    return entry;
+}
+
+/*
+ * Counters keep the number itself in the value bytes, in the narrowest of 1,
+ * 2, 4 or 8 bytes that holds it, so INCR neither parses nor formats text and
+ * a small counter takes fewer bytes than its digits. The width is the value
+ * length, and the number is rendered only when the value is read.
+ */
+size_t kv_int_width(const int64_t value) {
+    if (value >= INT8_MIN && value <= INT8_MAX) {
+        return sizeof(int8_t);
+    }
+    if (value >= INT16_MIN && value <= INT16_MAX) {
+        return sizeof(int16_t);
+    }
+    if (value >= INT32_MIN && value <= INT32_MAX) {
+        return sizeof(int32_t);
     }
+    return sizeof(int64_t);
+}
 
-    entry->next = NULL;
-    entry->prev = NULL;
-    entry->lru_next = NULL;
-    entry->lru_prev = NULL;
+static size_t store_int(char *bytes, const int64_t value) {
+    const size_t width = kv_int_width(value);
+    if (width == sizeof(int8_t)) {
+        const int8_t narrow = (int8_t) value;
+        memcpy(bytes, &narrow, width);
+    } else if (width == sizeof(int16_t)) {
+        const int16_t narrow = (int16_t) value;
+        memcpy(bytes, &narrow, width);
+    } else if (width == sizeof(int32_t)) {
+        const int32_t narrow = (int32_t) value;
+        memcpy(bytes, &narrow, width);
+    } else {
+        memcpy(bytes, &value, width);
+    }
+    return width;
+}
 
+kv_entry_t *kv_entry_create_int(const char *key, const size_t key_len, const int64_t value,
+                                const uint64_t expires_at) {
+    char bytes[sizeof(int64_t)];
+    const size_t width = store_int(bytes, value);
+    kv_entry_t *entry = kv_entry_create(key, key_len, bytes, width, expires_at);
+    if (entry) {
+        entry->encoding = KV_ENCODING_INT;
+    }
     return entry;
 }
 
 void kv_entry_free(kv_entry_t *entry) {
     if (!entry) return;
 
-    if (entry->prev) {
-        entry->prev->next = entry->next;
+    slab_free(entry, kv_entry_alloc_size(entry));
+}
+
+/*
+ * The index owns one reference. GET replies take another so the value can be
+ * written to the socket straight from the entry after the shard lock is gone;
+ * whoever drops the last reference frees the block.
+ */
+void kv_entry_retain(kv_entry_t *entry) {
+    __atomic_fetch_add(&entry->refs, 1, __ATOMIC_RELAXED);
+}
+
+void kv_entry_release(kv_entry_t *entry) {
+    if (entry && __atomic_sub_fetch(&entry->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        kv_entry_free(entry);
     }
-    if (entry->next) {
-        entry->next->prev = entry->prev;
+}
+
+int kv_entry_is_shared(const kv_entry_t *entry) {
+    return __atomic_load_n(&entry->refs, __ATOMIC_ACQUIRE) > 1;
+}
+
+int kv_entry_fits(const kv_entry_t *entry, const size_t value_len) {
+    return value_len <= UINT32_MAX &&
+           slab_usable_size(entry_size(entry->key_len, value_len)) == kv_entry_alloc_size(entry);
+}
+
+int kv_entry_set_value(kv_entry_t *entry, const char *value, const size_t value_len) {
+    if (!entry || !kv_entry_fits(entry, value_len)) {
+        return -1;
     }
 
-    entry->lru_prev = NULL;
-    entry->lru_next = NULL;
+    memcpy(kv_entry_value(entry), value, value_len);
+    entry->value_len = (uint32_t) value_len;
+    entry->encoding = KV_ENCODING_RAW;
+    return 0;
+}
 
-    free(entry->key);
-    free(entry->value);
+/* The caller checks kv_entry_fits for kv_int_width(value) first. */
+void kv_entry_set_int(kv_entry_t *entry, const int64_t value) {
+    entry->value_len = (uint32_t) store_int(kv_entry_value(entry), value);
+}
 
-    free(entry);
+int kv_entry_to_int(kv_entry_t *entry, int64_t *value) {
+    if (entry->encoding == KV_ENCODING_INT) {
+        *value = kv_entry_int(entry);
+        return 0;
+    }
+    return kv_parse_int(kv_entry_value(entry), entry->value_len, value);
+}
+
+static char shared_ints[KV_SHARED_INTS][5];
+static uint8_t shared_int_lens[KV_SHARED_INTS];
+static pthread_once_t shared_ints_once = PTHREAD_ONCE_INIT;
+
+static void shared_ints_init(void) {
+    for (int i = 0; i < KV_SHARED_INTS; i++) {
+        char text[8];
+        const int len = snprintf(text, sizeof(text), "%d", i);
+        memcpy(shared_ints[i], text, (size_t) len);
+        shared_int_lens[i] = (uint8_t) len;
+    }
+}
+
+/*
+ * Immutable decimal text of 0..KV_SHARED_INTS-1, shared by every key that
+ * holds such a number, so replying with a small counter neither formats nor
+ * allocates. NULL outside the range.
+ */
+const char *kv_shared_int_text(const int64_t value, size_t *len) {
+    if (value < 0 || value >= KV_SHARED_INTS) {
+        return NULL;
+    }
+
+    pthread_once(&shared_ints_once, shared_ints_init);
+    *len = shared_int_lens[value];
+    return shared_ints[value];
+}
+
+const char *kv_encoding_name(const uint8_t encoding) {
+    return encoding == KV_ENCODING_INT ? "int" : "raw";
+}
+
+/*
+ * The value as the client sees it: the stored bytes, or for a counter its
+ * decimal form written into buffer (KV_INT_TEXT_SIZE bytes).
+ */
+const char *kv_entry_text(kv_entry_t *entry, char *buffer, size_t *len) {
+    if (entry->encoding == KV_ENCODING_INT) {
+        *len = (size_t) snprintf(buffer, KV_INT_TEXT_SIZE, "%" PRId64, kv_entry_int(entry));
+        return buffer;
+    }
+
+    *len = entry->value_len;
+    return kv_entry_value(entry);
+}
+
+/*
+ * Accepts only the canonical decimal form (no sign, spaces or leading zeros
+ * beyond "0" itself), so a parsed value prints back to the same bytes.
+ */
+int kv_parse_int(const char *str, const size_t len, int64_t *value) {
+    if (len == 0 || len >= KV_INT_TEXT_SIZE) {
+        return -1;
+    }
+    if (len == 1 && str[0] == '0') {
+        *value = 0;
+        return 0;
+    }
+
+    const int negative = str[0] == '-';
+    size_t i = negative ? 1 : 0;
+    if (i == len || str[i] < '1' || str[i] > '9') {
+        return -1;
+    }
+
+    uint64_t magnitude = 0;
+    for (; i < len; i++) {
+        if (str[i] < '0' || str[i] > '9') {
+            return -1;
+        }
+        const unsigned digit = (unsigned) (str[i] - '0');
+        if (magnitude > (UINT64_MAX - digit) / 10) {
+            return -1;
+        }
+        magnitude = magnitude * 10 + digit;
+    }
+
+    if (negative) {
+        if (magnitude > (uint64_t) INT64_MAX + 1) {
+            return -1;
+        }
+        *value = magnitude == (uint64_t) INT64_MAX + 1 ? INT64_MIN : -(int64_t) magnitude;
+    } else {
+        if (magnitude > INT64_MAX) {
+            return -1;
+        }
+        *value = (int64_t) magnitude;
+    }
+    return 0;
+}
+
+int kv_parse_float(const char *str, const size_t len, long double *value) {
+    char buffer[KV_FLOAT_TEXT_SIZE];
+    if (len == 0 || len >= sizeof(buffer) || isspace((unsigned char) str[0])) {
+        return -1;
+    }
+    memcpy(buffer, str, len);
+    buffer[len] = '\0';
+
+    char *end;
+    errno = 0;
+    *value = strtold(buffer, &end);
+    if (end != buffer + len || errno == ERANGE || isnan(*value)) {
+        return -1;
+    }
+    return 0;
+}
+
+size_t kv_entry_alloc_size(const kv_entry_t *entry) {
+    return kv_entry_alloc_size_for(entry->key_len, entry->value_len);
+}
+
+/* The size of the object kv_entry_create would allocate, known before it does. */
+size_t kv_entry_alloc_size_for(const size_t key_len, const size_t value_len) {
+    return slab_usable_size(entry_size(key_len, value_len));
+}
+
+#define KV_EXPIRY_FAR 0x80000000u
+#define KV_EXPIRY_MASK 0x7fffffffu
+
+static uint64_t g_expiry_base = 0;
+static pthread_once_t g_expiry_base_once = PTHREAD_ONCE_INIT;
+
+static void init_expiry_base(void) {
+    g_expiry_base = kv_expiry_clock() / 1000 * 1000;
+}
+
+static uint64_t expiry_base(void) {
+    pthread_once(&g_expiry_base_once, init_expiry_base);
+    return g_expiry_base;
+}
+
+/*
+ * The 32-bit deadline word: 0 is no deadline. A deadline less than
+ * KV_EXPIRY_NEAR_MS (~12 days) away keeps millisecond precision as the low
+ * 31 bits of its unix time and is recovered against the current clock, which
+ * is exact as long as the two are within KV_EXPIRY_NEAR_MS of each other;
+ * the expiry heap removes the key long before that. A farther deadline gets
+ * the top bit and whole seconds since the process started.
+ */
+static uint32_t encode_deadline(uint64_t expires_at) {
+    if (expires_at == 0) {
+        return 0;
+    }
+
+    const uint64_t now = kv_expiry_clock();
+    if (expires_at < now + KV_EXPIRY_NEAR_MS) {
+        if (expires_at + KV_EXPIRY_NEAR_MS / 2 < now) {
+            expires_at = now;
+        }
+        const uint32_t packed = (uint32_t) expires_at & KV_EXPIRY_MASK;
+        return packed != 0 ? packed : 1;
+    }
+
+    const uint64_t seconds = (expires_at - expiry_base() + 999) / 1000;
+    return KV_EXPIRY_FAR | (uint32_t) (seconds < KV_EXPIRY_MASK ? seconds : KV_EXPIRY_MASK);
+}
+
+static uint64_t decode_deadline(const uint32_t packed) {
+    if (packed == 0) {
+        return 0;
+    }
+    if (packed & KV_EXPIRY_FAR) {
+        return expiry_base() + (uint64_t) (packed & KV_EXPIRY_MASK) * 1000;
+    }
+
+    const uint64_t now = kv_expiry_clock();
+    const uint32_t ahead = (packed - (uint32_t) now) & KV_EXPIRY_MASK;
+    if (ahead < KV_EXPIRY_NEAR_MS) {
+        return now + ahead;
+    }
+
+    const uint64_t behind = (uint64_t) KV_EXPIRY_MASK + 1 - ahead;
+    return now > behind ? now - behind : 1;
+}
+
+/*
+ * Lock-free readers check the deadline while a writer holding the shard lock
+ * may be moving it, so both sides go through atomic accesses.
+ */
+uint64_t kv_entry_expires_at(const kv_entry_t *entry) {
+    return decode_deadline(__atomic_load_n(&entry->expires, __ATOMIC_RELAXED));
+}
+
+void kv_entry_set_expires_at(kv_entry_t *entry, const uint64_t expires_at) {
+    __atomic_store_n(&entry->expires, encode_deadline(expires_at), __ATOMIC_RELAXED);
+}
+
+/*
+ * Whether the entry still holds expires_at, as decoded from it earlier. A
+ * near deadline is matched by its stored low bits rather than decoded again,
+ * so the answer does not change once the deadline is long past.
+ */
+int kv_entry_has_deadline(const kv_entry_t *entry, const uint64_t expires_at) {
+    const uint32_t packed = __atomic_load_n(&entry->expires, __ATOMIC_RELAXED);
+    if (packed == 0 || expires_at == 0) {
+        return packed == 0 && expires_at == 0;
+    }
+    if (packed & KV_EXPIRY_FAR) {
+        return decode_deadline(packed) == expires_at;
+    }
+
+    const uint32_t low = (uint32_t) expires_at & KV_EXPIRY_MASK;
+    return (low != 0 ? low : 1) == packed;
 }
 
 int kv_entry_is_expired(const kv_entry_t *entry) {
-    if (!entry || entry->expires_at == 0) {
+    if (!entry) {
         return 0;
     }
 
-    return time(NULL) >= entry->expires_at;
+    const uint64_t expires_at = kv_entry_expires_at(entry);
+    return expires_at != 0 && kv_expiry_clock() >= expires_at;
+}
+
+static uint32_t idle_ticks(const uint32_t lru, const uint32_t clock) {
+    return clock >= lru ? clock - lru : KV_LRU_MAX - lru + clock + 1;
+}
+
+static uint8_t lfu_decay(const uint32_t meta, const uint32_t clock) {
+    const uint8_t counter = (uint8_t) (meta >> KV_LRU_BITS);
+    const uint32_t periods = idle_ticks(meta & KV_LRU_MAX, clock) / KV_LFU_DECAY_TICKS;
+    return periods >= counter ? 0 : (uint8_t) (counter - periods);
+}
+
+/*
+ * Logarithmic counter: the chance of an increment falls as the counter grows,
+ * so 8 bits cover roughly a million hits with the default log factor.
+ */
+static uint8_t lfu_increment(const uint8_t counter) {
+    static _Thread_local uint32_t state = 0;
+    if (counter == UINT8_MAX) {
+        return counter;
+    }
+    if (state == 0) {
+        state = (uint32_t) (uintptr_t) &state | 1;
+    }
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    const uint64_t base = counter > KV_LFU_INIT ? counter - KV_LFU_INIT : 0;
+    return (uint64_t) state * (base * KV_LFU_LOG_FACTOR + 1) < ((uint64_t) 1 << 32) ? counter + 1 : counter;
 }
 
-void kv_entry_touch(kv_entry_t *entry) {
+/*
+ * Called by readers under a shared lock or no lock at all, so only the meta
+ * word is written and only when it changes; a lost race just keeps the other
+ * reader's equally fresh value.
+ */
+void kv_entry_touch(kv_entry_t *entry, const int count_frequency) {
     if (!entry) {
         return;
     }
 
-    entry->last_accessed = time(NULL);
-    entry->access_count++;
+    const uint32_t clock = kv_lru_clock();
+    uint32_t meta = __atomic_load_n(&entry->meta, __ATOMIC_RELAXED);
+    uint32_t updated = (meta & ~KV_LRU_MAX) | clock;
+    if (count_frequency) {
+        updated = (uint32_t) lfu_increment(lfu_decay(meta, clock)) << KV_LRU_BITS | clock;
+    }
+    if (updated != meta) {
+        __atomic_compare_exchange_n(&entry->meta, &meta, updated, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+}
+
+uint64_t kv_expiry_clock(void) {
+    return coarse_clock_unix_ms();
+}
+
+uint64_t kv_expiry_deadline(const int64_t ttl_ms) {
+    if (ttl_ms <= 0) {
+        return 0;
+    }
+
+    const uint64_t now = kv_expiry_clock();
+    return (uint64_t) ttl_ms >= UINT64_MAX - now ? UINT64_MAX : now + (uint64_t) ttl_ms;
+}
+
+uint64_t kv_expiry_max(void) {
+    return expiry_base() + (uint64_t) KV_EXPIRY_MASK * 1000;
+}
+
+uint32_t kv_lru_clock(void) {
+    return (uint32_t) (coarse_clock_monotonic_ms() / KV_LRU_RESOLUTION_MS) & KV_LRU_MAX;
+}
+
+uint32_t kv_entry_idle_time(const kv_entry_t *entry, const uint32_t clock) {
+    return idle_ticks(kv_entry_lru(entry), clock);
+}
+
+uint8_t kv_entry_lfu(const kv_entry_t *entry, const uint32_t clock) {
+    return lfu_decay(__atomic_load_n(&entry->meta, __ATOMIC_RELAXED), clock);
 }
@@ -3,31 +3,154 @@
 #include <stddef.h>
 #include <time.h>
 #include <stdint.h>
+#include <string.h>
 
-typedef struct kv_entry {
-    char *key;
-    char *value;
-    size_t value_len;
-    
-    time_t created_at;
-    time_t expires_at;
-    
-    time_t last_accessed;
-    uint64_t access_count;
+#define KV_LRU_BITS 24
+#define KV_LRU_MAX ((1u << KV_LRU_BITS) - 1)
+#define KV_LRU_RESOLUTION_MS 100
+#define KV_LFU_INIT 5
+#define KV_LFU_LOG_FACTOR 10
+#define KV_LFU_DECAY_TICKS (60 * 1000 / KV_LRU_RESOLUTION_MS)
+#define KV_INT_TEXT_SIZE 21
+#define KV_FLOAT_TEXT_SIZE 5120
 
-    struct kv_entry *next;
-    struct kv_entry *prev;
+#define KV_ENCODING_RAW 0
+#define KV_ENCODING_INT 1
+#define KV_ENCODING_COUNT 2
+#define KV_INT_MIN_DIGITS 8
+#define KV_SHARED_INTS 10000
+
+#define KV_KEY_MAX UINT16_MAX
 
-    struct kv_entry *lru_next;
-    struct kv_entry *lru_prev;
+#define KV_EXPIRY_NEAR_MS (UINT64_C(1) << 30)
+
+/*
+ * 31-byte header: the deadline is packed into 32 bits (see
+ * kv_entry_set_expires_at) and keys are limited to KV_KEY_MAX bytes, so
+ * the data starts right after the encoding byte. hash keeps the low 32 bits
+ * of the key hash, enough for the chains and the frequency sketch; the
+ * swiss index and the expiry heap store the full hash themselves.
+ */
+typedef struct kv_entry {
+    struct kv_entry *next;
+    uint32_t hash;
+    uint32_t meta;
+    uint32_t expires;
+    uint32_t refs;
+    uint32_t value_len;
+    uint16_t key_len;
+    uint8_t encoding;
+    char data[];
 } kv_entry_t;
 
-kv_entry_t* kv_entry_create(const char *key, const char *value, size_t value_len, time_t ttl);
+#define KV_ENTRY_HEADER_SIZE offsetof(kv_entry_t, data)
+
+static inline const char *kv_entry_key(const kv_entry_t *entry) {
+    return entry->data;
+}
+
+static inline char *kv_entry_value(kv_entry_t *entry) {
+    return entry->data + entry->key_len + 1;
+}
+
+static inline int64_t kv_entry_int(const kv_entry_t *entry) {
+    const char *bytes = entry->data + entry->key_len + 1;
+    switch (entry->value_len) {
+        case sizeof(int8_t): {
+            int8_t value;
+            memcpy(&value, bytes, sizeof(value));
+            return value;
+        }
+        case sizeof(int16_t): {
+            int16_t value;
+            memcpy(&value, bytes, sizeof(value));
+            return value;
+        }
+        case sizeof(int32_t): {
+            int32_t value;
+            memcpy(&value, bytes, sizeof(value));
+            return value;
+        }
+        default: {
+            int64_t value;
+            memcpy(&value, bytes, sizeof(value));
+            return value;
+        }
+    }
+}
+
+static inline uint32_t kv_entry_lru(const kv_entry_t *entry) {
+    return __atomic_load_n(&entry->meta, __ATOMIC_RELAXED) & KV_LRU_MAX;
+}
+
+static inline uint8_t kv_entry_lfu_counter(const kv_entry_t *entry) {
+    return (uint8_t) (__atomic_load_n(&entry->meta, __ATOMIC_RELAXED) >> KV_LRU_BITS);
+}
+
+kv_entry_t* kv_entry_create(const char *key, size_t key_len, const char *value, size_t value_len, uint64_t expires_at);
+
+kv_entry_t* kv_entry_create_int(const char *key, size_t key_len, int64_t value, uint64_t expires_at);
 
 void kv_entry_free(kv_entry_t *entry);
 
+void kv_entry_retain(kv_entry_t *entry);
+
+void kv_entry_release(kv_entry_t *entry);
+
+int kv_entry_is_shared(const kv_entry_t *entry);
+
+int kv_entry_fits(const kv_entry_t *entry, size_t value_len);
+
+int kv_entry_set_value(kv_entry_t *entry, const char *value, size_t value_len);
+
+size_t kv_int_width(int64_t value);
+
+void kv_entry_set_int(kv_entry_t *entry, int64_t value);
+
+int kv_entry_to_int(kv_entry_t *entry, int64_t *value);
+
+const char *kv_entry_text(kv_entry_t *entry, char *buffer, size_t *len);
+
+int kv_parse_int(const char *str, size_t len, int64_t *value);
+
+const char *kv_shared_int_text(int64_t value, size_t *len);
+
+const char *kv_encoding_name(uint8_t encoding);
+
+int kv_parse_float(const char *str, size_t len, long double *value);
+
+size_t kv_entry_alloc_size(const kv_entry_t *entry);
+
+size_t kv_entry_alloc_size_for(size_t key_len, size_t value_len);
+
 int kv_entry_is_expired(const kv_entry_t *entry);
 
-void kv_entry_touch(kv_entry_t *entry);
+/*
+ * Deadlines are unix milliseconds, packed into 32 bits. One less than
+ * KV_EXPIRY_NEAR_MS (~12.4 days) ahead is kept to the millisecond; a farther
+ * one is kept in whole seconds since the process started, rounded up, so
+ * its TTL reads up to 999 ms long, and cannot be later than kv_expiry_max()
+ * (~68 years after the start): commands reject longer TTLs, and the setter
+ * clamps them. A near deadline further than KV_EXPIRY_NEAR_MS in the past,
+ * as after the clock jumps forward, decodes as a future one; the expiry heap
+ * keeps the full deadline and deletes such a key on its next run.
+ */
+uint64_t kv_entry_expires_at(const kv_entry_t *entry);
+
+void kv_entry_set_expires_at(kv_entry_t *entry, uint64_t expires_at);
+
+int kv_entry_has_deadline(const kv_entry_t *entry, uint64_t expires_at);
+
+void kv_entry_touch(kv_entry_t *entry, int count_frequency);
+
+uint64_t kv_expiry_clock(void);
+
+uint64_t kv_expiry_deadline(int64_t ttl_ms);
+
+uint64_t kv_expiry_max(void);
+
+uint32_t kv_lru_clock(void);
 
+uint32_t kv_entry_idle_time(const kv_entry_t *entry, uint32_t clock);
 
+uint8_t kv_entry_lfu(const kv_entry_t *entry, uint32_t clock);
@@ -0,0 +1,422 @@
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS
+
+#include "slab.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+typedef struct slab_object {
+    struct slab_object *next;
+} slab_object_t;
+
+/*
+ * Header at the start of every page. Pages are mapped at SLAB_PAGE_SIZE
+ * alignment, so an object finds its page by masking its address, and a page
+ * whose objects have all come back can be unmapped.
+ */
+typedef struct slab_page {
+    struct slab_page *prev;
+    struct slab_page *next;
+    slab_object_t *free_list;
+    char *bump;
+    char *end;
+    size_t map_len;
+    unsigned live;
+    int listed;
+} slab_page_t;
+
+#define SLAB_PAGE_HEADER ((sizeof(slab_page_t) + 63) & ~(size_t) 63)
+
+typedef struct {
+    pthread_mutex_t lock;
+    size_t size;
+    slab_page_t *partial_head;
+    slab_page_t *partial_tail;
+    size_t empty_pages;
+} slab_class_t;
+
+typedef struct slab_cache {
+    slab_object_t *objects[SLAB_MAX_CLASSES];
+    unsigned counts[SLAB_MAX_CLASSES];
+
+    _Atomic int64_t used_bytes;
+    atomic_int in_use;
+    struct slab_cache *next;
+} slab_cache_t;
+
+static slab_class_t g_classes[SLAB_MAX_CLASSES];
+static size_t g_class_count = 0;
+static uint8_t g_class_index[SLAB_MAX_OBJECT / 16 + 1];
+
+static size_t g_os_page = 4096;
+static atomic_size_t g_pages = 0;
+static atomic_size_t g_page_bytes = 0;
+static atomic_size_t g_touched_bytes = 0;
+static atomic_size_t g_large_bytes = 0;
+static _Atomic(slab_cache_t *) g_caches = NULL;
+
+static pthread_once_t g_init_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_cache_key;
+static _Thread_local slab_cache_t *tls_cache = NULL;
+
+static void release_cache(void *arg);
+
+static void init_classes(void) {
+    size_t size = SLAB_MIN_OBJECT;
+    while (g_class_count < SLAB_MAX_CLASSES) {
+        if (size > SLAB_MAX_OBJECT || g_class_count == SLAB_MAX_CLASSES - 1) {
+            size = SLAB_MAX_OBJECT;
+        }
+
+        slab_class_t *class = &g_classes[g_class_count++];
+        pthread_mutex_init(&class->lock, NULL);
+        class->size = size;
+        class->partial_head = NULL;
+        class->partial_tail = NULL;
+        class->empty_pages = 0;
+
+        if (size == SLAB_MAX_OBJECT) {
+            break;
+        }
+
+        size_t next = (size * SLAB_GROWTH_PERCENT / 100 + 15) & ~(size_t) 15;
+        size = next > size + 16 ? next : size + 16;
+    }
+
+    size_t class = 0;
+    for (size_t slot = 0; slot <= SLAB_MAX_OBJECT / 16; slot++) {
+        while (g_classes[class].size < slot * 16) {
+            class++;
+        }
+        g_class_index[slot] = (uint8_t) class;
+    }
+
+    const long os_page = sysconf(_SC_PAGESIZE);
+    if (os_page > 0) {
+        g_os_page = (size_t) os_page;
+    }
+
+    pthread_key_create(&g_cache_key, release_cache);
+}
+
+static size_t class_for(const size_t size) {
+    return g_class_index[(size + 15) / 16];
+}
+
+static slab_cache_t *acquire_cache(void) {
+    if (tls_cache) {
+        return tls_cache;
+    }
+
+    pthread_once(&g_init_once, init_classes);
+
+    slab_cache_t *cache = atomic_load_explicit(&g_caches, memory_order_acquire);
+    while (cache) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&cache->in_use, &expected, 1)) {
+            break;
+        }
+        cache = cache->next;
+    }
+
+    if (!cache) {
+        cache = calloc(1, sizeof(slab_cache_t));
+        if (!cache) {
+            abort();
+        }
+        atomic_init(&cache->used_bytes, 0);
+        atomic_init(&cache->in_use, 1);
+
+        slab_cache_t *head = atomic_load_explicit(&g_caches, memory_order_relaxed);
+        do {
+            cache->next = head;
+        } while (!atomic_compare_exchange_weak_explicit(&g_caches, &head, cache,
+                                                        memory_order_release, memory_order_relaxed));
+    }
+
+    pthread_setspecific(g_cache_key, cache);
+    tls_cache = cache;
+    return cache;
+}
+
+static void add_counter(_Atomic int64_t *counter, const int64_t delta) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + delta,
+                          memory_order_relaxed);
+}
+
+static slab_page_t *page_of(const void *object) {
+    return (slab_page_t *) ((uintptr_t) object & ~(uintptr_t) (SLAB_PAGE_SIZE - 1));
+}
+
+/*
+ * A page is mapped in full but only the OS pages up to its bump pointer have
+ * ever been written, so only those count as memory the allocator holds.
+ */
+static size_t touched_length(const slab_page_t *page) {
+    const size_t used = (size_t) (page->bump - (const char *) page);
+    return (used + g_os_page - 1) & ~(g_os_page - 1);
+}
+
+static int page_exhausted(const slab_page_t *page, const size_t size) {
+    return !page->free_list && page->bump + size > page->end;
+}
+
+static void link_page(slab_class_t *class, slab_page_t *page) {
+    page->prev = class->partial_tail;
+    page->next = NULL;
+    if (class->partial_tail) {
+        class->partial_tail->next = page;
+    } else {
+        class->partial_head = page;
+    }
+    class->partial_tail = page;
+    page->listed = 1;
+}
+
+static void unlink_page(slab_class_t *class, slab_page_t *page) {
+    if (page->prev) {
+        page->prev->next = page->next;
+    } else {
+        class->partial_head = page->next;
+    }
+    if (page->next) {
+        page->next->prev = page->prev;
+    } else {
+        class->partial_tail = page->prev;
+    }
+    page->listed = 0;
+}
+
+/*
+ * Maps twice the page size and trims it down to an aligned page that is only
+ * as long as the objects it holds need, so no tail beyond the last object
+ * (rounded to the OS page) is ever taken from the system.
+ */
+static slab_page_t *map_page(const size_t size) {
+    const size_t capacity = (SLAB_PAGE_SIZE - SLAB_PAGE_HEADER) / size;
+    const size_t map_len = (SLAB_PAGE_HEADER + capacity * size + g_os_page - 1) & ~(g_os_page - 1);
+
+    char *raw = mmap(NULL, 2 * SLAB_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+
+    char *start = (char *) (((uintptr_t) raw + SLAB_PAGE_SIZE - 1) & ~(uintptr_t) (SLAB_PAGE_SIZE - 1));
+    if (start > raw) {
+        munmap(raw, (size_t) (start - raw));
+    }
+    munmap(start + map_len, (size_t) (raw + 2 * SLAB_PAGE_SIZE - (start + map_len)));
+
+    slab_page_t *page = (slab_page_t *) start;
+    page->prev = NULL;
+    page->next = NULL;
+    page->free_list = NULL;
+    page->bump = start + SLAB_PAGE_HEADER;
+    page->end = start + SLAB_PAGE_HEADER + capacity * size;
+    page->map_len = map_len;
+    page->live = 0;
+    page->listed = 0;
+
+    atomic_fetch_add_explicit(&g_pages, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_page_bytes, map_len, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_touched_bytes, touched_length(page), memory_order_relaxed);
+    return page;
+}
+
+static void unmap_page(slab_page_t *page) {
+    atomic_fetch_sub_explicit(&g_pages, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&g_page_bytes, page->map_len, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&g_touched_bytes, touched_length(page), memory_order_relaxed);
+    munmap(page, page->map_len);
+}
+
+/*
+ * Rewinds an empty page to its first object and gives the OS pages behind
+ * the header back, so a kept page holds no memory until it is used again.
+ */
+static void rewind_page(slab_page_t *page) {
+    const size_t touched = touched_length(page);
+    if (touched > g_os_page) {
+        madvise((char *) page + g_os_page, touched - g_os_page, MADV_DONTNEED);
+    }
+    page->free_list = NULL;
+    page->bump = (char *) page + SLAB_PAGE_HEADER;
+    atomic_fetch_sub_explicit(&g_touched_bytes, touched - touched_length(page), memory_order_relaxed);
+}
+
+/*
+ * Returns one object to its page. A page that empties out is unmapped unless
+ * it is the only empty page of the class, which is rewound and kept to absorb
+ * the next burst of allocations without another mmap.
+ */
+static void return_object(slab_class_t *class, slab_object_t *object) {
+    slab_page_t *page = page_of(object);
+    object->next = page->free_list;
+    page->free_list = object;
+    page->live--;
+
+    if (!page->listed) {
+        link_page(class, page);
+    }
+
+    if (page->live == 0) {
+        if (class->empty_pages > 0) {
+            unlink_page(class, page);
+            unmap_page(page);
+        } else {
+            rewind_page(page);
+            class->empty_pages++;
+        }
+    }
+}
+
+static slab_object_t *take_object(slab_class_t *class) {
+    slab_page_t *page = class->partial_head;
+    if (!page) {
+        page = map_page(class->size);
+        if (!page) {
+            return NULL;
+        }
+        link_page(class, page);
+        class->empty_pages++;
+    }
+
+    slab_object_t *object = page->free_list;
+    if (object) {
+        page->free_list = object->next;
+    } else {
+        const size_t touched = touched_length(page);
+        object = (slab_object_t *) page->bump;
+        page->bump += class->size;
+        atomic_fetch_add_explicit(&g_touched_bytes, touched_length(page) - touched, memory_order_relaxed);
+    }
+
+    if (page->live++ == 0) {
+        class->empty_pages--;
+    }
+    if (page_exhausted(page, class->size)) {
+        unlink_page(class, page);
+    }
+    return object;
+}
+
+static void flush_cache(slab_cache_t *cache, const size_t class_id, unsigned keep) {
+    slab_class_t *class = &g_classes[class_id];
+
+    pthread_mutex_lock(&class->lock);
+    while (cache->counts[class_id] > keep) {
+        slab_object_t *object = cache->objects[class_id];
+        cache->objects[class_id] = object->next;
+        cache->counts[class_id]--;
+
+        return_object(class, object);
+    }
+    pthread_mutex_unlock(&class->lock);
+}
+
+static void release_cache(void *arg) {
+    slab_cache_t *cache = arg;
+    for (size_t i = 0; i < g_class_count; i++) {
+        flush_cache(cache, i, 0);
+    }
+    atomic_store_explicit(&cache->in_use, 0, memory_order_release);
+}
+
+static int refill_cache(slab_cache_t *cache, const size_t class_id) {
+    slab_class_t *class = &g_classes[class_id];
+
+    pthread_mutex_lock(&class->lock);
+    while (cache->counts[class_id] < SLAB_CACHE_SIZE / 2) {
+        slab_object_t *object = take_object(class);
+        if (!object) {
+            break;
+        }
+
+        object->next = cache->objects[class_id];
+        cache->objects[class_id] = object;
+        cache->counts[class_id]++;
+    }
+    pthread_mutex_unlock(&class->lock);
+
+    return cache->counts[class_id] > 0 ? 0 : -1;
+}
+
+void *slab_alloc(const size_t size) {
+    slab_cache_t *cache = acquire_cache();
+
+    if (size > SLAB_MAX_OBJECT) {
+        void *ptr = malloc(size);
+        if (ptr) {
+            atomic_fetch_add_explicit(&g_large_bytes, size, memory_order_relaxed);
+            add_counter(&cache->used_bytes, (int64_t) size);
+        }
+        return ptr;
+    }
+
+    const size_t class_id = class_for(size);
+    if (cache->counts[class_id] == 0 && refill_cache(cache, class_id) != 0) {
+        return NULL;
+    }
+
+    slab_object_t *object = cache->objects[class_id];
+    cache->objects[class_id] = object->next;
+    cache->counts[class_id]--;
+
+    add_counter(&cache->used_bytes, (int64_t) g_classes[class_id].size);
+    return object;
+}
+
+void slab_free(void *ptr, const size_t size) {
+    if (!ptr) {
+        return;
+    }
+
+    slab_cache_t *cache = acquire_cache();
+
+    if (size > SLAB_MAX_OBJECT) {
+        free(ptr);
+        atomic_fetch_sub_explicit(&g_large_bytes, size, memory_order_relaxed);
+        add_counter(&cache->used_bytes, -(int64_t) size);
+        return;
+    }
+
+    const size_t class_id = class_for(size);
+    slab_object_t *object = ptr;
+    object->next = cache->objects[class_id];
+    cache->objects[class_id] = object;
+    cache->counts[class_id]++;
+
+    add_counter(&cache->used_bytes, -(int64_t) g_classes[class_id].size);
+
+    if (cache->counts[class_id] >= SLAB_CACHE_SIZE) {
+        flush_cache(cache, class_id, SLAB_CACHE_SIZE / 2);
+    }
+}
+
+size_t slab_usable_size(const size_t size) {
+    if (size > SLAB_MAX_OBJECT) {
+        return size;
+    }
+
+    pthread_once(&g_init_once, init_classes);
+    return g_classes[class_for(size)].size;
+}
+
+void slab_get_stats(slab_stats_t *stats) {
+    pthread_once(&g_init_once, init_classes);
+
+    int64_t used = 0;
+    for (slab_cache_t *cache = atomic_load_explicit(&g_caches, memory_order_acquire);
+         cache; cache = cache->next) {
+        used += atomic_load_explicit(&cache->used_bytes, memory_order_relaxed);
+    }
+
+    stats->classes = g_class_count;
+    stats->pages = atomic_load_explicit(&g_pages, memory_order_relaxed);
+    stats->large_bytes = atomic_load_explicit(&g_large_bytes, memory_order_relaxed);
+    stats->mapped_bytes = atomic_load_explicit(&g_page_bytes, memory_order_relaxed);
+    stats->held_bytes = (uint64_t) atomic_load_explicit(&g_touched_bytes, memory_order_relaxed) + stats->large_bytes;
+    stats->used_bytes = used > 0 ? (uint64_t) used : 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SLAB_PAGE_SIZE (1024 * 1024)
+#define SLAB_MIN_OBJECT 32
+#define SLAB_MAX_OBJECT (64 * 1024)
+#define SLAB_GROWTH_PERCENT 125
+#define SLAB_MAX_CLASSES 64
+#define SLAB_CACHE_SIZE 32
+
+typedef struct {
+    size_t classes;
+    size_t pages;
+    size_t mapped_bytes;
+    uint64_t held_bytes;
+    uint64_t used_bytes;
+    uint64_t large_bytes;
+} slab_stats_t;
+
+void *slab_alloc(size_t size);
+
+void slab_free(void *ptr, size_t size);
+
+size_t slab_usable_size(size_t size);
+
+void slab_get_stats(slab_stats_t *stats);
@@ -10,7 +10,7 @@ int stats_init(stats_t *stats, const uint64_t max_memory) {
     }
 
     memset(stats, 0, sizeof(stats_t));
-    stats->max_memory_bytes = max_memory;
+    atomic_init(&stats->max_memory_bytes, max_memory);
     stats->start_time = time(NULL);
 
     if (pthread_mutex_init(&stats->mutex, NULL) != 0) {
@@ -33,18 +33,22 @@ void stats_inc_command(stats_t *stats, const char *cmd) {
         return;
     }
 
-    if (pthread_mutex_lock(&stats->mutex) != 0) {
-        return;
-    }
-
     stats->total_commands++;
 
     if (strcasecmp(cmd, "GET") == 0) {
         stats->cmd_get++;
     } else if (strcasecmp(cmd, "SET") == 0) {
         stats->cmd_set++;
+    } else if (strcasecmp(cmd, "MGET") == 0) {
+        stats->cmd_mget++;
+    } else if (strcasecmp(cmd, "MSET") == 0) {
+        stats->cmd_mset++;
+    } else if (strcasecmp(cmd, "MSETNX") == 0) {
+        stats->cmd_msetnx++;
     } else if (strcasecmp(cmd, "DEL") == 0) {
         stats->cmd_del++;
+    } else if (strcasecmp(cmd, "INCR") == 0) {
+        stats->cmd_incr++;
     } else if (strcasecmp(cmd, "PING") == 0) {
         stats->cmd_ping++;
     } else if (strcasecmp(cmd, "AUTH") == 0) {
@@ -60,61 +64,52 @@ void stats_inc_command(stats_t *stats, const char *cmd) {
     } else {
         stats->cmd_other++;
     }
-
-    pthread_mutex_unlock(&stats->mutex);
 }
 
 void stats_inc_cache_hit(stats_t *stats) {
     if (!stats) return;
 
-    if (pthread_mutex_lock(&stats->mutex) != 0) {
-        return;
-    }
     stats->cache_hits++;
-    pthread_mutex_unlock(&stats->mutex);
 }
 
 void stats_inc_cache_miss(stats_t *stats) {
     if (!stats) return;
 
-    if (pthread_mutex_lock(&stats->mutex) != 0) {
-        return;
-    }
     stats->cache_misses++;
-    pthread_mutex_unlock(&stats->mutex);
 }
 
-void stats_set_memory(stats_t *stats, const uint64_t bytes) {
+void stats_inc_evicted(stats_t *stats) {
+    if (!stats) return;
+
+    stats->evicted_keys++;
+}
+
+void stats_add_expired(stats_t *stats, const uint64_t count) {
+    if (!stats) return;
+
+    stats->expired_keys += count;
+}
+
+void stats_set_memory(stats_t *stats, const uint64_t bytes, const uint64_t dataset_bytes) {
     if (!stats) return;
 
-    if (pthread_mutex_lock(&stats->mutex) != 0) {
-        return;
-    }
     stats->used_memory_bytes = bytes;
-    pthread_mutex_unlock(&stats->mutex);
+    stats->dataset_memory_bytes = dataset_bytes;
 }
 
 void stats_inc_connections(stats_t *stats) {
     if (!stats) return;
 
-    if (pthread_mutex_lock(&stats->mutex) != 0) {
-        return;
-    }
     stats->current_connections++;
     stats->total_connections++;
-    pthread_mutex_unlock(&stats->mutex);
 }
 
 void stats_dec_connections(stats_t *stats) {
     if (!stats) return;
 
-    if (pthread_mutex_lock(&stats->mutex) != 0) {
-        return;
-    }
-    if (stats->current_connections > 0) {
-        stats->current_connections--;
+    uint64_t current = atomic_load(&stats->current_connections);
+    while (current > 0 && !atomic_compare_exchange_weak(&stats->current_connections, &current, current - 1)) {
     }
-    pthread_mutex_unlock(&stats->mutex);
 }
 
 uint64_t stats_get_uptime(stats_t *stats) {
@@ -165,6 +160,11 @@ char *stats_format(stats_t *stats) {
                                       ? (double) stats->used_memory_bytes / (double) stats->max_memory_bytes * 100.0
                                       : 0.0;
 
+    const uint64_t dataset = stats->dataset_memory_bytes;
+    const uint64_t used = stats->used_memory_bytes;
+    const uint64_t overhead = used > dataset ? used - dataset : 0;
+    const double overhead_percent = used > 0 ? (double) overhead / (double) used * 100.0 : 0.0;
+
     const uint64_t total = stats->cache_hits + stats->cache_misses;
     double hit_ratio = 0.0;
     if (total > 0) {
@@ -177,7 +177,11 @@ char *stats_format(stats_t *stats) {
              "  total_commands_processed   %llu\r\n"
              "  cmd_get                    %llu\r\n"
              "  cmd_set                    %llu\r\n"
+             "  cmd_mget                   %llu\r\n"
+             "  cmd_mset                   %llu\r\n"
+             "  cmd_msetnx                 %llu\r\n"
              "  cmd_del                    %llu\r\n"
+             "  cmd_incr                   %llu\r\n"
              "  cmd_ping                   %llu\r\n"
              "  cmd_auth                   %llu\r\n"
              "  cmd_config                 %llu\r\n"
@@ -190,9 +194,13 @@ char *stats_format(stats_t *stats) {
              "  cache_hits                 %llu\r\n"
              "  cache_misses               %llu\r\n"
              "  hit_ratio                  %.1f%%\r\n"
+             "  evicted_keys               %llu\r\n"
+             "  expired_keys               %llu\r\n"
              "\r\n"
              "3. Memory\r\n"
              "  used_memory_bytes          %llu  (%.1f / %.1f MiB, %.1f%%)\r\n"
+             "  dataset_bytes              %llu\r\n"
+             "  overhead_bytes             %llu  (%.1f%%)\r\n"
              "\r\n"
              "4. Connections / Uptime\r\n"
              "  current_connections        %llu\r\n"
@@ -201,7 +209,11 @@ char *stats_format(stats_t *stats) {
              (unsigned long long)stats->total_commands,
              (unsigned long long)stats->cmd_get,
              (unsigned long long)stats->cmd_set,
+             (unsigned long long)stats->cmd_mget,
+             (unsigned long long)stats->cmd_mset,
+             (unsigned long long)stats->cmd_msetnx,
              (unsigned long long)stats->cmd_del,
+             (unsigned long long)stats->cmd_incr,
              (unsigned long long)stats->cmd_ping,
              (unsigned long long)stats->cmd_auth,
              (unsigned long long)stats->cmd_config,
@@ -212,8 +224,13 @@ char *stats_format(stats_t *stats) {
              (unsigned long long)stats->cache_hits,
              (unsigned long long)stats->cache_misses,
              hit_ratio,
+             (unsigned long long)stats->evicted_keys,
+             (unsigned long long)stats->expired_keys,
              (unsigned long long)stats->used_memory_bytes,
              memory_mb, max_mb, memory_percent,
+             (unsigned long long)dataset,
+             (unsigned long long)overhead,
+             overhead_percent,
              (unsigned long long)stats->current_connections,
              (unsigned long long)stats->total_connections,
              (unsigned long long)uptime,
@@ -1,30 +1,38 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdatomic.h>
 #include <pthread.h>
 #include <time.h>
 
 typedef struct {
-    uint64_t total_commands;
-    uint64_t cmd_get;
-    uint64_t cmd_set;
-    uint64_t cmd_del;
-    uint64_t cmd_ping;
-    uint64_t cmd_auth;
-    uint64_t cmd_config;
-    uint64_t cmd_expire;
-    uint64_t cmd_ttl;
-    uint64_t cmd_stats;
-    uint64_t cmd_other;
+    _Atomic uint64_t total_commands;
+    _Atomic uint64_t cmd_get;
+    _Atomic uint64_t cmd_set;
+    _Atomic uint64_t cmd_mget;
+    _Atomic uint64_t cmd_mset;
+    _Atomic uint64_t cmd_msetnx;
+    _Atomic uint64_t cmd_del;
+    _Atomic uint64_t cmd_incr;
+    _Atomic uint64_t cmd_ping;
+    _Atomic uint64_t cmd_auth;
+    _Atomic uint64_t cmd_config;
+    _Atomic uint64_t cmd_expire;
+    _Atomic uint64_t cmd_ttl;
+    _Atomic uint64_t cmd_stats;
+    _Atomic uint64_t cmd_other;
     
-    uint64_t cache_hits;
-    uint64_t cache_misses;
+    _Atomic uint64_t cache_hits;
+    _Atomic uint64_t cache_misses;
+    _Atomic uint64_t evicted_keys;
+    _Atomic uint64_t expired_keys;
 
-    uint64_t used_memory_bytes;
-    uint64_t max_memory_bytes;
+    _Atomic uint64_t used_memory_bytes;
+    _Atomic uint64_t dataset_memory_bytes;
+    _Atomic uint64_t max_memory_bytes;
 
-    uint64_t current_connections;
-    uint64_t total_connections;
+    _Atomic uint64_t current_connections;
+    _Atomic uint64_t total_connections;
 
     time_t start_time;
 
@@ -41,7 +49,11 @@ void stats_inc_cache_hit(stats_t *stats);
 
 void stats_inc_cache_miss(stats_t *stats);
 
-void stats_set_memory(stats_t *stats, uint64_t bytes);
+void stats_inc_evicted(stats_t *stats);
+
+void stats_add_expired(stats_t *stats, uint64_t count);
+
+void stats_set_memory(stats_t *stats, uint64_t bytes, uint64_t dataset_bytes);
 
 void stats_inc_connections(stats_t *stats);
 
@@ -51,6 +51,43 @@ static resp_value_t *handle_auth(const command_executor_t *executor, const resp_
     return resp_create_error("WRONGPASS", "invalid username-password pair");
 }
 
+static void release_entry(void *entry) {
+    kv_entry_release(entry);
+}
+
+static void keep_shared(void *owner) {
+    (void) owner;
+}
+
+/*
+ * Takes over the caller's reference. String values are sent straight from
+ * the entry, small counters from the shared table of numbers, and larger
+ * ones are formatted into a reply of their own.
+ */
+static resp_value_t *entry_reply(kv_entry_t *entry) {
+    if (entry->encoding == KV_ENCODING_RAW) {
+        resp_value_t *response = resp_create_bulk_string_ref(kv_entry_value(entry), entry->value_len,
+                                                             release_entry, entry);
+        if (!response) {
+            kv_entry_release(entry);
+        }
+        return response;
+    }
+
+    size_t len;
+    const char *shared = kv_shared_int_text(kv_entry_int(entry), &len);
+    if (shared) {
+        kv_entry_release(entry);
+        return resp_create_bulk_string_ref(shared, len, keep_shared, NULL);
+    }
+
+    char buffer[KV_INT_TEXT_SIZE];
+    const char *text = kv_entry_text(entry, buffer, &len);
+    resp_value_t *response = resp_create_bulk_string(text, len);
+    kv_entry_release(entry);
+    return response;
+}
+
 static resp_value_t *handle_get(const command_executor_t *executor, const resp_value_t *cmd) {
     stats_inc_command(executor->stats, "GET");
 
@@ -63,19 +100,90 @@ static resp_value_t *handle_get(const command_executor_t *executor, const resp_v
         return resp_create_error("ERR", "invalid key type");
     }
 
-    size_t value_len;
-    char *value = storage_get(executor->storage, key->data.str, &value_len);
-
-    if (!value) {
+    kv_entry_t *entry = storage_acquire(executor->storage, key->data.str, key->value_len);
+    if (!entry) {
         return resp_create_null();
     }
 
-    resp_value_t *response = resp_create_bulk_string(value, value_len);
-    free(value);
+    return entry_reply(entry);
+}
 
+static int collect_args(const resp_value_t *cmd, const size_t first, const size_t stride, const char **args,
+                        size_t *lens, const size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const resp_value_t *arg = cmd->data.array.elements[first + i * stride];
+        if (arg->type != RESP_BULK_STRING) {
+            return -1;
+        }
+        args[i] = arg->data.str;
+        lens[i] = arg->value_len;
+    }
+    return 0;
+}
+
+/* Entries keep a 16-bit key length, so longer keys can be looked up but not stored. */
+static int keys_too_long(const size_t *key_lens, const size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (key_lens[i] > KV_KEY_MAX) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static resp_value_t *mget_reply(kv_entry_t **entries, const size_t count) {
+    resp_value_t *response = resp_create_array(count);
+    for (size_t i = 0; i < count; i++) {
+        resp_value_t *element = entries[i] ? entry_reply(entries[i]) : resp_create_null();
+        if (!response) {
+            resp_free(element);
+            continue;
+        }
+        resp_array_set(response, i, element);
+    }
     return response;
 }
 
+static resp_value_t *handle_mget(const command_executor_t *executor, const resp_value_t *cmd) {
+    stats_inc_command(executor->stats, "MGET");
+
+    if (cmd->data.array.count < 2) {
+        return resp_create_error("ERR", "wrong number of arguments for 'MGET' command");
+    }
+
+    const size_t count = cmd->data.array.count - 1;
+    const char **keys = malloc(count * sizeof(char *));
+    size_t *key_lens = malloc(count * sizeof(size_t));
+    kv_entry_t **entries = malloc(count * sizeof(kv_entry_t *));
+
+    resp_value_t *response;
+    if (!keys || !key_lens || !entries) {
+        response = resp_create_error("ERR", "out of memory");
+    } else if (collect_args(cmd, 1, 1, keys, key_lens, count) != 0) {
+        response = resp_create_error("ERR", "invalid key type");
+    } else if (storage_mget(executor->storage, keys, key_lens, count, entries) != 0) {
+        response = resp_create_error("ERR", "out of memory");
+    } else {
+        response = mget_reply(entries, count);
+    }
+
+    free(keys);
+    free(key_lens);
+    free(entries);
+    return response;
+}
+
+/*
+ * Same grammar as stored integers: no sign but '-', no spaces, no leading
+ * zeros, nothing after the digits.
+ */
+static int parse_int64(const resp_value_t *arg, int64_t *out) {
+    if (arg->type != RESP_BULK_STRING) {
+        return -1;
+    }
+    return kv_parse_int(arg->data.str, arg->value_len, out);
+}
+
 static resp_value_t *handle_set(const command_executor_t *executor, const resp_value_t *cmd) {
     stats_inc_command(executor->stats, "SET");
 
@@ -89,17 +197,193 @@ static resp_value_t *handle_set(const command_executor_t *executor, const resp_v
     if (key->type != RESP_BULK_STRING || value->type != RESP_BULK_STRING) {
         return resp_create_error("ERR", "invalid argument type");
     }
+    if (keys_too_long(&key->value_len, 1)) {
+        return resp_create_error("ERR", "key is too long");
+    }
 
-    const time_t ttl = 0;
+    int64_t ttl_ms = 0;
+    int has_ttl = 0;
+    unsigned flags = 0;
+    int get = 0;
 
-    const int result = storage_set(executor->storage, key->data.str,
-                                   value->data.str, value->value_len, ttl);
+    for (size_t i = 3; i < cmd->data.array.count; i++) {
+        const resp_value_t *option = cmd->data.array.elements[i];
+        if (option->type != RESP_BULK_STRING) {
+            return resp_create_error("ERR", "syntax error");
+        }
 
-    if (result == 0) {
-        return resp_create_simple_string("OK");
+        const int ex = strcasecmp(option->data.str, "EX") == 0;
+        if (ex || strcasecmp(option->data.str, "PX") == 0) {
+            int64_t amount;
+            if (has_ttl || i + 1 >= cmd->data.array.count) {
+                return resp_create_error("ERR", "syntax error");
+            }
+            if (parse_int64(cmd->data.array.elements[++i], &amount) != 0 || amount <= 0 ||
+                (ex && amount > INT64_MAX / 1000) ||
+                kv_expiry_deadline(ex ? amount * 1000 : amount) > kv_expiry_max()) {
+                return resp_create_error("ERR", "invalid expire time in 'set' command");
+            }
+            ttl_ms = ex ? amount * 1000 : amount;
+            has_ttl = 1;
+        } else if (strcasecmp(option->data.str, "NX") == 0 && !(flags & STORAGE_SET_XX)) {
+            flags |= STORAGE_SET_NX;
+        } else if (strcasecmp(option->data.str, "XX") == 0 && !(flags & STORAGE_SET_NX)) {
+            flags |= STORAGE_SET_XX;
+        } else if (strcasecmp(option->data.str, "GET") == 0) {
+            get = 1;
+        } else {
+            return resp_create_error("ERR", "syntax error");
+        }
+    }
+
+    char *old_value = NULL;
+    size_t old_len = 0;
+    const int result = storage_set_ex(executor->storage, key->data.str, key->value_len, value->data.str,
+                                      value->value_len, ttl_ms, flags, get ? &old_value : NULL, &old_len);
+
+    if (result < 0) {
+        return resp_create_error("ERR", "out of memory");
+    }
+
+    if (get) {
+        if (!old_value) {
+            return resp_create_null();
+        }
+        resp_value_t *response = resp_create_bulk_string(old_value, old_len);
+        free(old_value);
+        return response;
+    }
+
+    return result == 0 ? resp_create_simple_string("OK") : resp_create_null();
+}
+
+static resp_value_t *handle_mset(const command_executor_t *executor, const resp_value_t *cmd, const int nx) {
+    stats_inc_command(executor->stats, nx ? "MSETNX" : "MSET");
+
+    if (cmd->data.array.count < 3 || cmd->data.array.count % 2 == 0) {
+        return resp_create_error("ERR", nx ? "wrong number of arguments for 'MSETNX' command"
+                                           : "wrong number of arguments for 'MSET' command");
     }
 
-    return resp_create_error("ERR", "out of memory");
+    const size_t count = (cmd->data.array.count - 1) / 2;
+    const char **keys = malloc(count * sizeof(char *));
+    size_t *key_lens = malloc(count * sizeof(size_t));
+    const char **values = malloc(count * sizeof(char *));
+    size_t *value_lens = malloc(count * sizeof(size_t));
+
+    resp_value_t *response;
+    if (!keys || !key_lens || !values || !value_lens) {
+        response = resp_create_error("ERR", "out of memory");
+    } else if (collect_args(cmd, 1, 2, keys, key_lens, count) != 0 ||
+               collect_args(cmd, 2, 2, values, value_lens, count) != 0) {
+        response = resp_create_error("ERR", "invalid argument type");
+    } else if (keys_too_long(key_lens, count)) {
+        response = resp_create_error("ERR", "key is too long");
+    } else {
+        const int result = storage_mset(executor->storage, keys, key_lens, values, value_lens, count,
+                                        nx ? STORAGE_SET_NX : 0);
+        if (result < 0) {
+            response = resp_create_error("ERR", "out of memory");
+        } else if (nx) {
+            response = resp_create_integer(result == 0);
+        } else {
+            response = resp_create_simple_string("OK");
+        }
+    }
+
+    free(keys);
+    free(key_lens);
+    free(values);
+    free(value_lens);
+    return response;
+}
+
+static resp_value_t *handle_incr(const command_executor_t *executor, const resp_value_t *cmd, const char *name,
+                                 const int sign, const int with_amount) {
+    stats_inc_command(executor->stats, "INCR");
+
+    if (cmd->data.array.count != (with_amount ? 3u : 2u)) {
+        char message[64];
+        snprintf(message, sizeof(message), "wrong number of arguments for '%s' command", name);
+        return resp_create_error("ERR", message);
+    }
+
+    const resp_value_t *key = cmd->data.array.elements[1];
+    if (key->type != RESP_BULK_STRING) {
+        return resp_create_error("ERR", "invalid key type");
+    }
+    if (keys_too_long(&key->value_len, 1)) {
+        return resp_create_error("ERR", "key is too long");
+    }
+
+    int64_t amount = 1;
+    if (with_amount && parse_int64(cmd->data.array.elements[2], &amount) != 0) {
+        return resp_create_error("ERR", "value is not an integer or out of range");
+    }
+    if (sign < 0) {
+        if (amount == INT64_MIN) {
+            return resp_create_error("ERR", "decrement would overflow");
+        }
+        amount = -amount;
+    }
+
+    int64_t value;
+    const int result = storage_incr(executor->storage, key->data.str, key->value_len, amount, &value);
+    if (result == STORAGE_NOT_NUMBER) {
+        return resp_create_error("ERR", "value is not an integer or out of range");
+    }
+    if (result == STORAGE_OVERFLOW) {
+        return resp_create_error("ERR", "increment or decrement would overflow");
+    }
+    if (result != 0) {
+        return resp_create_error("ERR", "out of memory");
+    }
+
+    return resp_create_integer(value);
+}
+
+static resp_value_t *handle_incrbyfloat(const command_executor_t *executor, const resp_value_t *cmd) {
+    stats_inc_command(executor->stats, "INCR");
+
+    if (cmd->data.array.count != 3) {
+        return resp_create_error("ERR", "wrong number of arguments for 'INCRBYFLOAT' command");
+    }
+
+    const resp_value_t *key = cmd->data.array.elements[1];
+    const resp_value_t *increment = cmd->data.array.elements[2];
+    if (key->type != RESP_BULK_STRING || increment->type != RESP_BULK_STRING) {
+        return resp_create_error("ERR", "invalid argument type");
+    }
+    if (keys_too_long(&key->value_len, 1)) {
+        return resp_create_error("ERR", "key is too long");
+    }
+
+    long double amount;
+    if (kv_parse_float(increment->data.str, increment->value_len, &amount) != 0) {
+        return resp_create_error("ERR", "value is not a valid float");
+    }
+
+    char *text = malloc(KV_FLOAT_TEXT_SIZE);
+    if (!text) {
+        return resp_create_error("ERR", "out of memory");
+    }
+
+    size_t len;
+    const int result = storage_incr_float(executor->storage, key->data.str, key->value_len, amount, text, &len);
+
+    resp_value_t *response;
+    if (result == STORAGE_NOT_NUMBER) {
+        response = resp_create_error("ERR", "value is not a valid float");
+    } else if (result == STORAGE_OVERFLOW) {
+        response = resp_create_error("ERR", "increment would produce NaN or Infinity");
+    } else if (result != 0) {
+        response = resp_create_error("ERR", "out of memory");
+    } else {
+        response = resp_create_bulk_string(text, len);
+    }
+
+    free(text);
+    return response;
 }
 
 static resp_value_t *handle_del(const command_executor_t *executor, const resp_value_t *cmd) {
@@ -113,14 +397,22 @@ static resp_value_t *handle_del(const command_executor_t *executor, const resp_v
     for (size_t i = 1; i < cmd->data.array.count; i++) {
         const resp_value_t *key = cmd->data.array.elements[i];
         if (key->type == RESP_BULK_STRING) {
-            deleted += storage_del(executor->storage, key->data.str);
+            deleted += storage_del(executor->storage, key->data.str, key->value_len);
         }
     }
 
     return resp_create_integer(deleted);
 }
 
-static resp_value_t *handle_expire(const command_executor_t *executor, const resp_value_t *cmd) {
+typedef enum {
+    EXPIRE_SECONDS,
+    EXPIRE_MILLISECONDS,
+    EXPIRE_AT_SECONDS,
+    EXPIRE_AT_MILLISECONDS
+} expire_unit_t;
+
+static resp_value_t *handle_expire(const command_executor_t *executor, const resp_value_t *cmd,
+                                   const expire_unit_t unit) {
     stats_inc_command(executor->stats, "EXPIRE");
 
     if (cmd->data.array.count < 3) {
@@ -128,19 +420,34 @@ static resp_value_t *handle_expire(const command_executor_t *executor, const res
     }
 
     const resp_value_t *key = cmd->data.array.elements[1];
-    const resp_value_t *seconds = cmd->data.array.elements[2];
 
-    if (key->type != RESP_BULK_STRING || seconds->type != RESP_BULK_STRING) {
+    if (key->type != RESP_BULK_STRING || cmd->data.array.elements[2]->type != RESP_BULK_STRING) {
         return resp_create_error("ERR", "invalid argument type");
     }
 
-    const time_t ttl = atoi(seconds->data.str);
-    const int result = storage_expire(executor->storage, key->data.str, ttl);
+    int64_t amount;
+    if (parse_int64(cmd->data.array.elements[2], &amount) != 0) {
+        return resp_create_error("ERR", "value is not an integer or out of range");
+    }
+
+    const int seconds = unit == EXPIRE_SECONDS || unit == EXPIRE_AT_SECONDS;
+    if (seconds && (amount > INT64_MAX / 1000 || amount < INT64_MIN / 1000)) {
+        return resp_create_error("ERR", "invalid expire time");
+    }
+    const int64_t ms = seconds ? amount * 1000 : amount;
+    const int at = unit == EXPIRE_AT_SECONDS || unit == EXPIRE_AT_MILLISECONDS;
+    const uint64_t deadline = at ? (ms > 0 ? (uint64_t) ms : 0) : kv_expiry_deadline(ms);
+    if (deadline > kv_expiry_max()) {
+        return resp_create_error("ERR", "invalid expire time");
+    }
+
+    const int result = at ? storage_expire_at(executor->storage, key->data.str, key->value_len, ms)
+                          : storage_expire(executor->storage, key->data.str, key->value_len, ms);
 
     return resp_create_integer(result);
 }
 
-static resp_value_t *handle_ttl(const command_executor_t *executor, const resp_value_t *cmd) {
+static resp_value_t *handle_ttl(const command_executor_t *executor, const resp_value_t *cmd, const int millis) {
     stats_inc_command(executor->stats, "TTL");
 
     if (cmd->data.array.count < 2) {
@@ -152,20 +459,44 @@ static resp_value_t *handle_ttl(const command_executor_t *executor, const resp_v
         return resp_create_error("ERR", "invalid key type");
     }
 
-    const int64_t ttl = storage_ttl(executor->storage, key->data.str);
+    const int64_t ttl = millis ? storage_pttl(executor->storage, key->data.str, key->value_len)
+                               : storage_ttl(executor->storage, key->data.str, key->value_len);
     return resp_create_integer(ttl);
 }
 
 static resp_value_t *handle_stats(const command_executor_t *executor) {
     stats_inc_command(executor->stats, "STATS");
 
+    stats_set_memory(executor->stats, storage_get_memory(executor->storage),
+                     storage_get_dataset_memory(executor->storage));
+
     char *stats_str = stats_format(executor->stats);
     if (!stats_str) {
         return resp_create_error("ERR", "failed to format statistics");
     }
 
-    resp_value_t *response = resp_create_bulk_string(stats_str, strlen(stats_str));
+    char *storage_str = storage_format_info(executor->storage);
+    if (!storage_str) {
+        free(stats_str);
+        return resp_create_error("ERR", "failed to format statistics");
+    }
+
+    const size_t stats_len = strlen(stats_str);
+    const size_t storage_len = strlen(storage_str);
+    char *report = malloc(stats_len + 2 + storage_len + 1);
+    if (!report) {
+        free(stats_str);
+        free(storage_str);
+        return resp_create_error("ERR", "failed to format statistics");
+    }
+    memcpy(report, stats_str, stats_len);
+    memcpy(report + stats_len, "\r\n", 2);
+    memcpy(report + stats_len + 2, storage_str, storage_len + 1);
     free(stats_str);
+    free(storage_str);
+
+    resp_value_t *response = resp_create_bulk_string(report, stats_len + 2 + storage_len);
+    free(report);
 
     return response;
 }
@@ -229,6 +560,21 @@ static resp_value_t *handle_config_get(const command_executor_t *executor, const
     } else if (strcasecmp(param->data.str, "workers") == 0) {
         snprintf(value, sizeof(value), "%d", executor->runtime_config->workers);
         resp_array_set(response, 1, resp_create_bulk_string(value, strlen(value)));
+    } else if (strcasecmp(param->data.str, "shards") == 0) {
+        snprintf(value, sizeof(value), "%zu", storage_get_shard_count(executor->storage));
+        resp_array_set(response, 1, resp_create_bulk_string(value, strlen(value)));
+    } else if (strcasecmp(param->data.str, "index") == 0) {
+        const char *name = storage_index_name(executor->storage->index);
+        resp_array_set(response, 1, resp_create_bulk_string(name, strlen(name)));
+    } else if (strcasecmp(param->data.str, "maxmemory-samples") == 0) {
+        snprintf(value, sizeof(value), "%u", storage_get_eviction_samples(executor->storage));
+        resp_array_set(response, 1, resp_create_bulk_string(value, strlen(value)));
+    } else if (strcasecmp(param->data.str, "maxmemory-policy") == 0) {
+        const char *name = storage_policy_name(storage_get_policy(executor->storage));
+        resp_array_set(response, 1, resp_create_bulk_string(name, strlen(name)));
+    } else if (strcasecmp(param->data.str, "active-expire-budget") == 0) {
+        snprintf(value, sizeof(value), "%ld", storage_get_expire_budget(executor->storage));
+        resp_array_set(response, 1, resp_create_bulk_string(value, strlen(value)));
     } else {
         pthread_rwlock_unlock(&executor->runtime_config->rwlock);
         resp_free(response);
@@ -281,8 +627,34 @@ static resp_value_t *handle_config_set(const command_executor_t *executor, const
             pthread_rwlock_unlock(&executor->runtime_config->rwlock);
             return resp_create_error("ERR", "default-ttl must be non-negative");
         }
+        if (new_value > INT64_MAX / 1000 || kv_expiry_deadline((int64_t) new_value * 1000) > kv_expiry_max()) {
+            pthread_rwlock_unlock(&executor->runtime_config->rwlock);
+            return resp_create_error("ERR", "default-ttl is too large");
+        }
         executor->runtime_config->default_ttl = new_value;
         storage_set_default_ttl(executor->storage, new_value);
+    } else if (strcasecmp(param->data.str, "maxmemory-samples") == 0) {
+        const long new_value = atol(value->data.str);
+        if (new_value < 1 || new_value > STORAGE_MAX_EVICTION_SAMPLES) {
+            pthread_rwlock_unlock(&executor->runtime_config->rwlock);
+            return resp_create_error("ERR", "maxmemory-samples must be between 1 and 64");
+        }
+        storage_set_eviction_samples(executor->storage, (unsigned) new_value);
+    } else if (strcasecmp(param->data.str, "maxmemory-policy") == 0) {
+        storage_policy_t policy;
+        if (storage_policy_parse(value->data.str, &policy) != 0) {
+            pthread_rwlock_unlock(&executor->runtime_config->rwlock);
+            return resp_create_error("ERR", "unknown maxmemory-policy");
+        }
+        if (storage_set_policy(executor->storage, policy) != 0) {
+            pthread_rwlock_unlock(&executor->runtime_config->rwlock);
+            return resp_create_error("ERR", "out of memory");
+        }
+    } else if (strcasecmp(param->data.str, "active-expire-budget") == 0) {
+        if (storage_set_expire_budget(executor->storage, atol(value->data.str)) != 0) {
+            pthread_rwlock_unlock(&executor->runtime_config->rwlock);
+            return resp_create_error("ERR", "active-expire-budget must be between 100 and 100000");
+        }
     } else {
         pthread_rwlock_unlock(&executor->runtime_config->rwlock);
         return resp_create_error("ERR", "unsupported CONFIG parameter");
@@ -406,14 +778,50 @@ resp_value_t *command_executor_execute(command_executor_t *executor,
     if (strcasecmp(name, "SET") == 0) {
         return handle_set(executor, cmd);
     }
+    if (strcasecmp(name, "MGET") == 0) {
+        return handle_mget(executor, cmd);
+    }
+    if (strcasecmp(name, "MSET") == 0) {
+        return handle_mset(executor, cmd, 0);
+    }
+    if (strcasecmp(name, "MSETNX") == 0) {
+        return handle_mset(executor, cmd, 1);
+    }
+    if (strcasecmp(name, "INCR") == 0) {
+        return handle_incr(executor, cmd, "INCR", 1, 0);
+    }
+    if (strcasecmp(name, "DECR") == 0) {
+        return handle_incr(executor, cmd, "DECR", -1, 0);
+    }
+    if (strcasecmp(name, "INCRBY") == 0) {
+        return handle_incr(executor, cmd, "INCRBY", 1, 1);
+    }
+    if (strcasecmp(name, "DECRBY") == 0) {
+        return handle_incr(executor, cmd, "DECRBY", -1, 1);
+    }
+    if (strcasecmp(name, "INCRBYFLOAT") == 0) {
+        return handle_incrbyfloat(executor, cmd);
+    }
     if (strcasecmp(name, "DEL") == 0) {
         return handle_del(executor, cmd);
     }
     if (strcasecmp(name, "EXPIRE") == 0) {
-        return handle_expire(executor, cmd);
+        return handle_expire(executor, cmd, EXPIRE_SECONDS);
+    }
+    if (strcasecmp(name, "PEXPIRE") == 0) {
+        return handle_expire(executor, cmd, EXPIRE_MILLISECONDS);
+    }
+    if (strcasecmp(name, "EXPIREAT") == 0) {
+        return handle_expire(executor, cmd, EXPIRE_AT_SECONDS);
+    }
+    if (strcasecmp(name, "PEXPIREAT") == 0) {
+        return handle_expire(executor, cmd, EXPIRE_AT_MILLISECONDS);
     }
     if (strcasecmp(name, "TTL") == 0) {
-        return handle_ttl(executor, cmd);
+        return handle_ttl(executor, cmd, 0);
+    }
+    if (strcasecmp(name, "PTTL") == 0) {
+        return handle_ttl(executor, cmd, 1);
     }
     if (strcasecmp(name, "STATS") == 0) {
         return handle_stats(executor);
@@ -0,0 +1,202 @@
+#include "epoch.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+typedef struct retired {
+    void *ptr;
+    epoch_free_fn free_fn;
+    uint64_t epoch;
+    struct retired *next;
+} retired_t;
+
+typedef struct epoch_record {
+    _Atomic uint64_t active_epoch;
+    atomic_int in_use;
+    struct epoch_record *next;
+
+    unsigned nesting;
+    pthread_mutex_t limbo_lock;
+    retired_t *limbo_head;
+    retired_t *limbo_tail;
+    size_t limbo_count;
+} epoch_record_t;
+
+static _Atomic uint64_t g_epoch = 1;
+static _Atomic(epoch_record_t *) g_records = NULL;
+static atomic_size_t g_pending = 0;
+
+static pthread_key_t g_record_key;
+static pthread_once_t g_record_key_once = PTHREAD_ONCE_INIT;
+static _Thread_local epoch_record_t *tls_record = NULL;
+
+static void release_record(void *arg) {
+    epoch_record_t *record = arg;
+    atomic_store_explicit(&record->active_epoch, 0, memory_order_release);
+    atomic_store_explicit(&record->in_use, 0, memory_order_release);
+}
+
+static void create_record_key(void) {
+    pthread_key_create(&g_record_key, release_record);
+}
+
+static epoch_record_t *acquire_record(void) {
+    if (tls_record) {
+        return tls_record;
+    }
+
+    pthread_once(&g_record_key_once, create_record_key);
+
+    epoch_record_t *record = atomic_load_explicit(&g_records, memory_order_acquire);
+    while (record) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&record->in_use, &expected, 1)) {
+            break;
+        }
+        record = record->next;
+    }
+
+    if (!record) {
+        record = calloc(1, sizeof(epoch_record_t));
+        if (!record) {
+            abort();
+        }
+        atomic_init(&record->active_epoch, 0);
+        atomic_init(&record->in_use, 1);
+        pthread_mutex_init(&record->limbo_lock, NULL);
+
+        epoch_record_t *head = atomic_load_explicit(&g_records, memory_order_relaxed);
+        do {
+            record->next = head;
+        } while (!atomic_compare_exchange_weak_explicit(&g_records, &head, record,
+                                                        memory_order_release, memory_order_relaxed));
+    }
+
+    pthread_setspecific(g_record_key, record);
+    tls_record = record;
+    return record;
+}
+
+void epoch_enter(void) {
+    epoch_record_t *record = acquire_record();
+    if (record->nesting++ > 0) {
+        return;
+    }
+
+    const uint64_t epoch = atomic_load(&g_epoch);
+    atomic_store(&record->active_epoch, epoch);
+}
+
+void epoch_exit(void) {
+    epoch_record_t *record = tls_record;
+    if (!record || record->nesting == 0) {
+        return;
+    }
+
+    if (--record->nesting == 0) {
+        atomic_store_explicit(&record->active_epoch, 0, memory_order_release);
+    }
+}
+
+static void try_advance(void) {
+    uint64_t epoch = atomic_load(&g_epoch);
+
+    for (epoch_record_t *record = atomic_load_explicit(&g_records, memory_order_acquire);
+         record; record = record->next) {
+        const uint64_t active = atomic_load(&record->active_epoch);
+        if (active != 0 && active != epoch) {
+            return;
+        }
+    }
+
+    atomic_compare_exchange_strong(&g_epoch, &epoch, epoch + 1);
+}
+
+static size_t free_limbo(epoch_record_t *record, const uint64_t safe_epoch) {
+    size_t freed = 0;
+
+    while (record->limbo_head && record->limbo_head->epoch + 2 <= safe_epoch) {
+        retired_t *node = record->limbo_head;
+        record->limbo_head = node->next;
+
+        node->free_fn(node->ptr);
+        free(node);
+        freed++;
+    }
+
+    if (!record->limbo_head) {
+        record->limbo_tail = NULL;
+    }
+    record->limbo_count -= freed;
+    atomic_fetch_sub_explicit(&g_pending, freed, memory_order_relaxed);
+    return freed;
+}
+
+void epoch_retire(void *ptr, const epoch_free_fn free_fn) {
+    if (!ptr) {
+        return;
+    }
+
+    epoch_record_t *record = acquire_record();
+
+    retired_t *node = malloc(sizeof(retired_t));
+    if (!node) {
+        abort();
+    }
+    node->ptr = ptr;
+    node->free_fn = free_fn;
+    node->epoch = atomic_load(&g_epoch);
+    node->next = NULL;
+
+    pthread_mutex_lock(&record->limbo_lock);
+    if (record->limbo_tail) {
+        record->limbo_tail->next = node;
+    } else {
+        record->limbo_head = node;
+    }
+    record->limbo_tail = node;
+    const size_t count = ++record->limbo_count;
+    pthread_mutex_unlock(&record->limbo_lock);
+    atomic_fetch_add_explicit(&g_pending, 1, memory_order_relaxed);
+
+    if (count >= EPOCH_COLLECT_THRESHOLD) {
+        epoch_collect();
+    }
+}
+
+/*
+ * Limbo lists belong to the retiring threads, but a thread that stops
+ * writing (or exits) would otherwise pin its list forever, so a collection
+ * sweeps every record. Lists whose owner is appending right now are skipped
+ * and picked up next time.
+ */
+void epoch_collect(void) {
+    try_advance();
+    const uint64_t safe_epoch = atomic_load(&g_epoch);
+
+    for (epoch_record_t *record = atomic_load_explicit(&g_records, memory_order_acquire);
+         record; record = record->next) {
+        if (pthread_mutex_trylock(&record->limbo_lock) != 0) {
+            continue;
+        }
+        free_limbo(record, safe_epoch);
+        pthread_mutex_unlock(&record->limbo_lock);
+    }
+}
+
+void epoch_drain(void) {
+    for (epoch_record_t *record = atomic_load_explicit(&g_records, memory_order_acquire);
+         record; record = record->next) {
+        pthread_mutex_lock(&record->limbo_lock);
+        free_limbo(record, UINT64_MAX);
+        pthread_mutex_unlock(&record->limbo_lock);
+    }
+}
+
+uint64_t epoch_current(void) {
+    return atomic_load_explicit(&g_epoch, memory_order_relaxed);
+}
+
+size_t epoch_pending(void) {
+    return atomic_load_explicit(&g_pending, memory_order_relaxed);
+}
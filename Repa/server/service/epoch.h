@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EPOCH_COLLECT_THRESHOLD 64
+
+typedef void (*epoch_free_fn)(void *ptr);
+
+void epoch_enter(void);
+
+void epoch_exit(void);
+
+void epoch_retire(void *ptr, epoch_free_fn free_fn);
+
+void epoch_collect(void);
+
+void epoch_drain(void);
+
+uint64_t epoch_current(void);
+
+size_t epoch_pending(void);
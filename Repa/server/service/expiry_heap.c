@@ -0,0 +1,124 @@
+#include "expiry_heap.h"
+#include <stdlib.h>
+
+static void sift_up(expiry_node_t *nodes, size_t index) {
+    const expiry_node_t node = nodes[index];
+    while (index > 0) {
+        const size_t parent = (index - 1) / 2;
+        if (nodes[parent].expires_at <= node.expires_at) {
+            break;
+        }
+        nodes[index] = nodes[parent];
+        index = parent;
+    }
+    nodes[index] = node;
+}
+
+static void sift_down(expiry_node_t *nodes, const size_t size, size_t index) {
+    const expiry_node_t node = nodes[index];
+    for (;;) {
+        size_t child = index * 2 + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size && nodes[child + 1].expires_at < nodes[child].expires_at) {
+            child++;
+        }
+        if (node.expires_at <= nodes[child].expires_at) {
+            break;
+        }
+        nodes[index] = nodes[child];
+        index = child;
+    }
+    nodes[index] = node;
+}
+
+static int resize(expiry_heap_t *heap, const size_t capacity) {
+    expiry_node_t *nodes = realloc(heap->nodes, capacity * sizeof(expiry_node_t));
+    if (!nodes) {
+        return -1;
+    }
+    heap->nodes = nodes;
+    heap->capacity = capacity;
+    return 0;
+}
+
+void expiry_heap_init(expiry_heap_t *heap) {
+    heap->nodes = NULL;
+    heap->size = 0;
+    heap->capacity = 0;
+}
+
+void expiry_heap_destroy(expiry_heap_t *heap) {
+    free(heap->nodes);
+    expiry_heap_init(heap);
+}
+
+int expiry_heap_push(expiry_heap_t *heap, kv_entry_t *entry, const uint64_t hash, const uint64_t expires_at) {
+    if (heap->size == heap->capacity &&
+        resize(heap, heap->capacity ? heap->capacity * 2 : EXPIRY_HEAP_MIN_CAPACITY) != 0) {
+        return -1;
+    }
+
+    heap->nodes[heap->size].entry = entry;
+    heap->nodes[heap->size].hash = hash;
+    heap->nodes[heap->size].expires_at = expires_at;
+    sift_up(heap->nodes, heap->size++);
+    return 0;
+}
+
+const expiry_node_t *expiry_heap_peek(const expiry_heap_t *heap) {
+    return heap->size > 0 ? &heap->nodes[0] : NULL;
+}
+
+void expiry_heap_pop(expiry_heap_t *heap) {
+    if (heap->size == 0) {
+        return;
+    }
+
+    heap->nodes[0] = heap->nodes[--heap->size];
+    if (heap->size > 0) {
+        sift_down(heap->nodes, heap->size, 0);
+    }
+
+    if (heap->size == 0) {
+        expiry_heap_destroy(heap);
+    } else if (heap->capacity > EXPIRY_HEAP_MIN_CAPACITY && heap->size < heap->capacity / 4) {
+        resize(heap, heap->capacity / 2);
+    }
+}
+
+/*
+ * Drops every node the callback rejects and restores the heap order in
+ * linear time, which is how stale nodes left by TTL updates get reclaimed.
+ */
+size_t expiry_heap_retain(expiry_heap_t *heap, int (*keep)(const expiry_node_t *node, void *ctx), void *ctx) {
+    size_t kept = 0;
+    for (size_t i = 0; i < heap->size; i++) {
+        if (keep(&heap->nodes[i], ctx)) {
+            heap->nodes[kept++] = heap->nodes[i];
+        }
+    }
+
+    const size_t removed = heap->size - kept;
+    heap->size = kept;
+    for (size_t i = kept / 2; i-- > 0;) {
+        sift_down(heap->nodes, kept, i);
+    }
+
+    size_t capacity = heap->capacity;
+    while (capacity > EXPIRY_HEAP_MIN_CAPACITY && kept < capacity / 4) {
+        capacity /= 2;
+    }
+    if (kept == 0) {
+        expiry_heap_destroy(heap);
+    } else if (capacity != heap->capacity) {
+        resize(heap, capacity);
+    }
+
+    return removed;
+}
+
+size_t expiry_heap_memory(const expiry_heap_t *heap) {
+    return heap->capacity * sizeof(expiry_node_t);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "../model/kv_entry.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define EXPIRY_HEAP_MIN_CAPACITY 64
+
+typedef struct {
+    kv_entry_t *entry;
+    uint64_t hash;
+    uint64_t expires_at;
+} expiry_node_t;
+
+typedef struct {
+    expiry_node_t *nodes;
+    size_t size;
+    size_t capacity;
+} expiry_heap_t;
+
+void expiry_heap_init(expiry_heap_t *heap);
+
+void expiry_heap_destroy(expiry_heap_t *heap);
+
+int expiry_heap_push(expiry_heap_t *heap, kv_entry_t *entry, uint64_t hash, uint64_t expires_at);
+
+const expiry_node_t *expiry_heap_peek(const expiry_heap_t *heap);
+
+void expiry_heap_pop(expiry_heap_t *heap);
+
+size_t expiry_heap_retain(expiry_heap_t *heap, int (*keep)(const expiry_node_t *node, void *ctx), void *ctx);
+
+size_t expiry_heap_memory(const expiry_heap_t *heap);
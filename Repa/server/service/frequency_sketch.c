@@ -0,0 +1,106 @@
+#include "frequency_sketch.h"
+#include <stdlib.h>
+
+#define RESET_MASK 0x7777777777777777ull
+
+static const uint64_t seeds[4] = {
+    0xc3a5c85c97cb3127ull, 0xb492b66fbe98f273ull, 0x9ae16a3b2f90404full, 0xcbf29ce484222325ull
+};
+
+static uint64_t mix(const uint32_t hash, const int row) {
+    uint64_t x = ((uint64_t) hash + seeds[row]) * 0x9e3779b97f4a7c15ull;
+    x ^= x >> 32;
+    return x;
+}
+
+frequency_sketch_t *frequency_sketch_create(const size_t expected_keys) {
+    size_t words = FREQUENCY_SKETCH_MIN_WORDS;
+    while (words * 2 <= expected_keys && words < FREQUENCY_SKETCH_MAX_WORDS) {
+        words <<= 1;
+    }
+
+    frequency_sketch_t *sketch = malloc(sizeof(frequency_sketch_t));
+    if (!sketch) {
+        return NULL;
+    }
+
+    sketch->table = calloc(words, sizeof(uint64_t));
+    if (!sketch->table) {
+        free(sketch);
+        return NULL;
+    }
+
+    sketch->mask = words - 1;
+    sketch->sample_size = words * FREQUENCY_SKETCH_SAMPLE_FACTOR;
+    atomic_init(&sketch->additions, 0);
+    return sketch;
+}
+
+void frequency_sketch_destroy(frequency_sketch_t *sketch) {
+    if (!sketch) {
+        return;
+    }
+
+    free(sketch->table);
+    free(sketch);
+}
+
+/*
+ * Halves every counter so old popularity fades; lost concurrent increments
+ * only make the estimate slightly lower.
+ */
+static void reset(frequency_sketch_t *sketch) {
+    for (size_t i = 0; i <= sketch->mask; i++) {
+        uint64_t word = atomic_load_explicit(&sketch->table[i], memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(&sketch->table[i], &word, (word >> 1) & RESET_MASK,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+        }
+    }
+}
+
+/*
+ * Each word holds sixteen 4-bit counters; row i uses counters 4i..4i+3 of its
+ * word, so the four counters of a key never share a nibble.
+ */
+void frequency_sketch_increment(frequency_sketch_t *sketch, const uint32_t hash) {
+    int added = 0;
+
+    for (int row = 0; row < 4; row++) {
+        const uint64_t h = mix(hash, row);
+        _Atomic uint64_t *word = &sketch->table[(h >> 2) & sketch->mask];
+        const unsigned shift = (unsigned) (row * 4 + (h & 3)) * 4;
+
+        uint64_t value = atomic_load_explicit(word, memory_order_relaxed);
+        while (((value >> shift) & 0xf) != 0xf) {
+            if (atomic_compare_exchange_weak_explicit(word, &value, value + ((uint64_t) 1 << shift),
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                added = 1;
+                break;
+            }
+        }
+    }
+
+    if (added && atomic_fetch_add_explicit(&sketch->additions, 1, memory_order_relaxed) + 1 == sketch->sample_size) {
+        reset(sketch);
+        atomic_fetch_sub_explicit(&sketch->additions, sketch->sample_size / 2, memory_order_relaxed);
+    }
+}
+
+unsigned frequency_sketch_estimate(const frequency_sketch_t *sketch, const uint32_t hash) {
+    unsigned frequency = 0xf;
+
+    for (int row = 0; row < 4; row++) {
+        const uint64_t h = mix(hash, row);
+        const uint64_t word = atomic_load_explicit(&sketch->table[(h >> 2) & sketch->mask], memory_order_relaxed);
+        const unsigned count = (unsigned) (word >> ((row * 4 + (h & 3)) * 4)) & 0xf;
+        if (count < frequency) {
+            frequency = count;
+        }
+    }
+
+    return frequency;
+}
+
+size_t frequency_sketch_memory(const frequency_sketch_t *sketch) {
+    return sketch ? sizeof(frequency_sketch_t) + (sketch->mask + 1) * sizeof(uint64_t) : 0;
+}
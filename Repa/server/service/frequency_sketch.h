@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FREQUENCY_SKETCH_MIN_WORDS 512
+#define FREQUENCY_SKETCH_MAX_WORDS (8 * 1024 * 1024)
+#define FREQUENCY_SKETCH_SAMPLE_FACTOR 10
+
+typedef struct {
+    _Atomic uint64_t *table;
+    size_t mask;
+    size_t sample_size;
+    atomic_size_t additions;
+} frequency_sketch_t;
+
+frequency_sketch_t *frequency_sketch_create(size_t expected_keys);
+
+void frequency_sketch_destroy(frequency_sketch_t *sketch);
+
+void frequency_sketch_increment(frequency_sketch_t *sketch, uint32_t hash);
+
+unsigned frequency_sketch_estimate(const frequency_sketch_t *sketch, uint32_t hash);
+
+size_t frequency_sketch_memory(const frequency_sketch_t *sketch);
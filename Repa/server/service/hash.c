@@ -0,0 +1,109 @@
+#include "hash.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const uint64_t hash_secret[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+static void mum(uint64_t *a, uint64_t *b) {
+    const __uint128_t r = (__uint128_t) *a * *b;
+    *a = (uint64_t) r;
+    *b = (uint64_t) (r >> 64);
+}
+
+static uint64_t mix(uint64_t a, uint64_t b) {
+    mum(&a, &b);
+    return a ^ b;
+}
+
+static uint64_t read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t read_small(const uint8_t *p, const size_t len) {
+    return ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8) | p[len - 1];
+}
+
+/*
+ * wyhash (final version 4): 8- and 16-byte reads folded with 64x64->128
+ * multiplies, so a 16-64 byte key costs a handful of multiplies instead of
+ * one dependent multiply per byte.
+ */
+uint64_t hash_bytes(const void *data, const size_t len, uint64_t seed) {
+    const uint8_t *p = data;
+    uint64_t a;
+    uint64_t b;
+
+    seed ^= mix(seed ^ hash_secret[0], hash_secret[1]);
+
+    if (len <= 16) {
+        if (len >= 4) {
+            const size_t shift = (len >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + shift);
+            b = (read32(p + len - 4) << 32) | read32(p + len - 4 - shift);
+        } else if (len > 0) {
+            a = read_small(p, len);
+            b = 0;
+        } else {
+            a = 0;
+            b = 0;
+        }
+    } else {
+        size_t remaining = len;
+        if (remaining > 48) {
+            uint64_t seed1 = seed;
+            uint64_t seed2 = seed;
+            do {
+                seed = mix(read64(p) ^ hash_secret[1], read64(p + 8) ^ seed);
+                seed1 = mix(read64(p + 16) ^ hash_secret[2], read64(p + 24) ^ seed1);
+                seed2 = mix(read64(p + 32) ^ hash_secret[3], read64(p + 40) ^ seed2);
+                p += 48;
+                remaining -= 48;
+            } while (remaining > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (remaining > 16) {
+            seed = mix(read64(p) ^ hash_secret[1], read64(p + 8) ^ seed);
+            p += 16;
+            remaining -= 16;
+        }
+        a = read64(p + remaining - 16);
+        b = read64(p + remaining - 8);
+    }
+
+    a ^= hash_secret[1];
+    b ^= seed;
+    mum(&a, &b);
+    return mix(a ^ hash_secret[0] ^ len, b ^ hash_secret[1]);
+}
+
+uint64_t hash_random_seed(void) {
+    uint64_t seed = 0;
+
+    FILE *urandom = fopen("/dev/urandom", "rb");
+    if (urandom) {
+        if (fread(&seed, sizeof(seed), 1, urandom) != 1) {
+            seed = 0;
+        }
+        fclose(urandom);
+    }
+
+    if (seed == 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        seed = mix((uint64_t) now.tv_sec ^ hash_secret[2], (uint64_t) now.tv_nsec ^ ((uint64_t) getpid() << 32));
+    }
+
+    return seed;
+}
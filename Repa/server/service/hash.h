@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed);
+
+uint64_t hash_random_seed(void);
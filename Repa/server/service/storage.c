@@ -1,48 +1,552 @@
 #include "storage.h"
+#include "epoch.h"
+#include "hash.h"
+#include "../model/slab.h"
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
-static void lru_remove(storage_t *storage, kv_entry_t *entry);
+static size_t evict_entries(storage_t *storage, storage_shard_t *shard, size_t needed_bytes, size_t same_size);
 
-static void lru_add_to_head(storage_t *storage, kv_entry_t *entry);
+static void forget_candidate(storage_shard_t *shard, const kv_entry_t *entry, kv_entry_t *replacement);
 
-static void lru_move_to_head(storage_t *storage, kv_entry_t *entry);
+static uint64_t key_hash(const storage_t *storage, const char *key, const size_t key_len) {
+    return hash_bytes(key, key_len, storage->hash_seed);
+}
+
+static int entry_matches(const kv_entry_t *entry, const char *key, const size_t key_len, const uint64_t hash) {
+    return entry->hash == (uint32_t) hash && entry->key_len == key_len && memcmp(kv_entry_key(entry), key, key_len) == 0;
+}
+
+static storage_shard_t *shard_for_hash(const storage_t *storage, const uint64_t hash) {
+    if (storage->shard_bits == 0) {
+        return &storage->shards[0];
+    }
+    return &storage->shards[hash >> (64 - storage->shard_bits)];
+}
+
+static int counts_frequency(const storage_t *storage) {
+    return atomic_load_explicit(&storage->policy, memory_order_relaxed) == STORAGE_POLICY_ALLKEYS_LFU;
+}
+
+static void record_access(storage_t *storage, const uint64_t hash) {
+    frequency_sketch_t *sketch = atomic_load_explicit(&storage->sketch, memory_order_acquire);
+    if (sketch && atomic_load_explicit(&storage->policy, memory_order_relaxed) == STORAGE_POLICY_W_TINYLFU) {
+        frequency_sketch_increment(sketch, (uint32_t) hash);
+    }
+}
+
+static kv_entry_t *load_entry(kv_entry_t *const *slot) {
+    return __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+}
+
+static void publish_entry(kv_entry_t **slot, kv_entry_t *entry) {
+    __atomic_store_n(slot, entry, __ATOMIC_RELEASE);
+}
+
+static void table_seq_begin(storage_shard_t *shard) {
+    atomic_fetch_add_explicit(&shard->table_seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void table_seq_end(storage_shard_t *shard) {
+    atomic_fetch_add_explicit(&shard->table_seq, 1, memory_order_release);
+}
+
+static void release_entry_cb(void *ptr) {
+    kv_entry_release(ptr);
+}
+
+static void dispose_entry(const storage_t *storage, kv_entry_t *entry) {
+    if (storage->lockfree_reads) {
+        epoch_retire(entry, release_entry_cb);
+    } else {
+        kv_entry_release(entry);
+    }
+}
+
+static void dispose_buckets(const storage_t *storage, kv_entry_t **buckets) {
+    if (storage->lockfree_reads) {
+        epoch_retire(buckets, free);
+    } else {
+        free(buckets);
+    }
+}
+
+static void free_swiss_cb(void *ptr) {
+    swiss_table_destroy(ptr);
+}
+
+static void dispose_swiss(const storage_t *storage, swiss_table_t *table) {
+    if (storage->lockfree_reads) {
+        epoch_retire(table, free_swiss_cb);
+    } else {
+        swiss_table_destroy(table);
+    }
+}
+
+static size_t entry_memory(const kv_entry_t *entry) {
+    return kv_entry_alloc_size(entry);
+}
+
+static size_t entry_dataset(const kv_entry_t *entry) {
+    return entry->key_len + entry->value_len;
+}
+
+static size_t shard_index_memory(const storage_shard_t *shard) {
+    return (shard->tables[0].size + shard->tables[1].size) * sizeof(kv_entry_t *) + swiss_table_memory(shard->swiss) +
+           expiry_heap_memory(&shard->expiry);
+}
+
+static void account_memory(storage_t *storage, storage_shard_t *shard, const size_t added, const size_t removed) {
+    shard->memory_used = shard->memory_used + added - removed;
+    if (added > removed) {
+        atomic_fetch_add_explicit(&storage->memory_used, added - removed, memory_order_relaxed);
+    } else if (removed > added) {
+        atomic_fetch_sub_explicit(&storage->memory_used, removed - added, memory_order_relaxed);
+    }
+}
+
+static void account_dataset(storage_t *storage, const size_t added, const size_t removed) {
+    if (added > removed) {
+        atomic_fetch_add_explicit(&storage->dataset_bytes, added - removed, memory_order_relaxed);
+    } else if (removed > added) {
+        atomic_fetch_sub_explicit(&storage->dataset_bytes, removed - added, memory_order_relaxed);
+    }
+}
+
+static int table_init(storage_table_t *table, const size_t size) {
+    table->buckets = calloc(size, sizeof(kv_entry_t *));
+    if (!table->buckets) {
+        return -1;
+    }
+    table->size = size;
+    table->mask = size - 1;
+    table->used = 0;
+    return 0;
+}
+
+static void table_reset(storage_table_t *table) {
+    table->buckets = NULL;
+    table->size = 0;
+    table->mask = 0;
+    table->used = 0;
+}
+
+static size_t table_size_for(const size_t entries) {
+    size_t size = STORAGE_DEFAULT_SIZE;
+    while (size < entries) {
+        size <<= 1;
+    }
+    return size;
+}
+
+static int is_rehashing(const storage_shard_t *shard) {
+    return shard->rehash_index != -1;
+}
+
+static void start_resize(storage_t *storage, storage_shard_t *shard, const size_t size) {
+    if (is_rehashing(shard) || size == shard->tables[0].size) {
+        return;
+    }
+
+    table_seq_begin(shard);
+    if (table_init(&shard->tables[1], size) == 0) {
+        shard->rehash_index = 0;
+        account_memory(storage, shard, size * sizeof(kv_entry_t *), 0);
+    }
+    table_seq_end(shard);
+}
+
+static int swiss_resize(storage_t *storage, storage_shard_t *shard, const size_t capacity) {
+    swiss_table_t *old_table = shard->swiss;
+    swiss_table_t *rebuilt = swiss_table_rebuild(old_table, capacity);
+    if (!rebuilt) {
+        return -1;
+    }
+
+    __atomic_store_n(&shard->swiss, rebuilt, __ATOMIC_RELEASE);
+    account_memory(storage, shard, swiss_table_memory(rebuilt), swiss_table_memory(old_table));
+    dispose_swiss(storage, old_table);
+    return 0;
+}
+
+static int swiss_reserve(storage_t *storage, storage_shard_t *shard) {
+    const swiss_table_t *table = shard->swiss;
+    if (table->growth_left > 0) {
+        return 0;
+    }
+
+    const int mostly_live = table->used * 16 >= table->capacity * 7;
+    return swiss_resize(storage, shard, mostly_live ? table->capacity * 2 : table->capacity);
+}
+
+static void expand_if_needed(storage_t *storage, storage_shard_t *shard) {
+    if (storage->index == STORAGE_INDEX_SWISS) {
+        return;
+    }
+
+    const storage_table_t *table = &shard->tables[0];
+    if (!is_rehashing(shard) && table->used >= table->size * STORAGE_MAX_LOAD_FACTOR) {
+        start_resize(storage, shard, table_size_for(table->used * 2));
+    }
+}
+
+static void shrink_if_needed(storage_t *storage, storage_shard_t *shard) {
+    if (storage->index == STORAGE_INDEX_SWISS) {
+        const swiss_table_t *swiss = shard->swiss;
+        if (swiss->capacity > STORAGE_DEFAULT_SIZE &&
+            swiss->used * 100 < swiss->capacity * STORAGE_MIN_FILL_PERCENT) {
+            swiss_resize(storage, shard, table_size_for(swiss->used * 2));
+        }
+        return;
+    }
+
+    const storage_table_t *table = &shard->tables[0];
+    if (!is_rehashing(shard) && table->size > STORAGE_DEFAULT_SIZE &&
+        table->used * 100 < table->size * STORAGE_MIN_FILL_PERCENT) {
+        start_resize(storage, shard, table_size_for(table->used));
+    }
+}
+
+static int rehash_buckets(storage_t *storage, storage_shard_t *shard, size_t buckets) {
+    storage_table_t *from = &shard->tables[0];
+    storage_table_t *to = &shard->tables[1];
+    size_t empty_visits = buckets * 10;
+
+    while (buckets-- > 0 && from->used > 0) {
+        while (!from->buckets[shard->rehash_index]) {
+            shard->rehash_index++;
+            if (--empty_visits == 0) {
+                return 1;
+            }
+        }
+
+        kv_entry_t *entry = from->buckets[shard->rehash_index];
+        while (entry) {
+            kv_entry_t *next = entry->next;
+            const size_t index = entry->hash & to->mask;
+
+            publish_entry(&entry->next, to->buckets[index]);
+            publish_entry(&to->buckets[index], entry);
+
+            from->used--;
+            to->used++;
+            entry = next;
+        }
+        publish_entry(&from->buckets[shard->rehash_index], NULL);
+        shard->rehash_index++;
+    }
+
+    if (from->used == 0) {
+        account_memory(storage, shard, 0, from->size * sizeof(kv_entry_t *));
+        dispose_buckets(storage, from->buckets);
+        *from = *to;
+        table_reset(to);
+        shard->rehash_index = -1;
+        return 0;
+    }
+
+    return 1;
+}
+
+static int rehash_step(storage_t *storage, storage_shard_t *shard, const size_t buckets) {
+    if (!is_rehashing(shard)) {
+        return 0;
+    }
+
+    table_seq_begin(shard);
+    const int rehashing = rehash_buckets(storage, shard, buckets);
+    table_seq_end(shard);
+
+    return rehashing;
+}
+
+static storage_table_t *table_for_hash(storage_shard_t *shard, const uint64_t hash) {
+    if (is_rehashing(shard) && (hash & shard->tables[0].mask) < (size_t) shard->rehash_index) {
+        return &shard->tables[1];
+    }
+    return &shard->tables[0];
+}
+
+static kv_entry_t **find_link(storage_shard_t *shard, const kv_entry_t *entry) {
+    storage_table_t *table = table_for_hash(shard, entry->hash);
+    kv_entry_t **link = &table->buckets[entry->hash & table->mask];
+    while (*link != entry) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+static void unlink_entry(const storage_t *storage, storage_shard_t *shard, kv_entry_t *entry, const uint64_t hash) {
+    forget_candidate(shard, entry, NULL);
+    if (storage->index == STORAGE_INDEX_SWISS) {
+        swiss_table_remove(shard->swiss, entry, hash);
+        return;
+    }
+
+    publish_entry(find_link(shard, entry), entry->next);
+    table_for_hash(shard, entry->hash)->used--;
+}
+
+static void replace_entry(storage_t *storage, storage_shard_t *shard, kv_entry_t *old_entry,
+                          kv_entry_t *new_entry, const uint64_t hash) {
+    forget_candidate(shard, old_entry, new_entry);
+    if (storage->index == STORAGE_INDEX_SWISS) {
+        swiss_table_replace(shard->swiss, old_entry, new_entry, hash);
+    } else {
+        new_entry->next = old_entry->next;
+        publish_entry(find_link(shard, old_entry), new_entry);
+    }
+
+    account_memory(storage, shard, entry_memory(new_entry), entry_memory(old_entry));
+    account_dataset(storage, entry_dataset(new_entry), entry_dataset(old_entry));
+    shard->encoded_keys[old_entry->encoding]--;
+    shard->encoded_keys[new_entry->encoding]++;
+    dispose_entry(storage, old_entry);
+}
+
+static void remove_entry(storage_t *storage, storage_shard_t *shard, kv_entry_t *entry, const uint64_t hash) {
+    unlink_entry(storage, shard, entry, hash);
+
+    account_memory(storage, shard, 0, entry_memory(entry));
+    account_dataset(storage, 0, entry_dataset(entry));
+    shard->entry_count--;
+    shard->encoded_keys[entry->encoding]--;
+
+    dispose_entry(storage, entry);
+}
+
+typedef struct {
+    const storage_t *storage;
+    storage_shard_t *shard;
+} expiry_ctx_t;
+
+static int entry_is_indexed(const storage_t *storage, storage_shard_t *shard, const kv_entry_t *entry,
+                            const uint64_t hash) {
+    if (storage->index == STORAGE_INDEX_SWISS) {
+        return swiss_table_contains(shard->swiss, entry, hash);
+    }
+
+    const storage_table_t *table = table_for_hash(shard, hash);
+    for (const kv_entry_t *current = table->buckets[hash & table->mask]; current; current = current->next) {
+        if (current == entry) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Heap nodes are never removed when their entry is deleted or gets a new TTL,
+ * so a node is only acted on if its pointer is still in the index and still
+ * carries the same deadline. The pointer is compared, never dereferenced,
+ * until it is known to be live.
+ */
+static int expiry_node_current(const expiry_node_t *node, void *arg) {
+    const expiry_ctx_t *ctx = arg;
+    return entry_is_indexed(ctx->storage, ctx->shard, node->entry, node->hash) &&
+           kv_entry_has_deadline(node->entry, node->expires_at);
+}
+
+static void schedule_expiry(storage_t *storage, storage_shard_t *shard, kv_entry_t *entry, const uint64_t hash,
+                            const uint64_t previous) {
+    const uint64_t expires_at = kv_entry_expires_at(entry);
+    if (expires_at == 0 || expires_at == previous) {
+        return;
+    }
+
+    const size_t before = expiry_heap_memory(&shard->expiry);
+    if (shard->expiry.size >= 2 * shard->entry_count + STORAGE_EXPIRY_SLACK) {
+        expiry_ctx_t ctx = {storage, shard};
+        expiry_heap_retain(&shard->expiry, expiry_node_current, &ctx);
+    }
+    expiry_heap_push(&shard->expiry, entry, hash, expires_at);
+    account_memory(storage, shard, expiry_heap_memory(&shard->expiry), before);
+}
+
+static size_t shard_expire_due(storage_t *storage, storage_shard_t *shard, const uint64_t now, int *more) {
+    expiry_ctx_t ctx = {storage, shard};
+    const size_t before = expiry_heap_memory(&shard->expiry);
+    size_t removed = 0;
+
+    *more = 0;
+    for (size_t i = 0; i < STORAGE_EXPIRE_BATCH; i++) {
+        const expiry_node_t *node = expiry_heap_peek(&shard->expiry);
+        if (!node || node->expires_at > now) {
+            break;
+        }
+
+        const expiry_node_t due = *node;
+        expiry_heap_pop(&shard->expiry);
+        if (expiry_node_current(&due, &ctx)) {
+            remove_entry(storage, shard, due.entry, due.hash);
+            removed++;
+        }
+        *more = i + 1 == STORAGE_EXPIRE_BATCH;
+    }
+
+    account_memory(storage, shard, expiry_heap_memory(&shard->expiry), before);
+    if (removed > 0) {
+        shrink_if_needed(storage, shard);
+    }
+    return removed;
+}
+
+/*
+ * Estimates how many keys in the shard are already past their deadline but
+ * still stored, from evenly spaced heap nodes. Exact for small heaps.
+ */
+static size_t shard_stale_estimate(const storage_t *storage, storage_shard_t *shard, const uint64_t now) {
+    const expiry_heap_t *heap = &shard->expiry;
+    if (heap->size == 0) {
+        return 0;
+    }
+
+    expiry_ctx_t ctx = {storage, shard};
+    const size_t samples = heap->size < STORAGE_STALE_SAMPLES ? heap->size : STORAGE_STALE_SAMPLES;
+    size_t due = 0;
+    for (size_t i = 0; i < samples; i++) {
+        const expiry_node_t *node = &heap->nodes[i * heap->size / samples];
+        if (node->expires_at <= now && expiry_node_current(node, &ctx)) {
+            due++;
+        }
+    }
+    return due * heap->size / samples;
+}
+
+static int shard_init(storage_shard_t *shard, const storage_index_t index) {
+    table_reset(&shard->tables[0]);
+    table_reset(&shard->tables[1]);
+    shard->swiss = NULL;
+
+    if (index == STORAGE_INDEX_SWISS) {
+        shard->swiss = swiss_table_create(STORAGE_DEFAULT_SIZE);
+        if (!shard->swiss) {
+            return -1;
+        }
+    } else if (table_init(&shard->tables[0], STORAGE_DEFAULT_SIZE) != 0) {
+        return -1;
+    }
+    atomic_init(&shard->table_seq, 0);
+    shard->rehash_index = -1;
+    shard->entry_count = 0;
+    memset(shard->encoded_keys, 0, sizeof(shard->encoded_keys));
+    shard->memory_used = 0;
+    shard->rng = (uint64_t) (uintptr_t) shard | 1;
+    shard->eviction_pool_size = 0;
+    shard->window_size = 0;
+    expiry_heap_init(&shard->expiry);
+
+    if (pthread_rwlock_init(&shard->rwlock, NULL) != 0) {
+        free(shard->tables[0].buckets);
+        swiss_table_destroy(shard->swiss);
+        return -1;
+    }
 
-static void lru_evict(storage_t *storage, size_t needed_bytes);
+    return 0;
+}
+
+static void shard_destroy(storage_shard_t *shard) {
+    const int lock_result = pthread_rwlock_wrlock(&shard->rwlock);
+
+    for (int t = 0; t <= 1; t++) {
+        storage_table_t *table = &shard->tables[t];
+        for (size_t i = 0; i < table->size; i++) {
+            kv_entry_t *entry = table->buckets[i];
+            while (entry) {
+                kv_entry_t *next = entry->next;
+                kv_entry_release(entry);
+                entry = next;
+            }
+        }
+        free(table->buckets);
+    }
+
+    if (shard->swiss) {
+        for (size_t i = 0; i < shard->swiss->capacity; i++) {
+            kv_entry_release(swiss_table_entry_at(shard->swiss, i));
+        }
+        swiss_table_destroy(shard->swiss);
+    }
+    expiry_heap_destroy(&shard->expiry);
 
-static uint32_t hash_function(const char *key) {
-    uint32_t hash = 5381;
-    int c;
-    while ((c = (unsigned char) *key++)) {
-        hash = hash * 33 + c;
+    if (lock_result == 0) {
+        pthread_rwlock_unlock(&shard->rwlock);
     }
-    return hash;
+    pthread_rwlock_destroy(&shard->rwlock);
 }
 
-storage_t *storage_create(const size_t max_memory, const time_t default_ttl, stats_t *stats) {
+storage_t *storage_create(const storage_options_t *options, stats_t *stats) {
+    if (!options) {
+        return NULL;
+    }
+
+    const size_t shards = options->shards;
+    if (shards == 0 || shards > STORAGE_MAX_SHARDS || (shards & (shards - 1)) != 0) {
+        return NULL;
+    }
+
     storage_t *storage = calloc(1, sizeof(storage_t));
     if (!storage) {
         return NULL;
     }
 
-    storage->bucket_count = STORAGE_DEFAULT_SIZE;
-    storage->buckets = calloc(storage->bucket_count, sizeof(kv_entry_t *));
-    if (!storage->buckets) {
+    storage->shards = aligned_alloc(_Alignof(storage_shard_t), shards * sizeof(storage_shard_t));
+    if (!storage->shards) {
         free(storage);
         return NULL;
     }
 
-    storage->max_memory = max_memory;
-    storage->default_ttl = default_ttl;
+    storage->shard_count = shards;
+    storage->shard_bits = 0;
+    while ((1UL << storage->shard_bits) < shards) {
+        storage->shard_bits++;
+    }
+
+    for (size_t i = 0; i < shards; i++) {
+        if (shard_init(&storage->shards[i], options->index) != 0) {
+            for (size_t j = 0; j < i; j++) {
+                shard_destroy(&storage->shards[j]);
+            }
+            free(storage->shards);
+            free(storage);
+            return NULL;
+        }
+    }
+
+    storage->lockfree_reads = options->lockfree_reads;
+    storage->index = options->index;
+    storage->hash_seed = hash_random_seed();
+    atomic_init(&storage->memory_used, 0);
+    atomic_init(&storage->slab_idle_bytes, 0);
+    atomic_init(&storage->dataset_bytes, 0);
+    atomic_init(&storage->max_memory, options->max_memory);
+    atomic_init(&storage->default_ttl, options->default_ttl);
+    atomic_init(&storage->eviction_samples, STORAGE_EVICTION_SAMPLES);
+    storage_set_eviction_samples(storage, options->eviction_samples);
+    atomic_init(&storage->policy, STORAGE_POLICY_ALLKEYS_LRU);
+    atomic_init(&storage->sketch, NULL);
+    atomic_init(&storage->maintenance_cursor, 0);
+    atomic_init(&storage->expiry_cursor, 0);
+    atomic_init(&storage->expire_budget_us, STORAGE_EXPIRE_BUDGET_US);
+    if (options->expire_budget_us > 0) {
+        storage_set_expire_budget(storage, options->expire_budget_us);
+    }
+    atomic_init(&storage->expire_cycle_us, 0);
+    atomic_init(&storage->expire_rate, 0);
+    clock_gettime(CLOCK_MONOTONIC, &storage->expire_last_cycle);
     storage->stats = stats;
-    storage->entry_count = 0;
-    storage->memory_used = 0;
-    storage->lru_head = NULL;
-    storage->lru_tail = NULL;
 
-    if (pthread_rwlock_init(&storage->rwlock, NULL) != 0) {
-        free(storage->buckets);
-        free(storage);
+    for (size_t i = 0; i < shards; i++) {
+        account_memory(storage, &storage->shards[i], shard_index_memory(&storage->shards[i]), 0);
+    }
+
+    if (storage_set_policy(storage, options->policy) != 0) {
+        storage_destroy(storage);
         return NULL;
     }
 
@@ -54,414 +558,1565 @@ void storage_destroy(storage_t *storage) {
         return;
     }
 
-    const int lock_result = pthread_rwlock_wrlock(&storage->rwlock);
+    epoch_drain();
 
-    for (size_t i = 0; i < storage->bucket_count; i++) {
-        kv_entry_t *entry = storage->buckets[i];
-        while (entry) {
-            kv_entry_t *next = entry->next;
-            kv_entry_free(entry);
-            entry = next;
+    for (size_t i = 0; i < storage->shard_count; i++) {
+        shard_destroy(&storage->shards[i]);
+    }
+
+    frequency_sketch_destroy(atomic_load_explicit(&storage->sketch, memory_order_relaxed));
+    free(storage->shards);
+    free(storage);
+}
+
+static uint64_t shard_random(storage_shard_t *shard) {
+    uint64_t x = shard->rng;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    shard->rng = x;
+    return x;
+}
+
+static int eviction_score(const storage_policy_t policy, const kv_entry_t *entry, const uint32_t clock,
+                          uint32_t *score) {
+    switch (policy) {
+        case STORAGE_POLICY_ALLKEYS_LFU:
+            *score = (uint32_t) (UINT8_MAX - kv_entry_lfu(entry, clock)) << KV_LRU_BITS |
+                     kv_entry_idle_time(entry, clock);
+            return 0;
+        case STORAGE_POLICY_VOLATILE_TTL: {
+            const uint64_t expires_at = kv_entry_expires_at(entry);
+            if (expires_at == 0) {
+                return -1;
+            }
+            *score = UINT32_MAX - (uint32_t) (expires_at / 1000 < UINT32_MAX ? expires_at / 1000 : UINT32_MAX);
+            return 0;
+        }
+        default:
+            *score = kv_entry_idle_time(entry, clock);
+            return 0;
+    }
+}
+
+static int window_contains(const storage_shard_t *shard, const kv_entry_t *entry) {
+    for (size_t i = 0; i < shard->window_size; i++) {
+        if (shard->window[i].entry == entry) {
+            return 1;
         }
     }
+    return 0;
+}
 
-    free(storage->buckets);
+static void window_remove_at(storage_shard_t *shard, const size_t index) {
+    memmove(&shard->window[index], &shard->window[index + 1],
+            (shard->window_size - index - 1) * sizeof(shard->window[0]));
+    shard->window_size--;
+}
 
-    if (lock_result == 0) {
-        pthread_rwlock_unlock(&storage->rwlock);
+static void window_push(storage_shard_t *shard, kv_entry_t *entry, const uint64_t hash) {
+    if (shard->window_size == STORAGE_TINYLFU_WINDOW) {
+        window_remove_at(shard, 0);
     }
-    pthread_rwlock_destroy(&storage->rwlock);
-    free(storage);
+    shard->window[shard->window_size++] = (storage_entry_ref_t) {entry, hash};
 }
 
-static void lru_remove(storage_t *storage, kv_entry_t *entry) {
-    if (!entry) return;
+static void pool_insert(storage_shard_t *shard, kv_entry_t *entry, const uint64_t hash, const uint32_t score) {
+    storage_eviction_candidate_t *pool = shard->eviction_pool;
+    size_t size = shard->eviction_pool_size;
 
-    if (entry->lru_prev) {
-        entry->lru_prev->lru_next = entry->lru_next;
-    } else {
-        storage->lru_head = entry->lru_next;
+    for (size_t i = 0; i < size; i++) {
+        if (pool[i].entry == entry) {
+            return;
+        }
     }
 
-    if (entry->lru_next) {
-        entry->lru_next->lru_prev = entry->lru_prev;
-    } else {
-        storage->lru_tail = entry->lru_prev;
+    if (size == STORAGE_EVICTION_POOL) {
+        if (score <= pool[0].score) {
+            return;
+        }
+        memmove(&pool[0], &pool[1], (size - 1) * sizeof(*pool));
+        size--;
+    }
+
+    size_t pos = size;
+    while (pos > 0 && pool[pos - 1].score > score) {
+        pool[pos] = pool[pos - 1];
+        pos--;
+    }
+    pool[pos].entry = entry;
+    pool[pos].hash = hash;
+    pool[pos].score = score;
+    shard->eviction_pool_size = size + 1;
+}
+
+static void forget_candidate(storage_shard_t *shard, const kv_entry_t *entry, kv_entry_t *replacement) {
+    storage_eviction_candidate_t *pool = shard->eviction_pool;
+
+    for (size_t i = 0; i < shard->eviction_pool_size; i++) {
+        if (pool[i].entry == entry) {
+            memmove(&pool[i], &pool[i + 1], (shard->eviction_pool_size - i - 1) * sizeof(*pool));
+            shard->eviction_pool_size--;
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < shard->window_size; i++) {
+        if (shard->window[i].entry == entry) {
+            if (replacement) {
+                shard->window[i].entry = replacement;
+            } else {
+                window_remove_at(shard, i);
+            }
+            break;
+        }
+    }
+}
+
+static void pool_refresh(storage_shard_t *shard, const storage_policy_t policy, const uint32_t clock) {
+    storage_eviction_candidate_t *pool = shard->eviction_pool;
+    const size_t size = shard->eviction_pool_size;
+    size_t kept = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        storage_eviction_candidate_t candidate = {pool[i].entry, pool[i].hash, 0};
+        if (eviction_score(policy, candidate.entry, clock, &candidate.score) != 0 ||
+            (policy == STORAGE_POLICY_W_TINYLFU && window_contains(shard, candidate.entry))) {
+            continue;
+        }
+        size_t pos = kept++;
+        while (pos > 0 && pool[pos - 1].score > candidate.score) {
+            pool[pos] = pool[pos - 1];
+            pos--;
+        }
+        pool[pos] = candidate;
+    }
+    shard->eviction_pool_size = kept;
+}
+
+static void sample_entry(storage_shard_t *shard, const storage_policy_t policy, kv_entry_t *entry,
+                         const uint64_t hash, const uint32_t clock) {
+    uint32_t score;
+    if (eviction_score(policy, entry, clock, &score) == 0 &&
+        (policy != STORAGE_POLICY_W_TINYLFU || !window_contains(shard, entry))) {
+        pool_insert(shard, entry, hash, score);
+    }
+}
+
+static void sample_chain(storage_shard_t *shard, const storage_policy_t policy, const size_t start,
+                         const uint32_t clock, const unsigned samples) {
+    const int tables = is_rehashing(shard) ? 2 : 1;
+    unsigned sampled = 0;
+
+    for (int t = 0; t < tables && sampled < samples; t++) {
+        const storage_table_t *table = &shard->tables[t];
+        for (size_t i = 0; i < table->size && sampled < samples; i++) {
+            for (kv_entry_t *entry = table->buckets[(start + i) & table->mask];
+                 entry && sampled < samples; entry = entry->next) {
+                /* The chains are indexed by the stored 32 bits, which is all they need. */
+                sample_entry(shard, policy, entry, entry->hash, clock);
+                sampled++;
+            }
+        }
+    }
+}
+
+static void sample_swiss(storage_shard_t *shard, const storage_policy_t policy, const size_t start,
+                         const uint32_t clock, const unsigned samples) {
+    const swiss_table_t *table = shard->swiss;
+    unsigned sampled = 0;
+
+    for (size_t i = 0; i < table->capacity && sampled < samples; i++) {
+        const size_t index = (start + i) & table->mask;
+        kv_entry_t *entry = swiss_table_entry_at(table, index);
+        if (entry) {
+            sample_entry(shard, policy, entry, table->slots[index].hash, clock);
+            sampled++;
+        }
+    }
+}
+
+/*
+ * W-TinyLFU: the oldest entry of the admission window competes with the
+ * main victim and whichever the frequency sketch has seen less is evicted,
+ * so a one-off scan only ever displaces other scanned keys.
+ */
+static storage_entry_ref_t admission_victim(storage_t *storage, storage_shard_t *shard,
+                                            const storage_entry_ref_t victim) {
+    const frequency_sketch_t *sketch = atomic_load_explicit(&storage->sketch, memory_order_acquire);
+    if (shard->window_size == 0) {
+        return victim;
+    }
+
+    const storage_entry_ref_t candidate = shard->window[0];
+    window_remove_at(shard, 0);
+    if (!victim.entry || !sketch ||
+        frequency_sketch_estimate(sketch, candidate.entry->hash) <=
+        frequency_sketch_estimate(sketch, victim.entry->hash)) {
+        return candidate;
+    }
+    return victim;
+}
+
+/*
+ * Best candidate in the pool whose slab object is same_size bytes, or the
+ * best of all when same_size is 0.
+ */
+static storage_entry_ref_t pool_victim(const storage_shard_t *shard, const size_t same_size) {
+    for (size_t i = shard->eviction_pool_size; i > 0; i--) {
+        const storage_eviction_candidate_t *candidate = &shard->eviction_pool[i - 1];
+        if (same_size == 0 || entry_memory(candidate->entry) == same_size) {
+            return (storage_entry_ref_t) {candidate->entry, candidate->hash};
+        }
+    }
+    return (storage_entry_ref_t) {NULL, 0};
+}
+
+/*
+ * volatile-ttl when the sample held no key with a TTL, which is likely once
+ * most keys have none: the soonest deadline in the shard's expiry heap.
+ * Nodes whose key is gone or has a new deadline are dropped on the way.
+ */
+static storage_entry_ref_t heap_victim(storage_t *storage, storage_shard_t *shard, const size_t same_size) {
+    expiry_ctx_t ctx = {storage, shard};
+    const size_t before = expiry_heap_memory(&shard->expiry);
+    storage_entry_ref_t victim = {NULL, 0};
+
+    for (const expiry_node_t *node; (node = expiry_heap_peek(&shard->expiry)) != NULL;) {
+        if (expiry_node_current(node, &ctx)) {
+            if (same_size == 0 || entry_memory(node->entry) == same_size) {
+                victim = (storage_entry_ref_t) {node->entry, node->hash};
+            }
+            break;
+        }
+        expiry_heap_pop(&shard->expiry);
+    }
+
+    account_memory(storage, shard, expiry_heap_memory(&shard->expiry), before);
+    return victim;
+}
+
+/*
+ * Sampled eviction: each round samples a few entries from a random position
+ * into a small per-shard pool ordered by the policy's score and evicts the
+ * best candidate. The pool carries good candidates over to later rounds, so
+ * the victim is the best of far more entries than one round samples. With
+ * same_size set only entries of that slab object size are evicted, and a
+ * round that finds none ends the eviction.
+ */
+static size_t evict_entries(storage_t *storage, storage_shard_t *shard, const size_t needed_bytes,
+                            const size_t same_size) {
+    const storage_policy_t policy = atomic_load_explicit(&storage->policy, memory_order_relaxed);
+    const unsigned samples = atomic_load_explicit(&storage->eviction_samples, memory_order_relaxed);
+    size_t freed = 0;
+
+    if (policy == STORAGE_POLICY_NOEVICTION) {
+        return 0;
+    }
+
+    while (freed < needed_bytes && shard->entry_count > 0) {
+        const uint32_t clock = kv_lru_clock();
+        const size_t start = (size_t) shard_random(shard);
+
+        pool_refresh(shard, policy, clock);
+        if (storage->index == STORAGE_INDEX_SWISS) {
+            sample_swiss(shard, policy, start, clock, samples);
+        } else {
+            sample_chain(shard, policy, start, clock, samples);
+        }
+
+        storage_entry_ref_t victim = pool_victim(shard, same_size);
+        if (policy == STORAGE_POLICY_W_TINYLFU && same_size == 0) {
+            victim = admission_victim(storage, shard, victim);
+        } else if (policy == STORAGE_POLICY_VOLATILE_TTL && !victim.entry) {
+            victim = heap_victim(storage, shard, same_size);
+        }
+        if (!victim.entry) {
+            break;
+        }
+
+        freed += entry_memory(victim.entry);
+        remove_entry(storage, shard, victim.entry, victim.hash);
+        if (storage->stats) {
+            stats_inc_evicted(storage->stats);
+        }
+    }
+
+    return freed;
+}
+
+static kv_entry_t *lookup_entry(const storage_t *storage, const storage_shard_t *shard, const char *key,
+                                const size_t key_len, const uint64_t hash) {
+    if (storage->index == STORAGE_INDEX_SWISS) {
+        return swiss_table_find(shard->swiss, key, key_len, hash);
+    }
+
+    for (int t = 0; t <= 1; t++) {
+        const storage_table_t *table = &shard->tables[t];
+        if (table->size == 0) {
+            break;
+        }
+
+        kv_entry_t *entry = table->buckets[hash & table->mask];
+        while (entry) {
+            if (entry_matches(entry, key, key_len, hash)) {
+                return entry;
+            }
+            entry = entry->next;
+        }
+
+        if (!is_rehashing(shard)) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static kv_entry_t *find_entry(const storage_t *storage, const storage_shard_t *shard, const char *key,
+                              const size_t key_len, const uint64_t hash) {
+    kv_entry_t *entry = lookup_entry(storage, shard, key, key_len, hash);
+    if (entry && kv_entry_is_expired(entry)) {
+        return NULL;
+    }
+    return entry;
+}
+
+/*
+ * Walks the shard without its lock. The caller must be inside an epoch so
+ * that unlinked entries and retired bucket arrays stay readable. A miss is
+ * only trusted if no rehash step or resize ran concurrently, because those
+ * move entries between chains; otherwise -1 tells the caller to retry under
+ * the shard lock. The swiss index never moves entries in place, a resize
+ * publishes a whole new table, so its answer is always final.
+ */
+static int find_entry_lockfree(const storage_t *storage, storage_shard_t *shard, const char *key,
+                               const size_t key_len, const uint64_t hash, kv_entry_t **result) {
+    if (storage->index == STORAGE_INDEX_SWISS) {
+        kv_entry_t *entry = swiss_table_find(__atomic_load_n(&shard->swiss, __ATOMIC_ACQUIRE), key, key_len, hash);
+        *result = entry && !kv_entry_is_expired(entry) ? entry : NULL;
+        return 0;
+    }
+
+    const unsigned seq = atomic_load_explicit(&shard->table_seq, memory_order_acquire);
+    if (seq & 1) {
+        return -1;
+    }
+
+    kv_entry_t **buckets[2];
+    size_t masks[2];
+    buckets[0] = __atomic_load_n(&shard->tables[0].buckets, __ATOMIC_RELAXED);
+    masks[0] = __atomic_load_n(&shard->tables[0].mask, __ATOMIC_RELAXED);
+    buckets[1] = __atomic_load_n(&shard->tables[1].buckets, __ATOMIC_RELAXED);
+    masks[1] = __atomic_load_n(&shard->tables[1].mask, __ATOMIC_RELAXED);
+    const int tables = __atomic_load_n(&shard->rehash_index, __ATOMIC_RELAXED) != -1 ? 2 : 1;
+
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&shard->table_seq, memory_order_relaxed) != seq) {
+        return -1;
+    }
+
+    for (int t = 0; t < tables; t++) {
+        kv_entry_t *entry = load_entry(&buckets[t][hash & masks[t]]);
+        while (entry) {
+            if (entry_matches(entry, key, key_len, hash)) {
+                *result = kv_entry_is_expired(entry) ? NULL : entry;
+                return 0;
+            }
+            entry = load_entry(&entry->next);
+        }
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&shard->table_seq, memory_order_relaxed) != seq) {
+        return -1;
+    }
+
+    *result = NULL;
+    return 0;
+}
+
+static kv_entry_t *record_lookup(const storage_t *storage, kv_entry_t *entry) {
+    if (!entry) {
+        if (storage->stats) {
+            stats_inc_cache_miss(storage->stats);
+        }
+        return NULL;
+    }
+
+    if (storage->stats) {
+        stats_inc_cache_hit(storage->stats);
+    }
+
+    kv_entry_touch(entry, counts_frequency(storage));
+    return entry;
+}
+
+static kv_entry_t *retain_value(const storage_t *storage, kv_entry_t *entry) {
+    if (record_lookup(storage, entry)) {
+        kv_entry_retain(entry);
+    }
+    return entry;
+}
+
+static char *copy_value(const storage_t *storage, kv_entry_t *entry, size_t *value_len) {
+    if (!record_lookup(storage, entry)) {
+        return NULL;
+    }
+
+    char buffer[KV_INT_TEXT_SIZE];
+    size_t len;
+    const char *text = kv_entry_text(entry, buffer, &len);
+
+    char *value = malloc(len ? len : 1);
+    if (value) {
+        memcpy(value, text, len);
+        if (value_len) {
+            *value_len = len;
+        }
+    }
+    return value;
+}
+
+static int64_t entry_pttl(const kv_entry_t *entry) {
+    if (!entry) {
+        return -2;
+    }
+
+    const uint64_t expires_at = kv_entry_expires_at(entry);
+    if (expires_at == 0) {
+        return -1;
+    }
+
+    const uint64_t now = kv_expiry_clock();
+    return expires_at > now ? (int64_t) (expires_at - now) : -2;
+}
+
+static uint64_t entry_deadline(storage_t *storage, const int64_t ttl_ms) {
+    if (ttl_ms != 0) {
+        return kv_expiry_deadline(ttl_ms);
+    }
+
+    const time_t default_ttl = atomic_load_explicit(&storage->default_ttl, memory_order_relaxed);
+    return default_ttl > 0 ? kv_expiry_deadline((int64_t) default_ttl * 1000) : 0;
+}
+
+char *storage_get(storage_t *storage, const char *key, const size_t key_len, size_t *value_len) {
+    if (!storage || !key) {
+        return NULL;
+    }
+
+    const uint64_t hash = key_hash(storage, key, key_len);
+    storage_shard_t *shard = shard_for_hash(storage, hash);
+    record_access(storage, hash);
+
+    if (storage->lockfree_reads) {
+        kv_entry_t *entry;
+        epoch_enter();
+        if (find_entry_lockfree(storage, shard, key, key_len, hash, &entry) == 0) {
+            char *value = copy_value(storage, entry, value_len);
+            epoch_exit();
+            return value;
+        }
+        epoch_exit();
+    }
+
+    if (pthread_rwlock_rdlock(&shard->rwlock) != 0) {
+        return NULL;
+    }
+
+    char *value = copy_value(storage, find_entry(storage, shard, key, key_len, hash), value_len);
+
+    pthread_rwlock_unlock(&shard->rwlock);
+    return value;
+}
+
+/*
+ * Like storage_get, but instead of copying the value hands back the entry
+ * itself with a reference taken; the caller reads kv_entry_value() and drops
+ * the reference with kv_entry_release() once the bytes are on the wire.
+ */
+kv_entry_t *storage_acquire(storage_t *storage, const char *key, const size_t key_len) {
+    if (!storage || !key) {
+        return NULL;
+    }
+
+    const uint64_t hash = key_hash(storage, key, key_len);
+    storage_shard_t *shard = shard_for_hash(storage, hash);
+    record_access(storage, hash);
+
+    if (storage->lockfree_reads) {
+        kv_entry_t *entry;
+        epoch_enter();
+        if (find_entry_lockfree(storage, shard, key, key_len, hash, &entry) == 0) {
+            retain_value(storage, entry);
+            epoch_exit();
+            return entry;
+        }
+        epoch_exit();
+    }
+
+    if (pthread_rwlock_rdlock(&shard->rwlock) != 0) {
+        return NULL;
+    }
+
+    kv_entry_t *entry = retain_value(storage, find_entry(storage, shard, key, key_len, hash));
+
+    pthread_rwlock_unlock(&shard->rwlock);
+    return entry;
+}
+
+typedef struct {
+    uint64_t hash;
+    size_t index;
+    int pending;
+} batch_slot_t;
+
+static int compare_batch_slots(const void *a, const void *b) {
+    const batch_slot_t *x = a;
+    const batch_slot_t *y = b;
+    if (x->hash != y->hash) {
+        return x->hash < y->hash ? -1 : 1;
+    }
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/*
+ * Orders a batch so that keys of one shard are adjacent. The shard is picked
+ * by the top bits of the hash, so sorting by hash groups shards in ascending
+ * order, which is also the order their locks are taken in; equal keys keep
+ * their argument order.
+ */
+static batch_slot_t *plan_batch(storage_t *storage, const char *const *keys, const size_t *key_lens,
+                                const size_t count) {
+    batch_slot_t *slots = malloc(count * sizeof(batch_slot_t));
+    if (!slots) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        slots[i].hash = key_hash(storage, keys[i], key_lens[i]);
+        slots[i].index = i;
+        slots[i].pending = 1;
+    }
+    qsort(slots, count, sizeof(batch_slot_t), compare_batch_slots);
+
+    return slots;
+}
+
+static size_t batch_group_end(const storage_t *storage, const batch_slot_t *slots, const size_t start,
+                              const size_t count) {
+    const storage_shard_t *shard = shard_for_hash(storage, slots[start].hash);
+    size_t end = start + 1;
+    while (end < count && shard_for_hash(storage, slots[end].hash) == shard) {
+        end++;
+    }
+    return end;
+}
+
+static void unlock_batch(const storage_t *storage, const batch_slot_t *slots, const size_t end) {
+    for (size_t i = 0; i < end; i = batch_group_end(storage, slots, i, end)) {
+        pthread_rwlock_unlock(&shard_for_hash(storage, slots[i].hash)->rwlock);
+    }
+}
+
+/*
+ * Pulls the bucket a later key of the batch will probe into cache while the
+ * current key is being compared. Only an address is computed from the racy
+ * loads, so a concurrent resize costs at most a useless prefetch.
+ */
+static void prefetch_bucket(const storage_t *storage, const batch_slot_t *slot) {
+    const storage_shard_t *shard = shard_for_hash(storage, slot->hash);
+    if (storage->index == STORAGE_INDEX_SWISS) {
+        swiss_table_prefetch(__atomic_load_n(&shard->swiss, __ATOMIC_ACQUIRE), slot->hash);
+        return;
+    }
+
+    kv_entry_t **buckets = __atomic_load_n(&shard->tables[0].buckets, __ATOMIC_RELAXED);
+    const size_t mask = __atomic_load_n(&shard->tables[0].mask, __ATOMIC_RELAXED);
+    if (buckets) {
+        __builtin_prefetch(&buckets[slot->hash & mask]);
+    }
+}
+
+static void prefetch_ahead(const storage_t *storage, const batch_slot_t *slots, const size_t i,
+                           const size_t count) {
+    if (i + STORAGE_BATCH_PREFETCH < count) {
+        prefetch_bucket(storage, &slots[i + STORAGE_BATCH_PREFETCH]);
+    }
+}
+
+static void prefetch_first(const storage_t *storage, const batch_slot_t *slots, const size_t count) {
+    for (size_t i = 0; i < count && i < STORAGE_BATCH_PREFETCH; i++) {
+        prefetch_bucket(storage, &slots[i]);
+    }
+}
+
+/*
+ * Whether any key of the shard group start..end-1 is still to be looked up
+ * under the shard lock, which is then held for it.
+ */
+static int group_pending(const batch_slot_t *slots, const size_t start, const size_t end) {
+    for (size_t i = start; i < end; i++) {
+        if (slots[i].pending) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * MGET: every shard the batch touches is read-locked once instead of once per
+ * key, and all of them are held together, taken in the same ascending order
+ * as MSET takes them, so the batch never sees an MSET half done. Keys found
+ * by lock-free reads are read one by one and carry no such guarantee. Found
+ * entries are returned retained, as by storage_acquire, and missing keys as
+ * NULL.
+ */
+int storage_mget(storage_t *storage, const char *const *keys, const size_t *key_lens, const size_t count,
+                 kv_entry_t **entries) {
+    if (!storage || !keys || !key_lens || !entries) {
+        return -1;
+    }
+
+    memset(entries, 0, count * sizeof(kv_entry_t *));
+    if (count == 0) {
+        return 0;
+    }
+
+    batch_slot_t *slots = plan_batch(storage, keys, key_lens, count);
+    if (!slots) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        record_access(storage, slots[i].hash);
+    }
+    prefetch_first(storage, slots, count);
+
+    if (storage->lockfree_reads) {
+        epoch_enter();
+        for (size_t i = 0; i < count; i++) {
+            batch_slot_t *slot = &slots[i];
+            prefetch_ahead(storage, slots, i, count);
+
+            kv_entry_t *entry;
+            if (find_entry_lockfree(storage, shard_for_hash(storage, slot->hash), keys[slot->index],
+                                    key_lens[slot->index], slot->hash, &entry) == 0) {
+                entries[slot->index] = retain_value(storage, entry);
+                slot->pending = 0;
+            }
+        }
+        epoch_exit();
+    }
+
+    for (size_t start = 0; start < count;) {
+        const size_t end = batch_group_end(storage, slots, start, count);
+        if (group_pending(slots, start, end) &&
+            pthread_rwlock_rdlock(&shard_for_hash(storage, slots[start].hash)->rwlock) != 0) {
+            for (size_t i = start; i < end; i++) {
+                slots[i].pending = 0;
+            }
+        }
+        start = end;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const batch_slot_t *slot = &slots[i];
+        prefetch_ahead(storage, slots, i, count);
+        if (slot->pending) {
+            entries[slot->index] = retain_value(storage, find_entry(storage, shard_for_hash(storage, slot->hash),
+                                                                    keys[slot->index], key_lens[slot->index],
+                                                                    slot->hash));
+        }
+    }
+
+    for (size_t start = 0; start < count;) {
+        const size_t end = batch_group_end(storage, slots, start, count);
+        if (group_pending(slots, start, end)) {
+            pthread_rwlock_unlock(&shard_for_hash(storage, slots[start].hash)->rwlock);
+        }
+        start = end;
+    }
+
+    free(slots);
+    return 0;
+}
+
+static int update_existing_entry(storage_t *storage, storage_shard_t *shard, kv_entry_t *existing,
+                                 const uint64_t hash, const char *value, const size_t value_len,
+                                 const uint64_t expires_at) {
+    const size_t old_len = existing->value_len;
+    const uint64_t old_expires_at = kv_entry_expires_at(existing);
+    const uint8_t old_encoding = existing->encoding;
+    if (kv_entry_set_value(existing, value, value_len) != 0) {
+        return -1;
+    }
+    account_dataset(storage, value_len, old_len);
+    shard->encoded_keys[old_encoding]--;
+    shard->encoded_keys[existing->encoding]++;
+
+    kv_entry_set_expires_at(existing, expires_at);
+    kv_entry_touch(existing, counts_frequency(storage));
+    schedule_expiry(storage, shard, existing, hash, old_expires_at);
+
+    return 0;
+}
+
+static int update_existing_int(storage_t *storage, storage_shard_t *shard, kv_entry_t *existing,
+                               const uint64_t hash, const int64_t value, const uint64_t expires_at) {
+    const size_t old_len = existing->value_len;
+    const uint64_t old_expires_at = kv_entry_expires_at(existing);
+    kv_entry_set_int(existing, value);
+    account_dataset(storage, existing->value_len, old_len);
+
+    kv_entry_set_expires_at(existing, expires_at);
+    kv_entry_touch(existing, counts_frequency(storage));
+    schedule_expiry(storage, shard, existing, hash, old_expires_at);
+
+    return 0;
+}
+
+/*
+ * Shards this thread already write-locks for a multi-key write, indexed like
+ * storage->shards. Locking one of them again is undefined, so eviction uses
+ * them as they are.
+ */
+static _Thread_local const uint8_t *held_shards = NULL;
+
+static void evict_from_other_shards(storage_t *storage, const storage_shard_t *owner, size_t needed) {
+    for (size_t i = 0; i < storage->shard_count && needed > 0; i++) {
+        storage_shard_t *shard = &storage->shards[i];
+        const int held = held_shards && held_shards[i];
+        if (shard == owner || (!held && pthread_rwlock_trywrlock(&shard->rwlock) != 0)) {
+            continue;
+        }
+
+        const size_t freed = evict_entries(storage, shard, needed, 0);
+        needed = freed >= needed ? 0 : needed - freed;
+
+        if (!held) {
+            pthread_rwlock_unlock(&shard->rwlock);
+        }
+    }
+}
+
+/*
+ * Runs before the write allocates anything: bytes is how much used memory
+ * the write adds, object_size the slab object it is about to allocate, or 0
+ * when it allocates none of its own (a replacement growing an entry).
+ */
+static int check_and_evict_memory(storage_t *storage, storage_shard_t *shard, const size_t bytes,
+                                  const size_t object_size) {
+    const size_t max_memory = atomic_load_explicit(&storage->max_memory, memory_order_relaxed);
+    if (max_memory == 0) {
+        return 0;
+    }
+
+    /*
+     * Slab memory that no entry uses counts against the limit as well. Freed
+     * entries turn into more such memory until whole pages empty out, so
+     * evicting arbitrary entries for it would only shrink the dataset. When
+     * it alone is over the limit an entry of the same object size is evicted
+     * instead: its object goes back to this thread's slab cache and the
+     * allocation that follows takes it rather than growing the slab. With
+     * lock-free reads an evicted entry is freed only after readers leave, so
+     * there is nothing to reuse and nothing is evicted.
+     */
+    const size_t used = atomic_load_explicit(&storage->memory_used, memory_order_relaxed);
+    const size_t idle = atomic_load_explicit(&storage->slab_idle_bytes, memory_order_relaxed);
+    if (used + idle + bytes <= max_memory) {
+        return 0;
+    }
+    if (used + bytes <= max_memory) {
+        if (object_size > 0 && !storage->lockfree_reads) {
+            evict_entries(storage, shard, object_size, object_size);
+        }
+        return 0;
+    }
+
+    const size_t needed = used + bytes - max_memory;
+    const size_t freed = evict_entries(storage, shard, needed, 0);
+    if (freed < needed) {
+        evict_from_other_shards(storage, shard, needed - freed);
+    }
+
+    if (atomic_load_explicit(&storage->memory_used, memory_order_relaxed) + bytes > max_memory) {
+        return -1;
+    }
+    return 0;
+}
+
+static int insert_new_entry(storage_t *storage, storage_shard_t *shard, kv_entry_t *new_entry, const uint64_t hash) {
+    if (storage->index == STORAGE_INDEX_SWISS) {
+        if (swiss_reserve(storage, shard) != 0 || swiss_table_insert(shard->swiss, new_entry, hash) != 0) {
+            return -1;
+        }
+    } else {
+        storage_table_t *table = table_for_hash(shard, hash);
+        const size_t index = hash & table->mask;
+
+        new_entry->next = table->buckets[index];
+        publish_entry(&table->buckets[index], new_entry);
+        table->used++;
+    }
+
+    if (atomic_load_explicit(&storage->policy, memory_order_relaxed) == STORAGE_POLICY_W_TINYLFU) {
+        window_push(shard, new_entry, hash);
+    }
+
+    shard->entry_count++;
+    shard->encoded_keys[new_entry->encoding]++;
+    account_memory(storage, shard, entry_memory(new_entry), 0);
+    account_dataset(storage, entry_dataset(new_entry), 0);
+    schedule_expiry(storage, shard, new_entry, hash, 0);
+
+    expand_if_needed(storage, shard);
+    return 0;
+}
+
+/*
+ * Makes room for an entry of memory bytes that is about to be allocated for
+ * the key, replacing *existing if there is one. The eviction may pick
+ * existing itself, so it is pinned meanwhile; when that happens *existing is
+ * cleared and the room is made for a new key instead.
+ */
+static int reserve_entry(storage_t *storage, storage_shard_t *shard, kv_entry_t **existing, const size_t memory,
+                         const uint64_t hash) {
+    if (!*existing) {
+        return check_and_evict_memory(storage, shard, memory, memory);
+    }
+
+    const size_t old_memory = entry_memory(*existing);
+    if (memory <= old_memory) {
+        return 0;
+    }
+
+    kv_entry_retain(*existing);
+    int status = check_and_evict_memory(storage, shard, memory - old_memory, 0);
+    const int evicted = !entry_is_indexed(storage, shard, *existing, hash);
+    kv_entry_release(*existing);
+
+    if (evicted) {
+        *existing = NULL;
+        if (status == 0) {
+            status = check_and_evict_memory(storage, shard, memory, memory);
+        }
+    }
+    return status;
+}
+
+/*
+ * Stores a freshly built entry for the key, taking the place of existing if
+ * there is one; the entry keeps the access history of the one it replaces.
+ * Room for it has been made by reserve_entry before it was allocated.
+ */
+static int put_entry(storage_t *storage, storage_shard_t *shard, kv_entry_t *existing, kv_entry_t *entry,
+                     const uint64_t hash) {
+    if (!existing) {
+        entry->hash = (uint32_t) hash;
+        if (insert_new_entry(storage, shard, entry, hash) != 0) {
+            kv_entry_free(entry);
+            return -1;
+        }
+        return 0;
     }
 
-    entry->lru_prev = NULL;
-    entry->lru_next = NULL;
-}
+    entry->hash = existing->hash;
+    entry->meta = existing->meta;
+    kv_entry_touch(entry, counts_frequency(storage));
 
-static void lru_add_to_head(storage_t *storage, kv_entry_t *entry) {
-    if (!entry) return;
+    replace_entry(storage, shard, existing, entry, hash);
+    schedule_expiry(storage, shard, entry, hash, 0);
+    return 0;
+}
 
-    entry->lru_prev = NULL;
-    entry->lru_next = storage->lru_head;
+int storage_set(storage_t *storage, const char *key, const size_t key_len, const char *value,
+                const size_t value_len, const int64_t ttl_ms) {
+    return storage_set_ex(storage, key, key_len, value, value_len, ttl_ms, 0, NULL, NULL);
+}
 
-    if (storage->lru_head) {
-        storage->lru_head->lru_prev = entry;
-    } else {
-        storage->lru_tail = entry;
+static kv_entry_t *lookup_live(storage_t *storage, storage_shard_t *shard, const char *key, const size_t key_len,
+                               const uint64_t hash) {
+    kv_entry_t *existing = lookup_entry(storage, shard, key, key_len, hash);
+    if (existing && kv_entry_is_expired(existing)) {
+        remove_entry(storage, shard, existing, hash);
+        return NULL;
     }
-
-    storage->lru_head = entry;
+    return existing;
 }
 
-static void lru_move_to_head(storage_t *storage, kv_entry_t *entry) {
-    if (!entry || entry == storage->lru_head) return;
-    lru_remove(storage, entry);
-    lru_add_to_head(storage, entry);
-}
+static int set_locked(storage_t *storage, storage_shard_t *shard, const char *key, const size_t key_len,
+                      const uint64_t hash, const char *value, const size_t value_len, const int64_t ttl_ms,
+                      const unsigned flags, char **old_value, size_t *old_len) {
+    kv_entry_t *existing = lookup_live(storage, shard, key, key_len, hash);
 
-static void lru_evict(storage_t *storage, const size_t needed_bytes) {
-    size_t freed = 0;
+    if (old_value && existing) {
+        char buffer[KV_INT_TEXT_SIZE];
+        size_t len;
+        const char *text = kv_entry_text(existing, buffer, &len);
 
-    while (freed < needed_bytes && storage->lru_tail) {
-        kv_entry_t *victim = storage->lru_tail;
+        *old_value = malloc(len ? len : 1);
+        if (!*old_value) {
+            return -1;
+        }
+        memcpy(*old_value, text, len);
+        if (old_len) {
+            *old_len = len;
+        }
+    }
 
-        lru_remove(storage, victim);
+    if ((flags & STORAGE_SET_NX && existing) || (flags & STORAGE_SET_XX && !existing)) {
+        return 1;
+    }
 
-        const uint32_t hash = hash_function(victim->key);
-        const size_t index = hash % storage->bucket_count;
+    /* Short numbers stay text: the few bytes saved would not pay for formatting them on every GET. */
+    int64_t number;
+    const int as_int = value_len >= KV_INT_MIN_DIGITS && kv_parse_int(value, value_len, &number) == 0;
 
-        if (storage->buckets[index] == victim) {
-            storage->buckets[index] = victim->next;
-        }
-        if (victim->prev) {
-            victim->prev->next = victim->next;
+    const uint64_t expires_at = entry_deadline(storage, ttl_ms);
+    if (existing) {
+        record_access(storage, hash);
+        const int writable = !storage->lockfree_reads && !kv_entry_is_shared(existing);
+        if (as_int && writable && existing->encoding == KV_ENCODING_INT &&
+            kv_entry_fits(existing, kv_int_width(number))) {
+            return update_existing_int(storage, shard, existing, hash, number, expires_at);
         }
-        if (victim->next) {
-            victim->next->prev = victim->prev;
+        if (!as_int && writable && kv_entry_fits(existing, value_len)) {
+            return update_existing_entry(storage, shard, existing, hash, value, value_len, expires_at);
         }
+    }
 
-        freed += strlen(victim->key) + victim->value_len;
-        storage->memory_used -= strlen(victim->key) + victim->value_len;
-        storage->entry_count--;
-
-        kv_entry_free(victim);
+    const size_t memory = kv_entry_alloc_size_for(key_len, as_int ? kv_int_width(number) : value_len);
+    if (reserve_entry(storage, shard, &existing, memory, hash) != 0) {
+        return -1;
     }
 
-    if (storage->stats && freed > 0) {
-        stats_set_memory(storage->stats, storage->memory_used);
+    kv_entry_t *entry = as_int ? kv_entry_create_int(key, key_len, number, expires_at)
+                               : kv_entry_create(key, key_len, value, value_len, expires_at);
+    if (!entry) {
+        return -1;
     }
+
+    return put_entry(storage, shard, existing, entry, hash);
 }
 
-static kv_entry_t *find_entry(const storage_t *storage, const char *key) {
-    const uint32_t hash = hash_function(key);
-    const size_t index = hash % storage->bucket_count;
+/*
+ * SET with Redis options in one shard lock acquisition: NX/XX conditions and,
+ * when old_value is given, the previous value copied out before the write.
+ * Returns 1 when a condition left the key untouched.
+ */
+int storage_set_ex(storage_t *storage, const char *key, const size_t key_len, const char *value,
+                   const size_t value_len, const int64_t ttl_ms, const unsigned flags, char **old_value,
+                   size_t *old_len) {
+    if (old_value) {
+        *old_value = NULL;
+    }
+    if (!storage || !key || !value) {
+        return -1;
+    }
+
+    const uint64_t hash = key_hash(storage, key, key_len);
+    storage_shard_t *shard = shard_for_hash(storage, hash);
 
-    kv_entry_t *entry = storage->buckets[index];
-    while (entry) {
-        if (strcmp(entry->key, key) == 0) {
-            if (kv_entry_is_expired(entry)) {
-                return NULL;
-            }
-            return entry;
-        }
-        entry = entry->next;
+    if (pthread_rwlock_wrlock(&shard->rwlock) != 0) {
+        return -1;
     }
 
-    return NULL;
+    rehash_step(storage, shard, STORAGE_REHASH_STEP);
+    const int result = set_locked(storage, shard, key, key_len, hash, value, value_len, ttl_ms, flags,
+                                  old_value, old_len);
+
+    pthread_rwlock_unlock(&shard->rwlock);
+    return result;
 }
 
-char *storage_get(storage_t *storage, const char *key, size_t *value_len) {
-    if (!storage || !key) {
-        return NULL;
+/*
+ * MSET, or MSETNX with STORAGE_SET_NX. All shards of the batch are
+ * write-locked once, in ascending order so that concurrent batches cannot
+ * deadlock, and held until every key is written, so MGET and single-key
+ * readers that lock see either none or all of the batch. Under NX nothing is written if any key exists, which
+ * is reported by returning 1.
+ */
+int storage_mset(storage_t *storage, const char *const *keys, const size_t *key_lens,
+                 const char *const *values, const size_t *value_lens, const size_t count,
+                 const unsigned flags) {
+    if (!storage || !keys || !key_lens || !values || !value_lens) {
+        return -1;
+    }
+    if (count == 0) {
+        return 0;
     }
 
-    if (pthread_rwlock_rdlock(&storage->rwlock) != 0) {
-        return NULL;
+    batch_slot_t *slots = plan_batch(storage, keys, key_lens, count);
+    uint8_t *held = calloc(storage->shard_count, sizeof(uint8_t));
+    if (!slots || !held) {
+        free(slots);
+        free(held);
+        return -1;
     }
 
-    kv_entry_t *entry = find_entry(storage, key);
-    if (!entry) {
-        if (storage->stats) {
-            stats_inc_cache_miss(storage->stats);
+    for (size_t start = 0; start < count;) {
+        const size_t end = batch_group_end(storage, slots, start, count);
+        storage_shard_t *shard = shard_for_hash(storage, slots[start].hash);
+
+        if (pthread_rwlock_wrlock(&shard->rwlock) != 0) {
+            unlock_batch(storage, slots, start);
+            free(slots);
+            free(held);
+            return -1;
         }
-        pthread_rwlock_unlock(&storage->rwlock);
-        return NULL;
-    }
+        rehash_step(storage, shard, STORAGE_REHASH_STEP);
+        held[shard - storage->shards] = 1;
 
-    if (storage->stats) {
-        stats_inc_cache_hit(storage->stats);
+        start = end;
+    }
+    held_shards = held;
+
+    int result = 0;
+    prefetch_first(storage, slots, count);
+
+    if (flags & STORAGE_SET_NX) {
+        for (size_t i = 0; i < count && result == 0; i++) {
+            const batch_slot_t *slot = &slots[i];
+            prefetch_ahead(storage, slots, i, count);
+            if (find_entry(storage, shard_for_hash(storage, slot->hash), keys[slot->index],
+                           key_lens[slot->index], slot->hash)) {
+                result = 1;
+            }
+        }
+        prefetch_first(storage, slots, count);
     }
 
-    kv_entry_touch(entry);
-
-    char *value = malloc(entry->value_len);
-    if (value) {
-        memcpy(value, entry->value, entry->value_len);
-        if (value_len) {
-            *value_len = entry->value_len;
+    for (size_t i = 0; i < count && result == 0; i++) {
+        const batch_slot_t *slot = &slots[i];
+        prefetch_ahead(storage, slots, i, count);
+        if (set_locked(storage, shard_for_hash(storage, slot->hash), keys[slot->index], key_lens[slot->index],
+                       slot->hash, values[slot->index], value_lens[slot->index], 0, 0, NULL, NULL) != 0) {
+            result = -1;
         }
     }
 
-    pthread_rwlock_unlock(&storage->rwlock);
-    return value;
+    held_shards = NULL;
+    unlock_batch(storage, slots, count);
+    free(slots);
+    free(held);
+    return result;
 }
 
-static int update_existing_entry(storage_t *storage, kv_entry_t *existing, const char *value, size_t value_len,
-                                 const time_t ttl) {
-    char *new_value = malloc(value_len);
-    if (!new_value) {
+/*
+ * INCR/DECR/INCRBY/DECRBY as one write-locked step. The result is kept as an
+ * integer-encoded entry, updated in place when no reader can be looking at
+ * it; a missing key starts from 0 and an existing one keeps its TTL.
+ */
+int storage_incr(storage_t *storage, const char *key, const size_t key_len, const int64_t delta,
+                 int64_t *result) {
+    if (!storage || !key) {
         return -1;
     }
 
-    storage->memory_used -= existing->value_len;
-    free(existing->value);
-
-    existing->value = new_value;
-    memcpy(existing->value, value, value_len);
-    existing->value_len = value_len;
-    storage->memory_used += value_len;
+    const uint64_t hash = key_hash(storage, key, key_len);
+    storage_shard_t *shard = shard_for_hash(storage, hash);
 
-    if (ttl > 0) {
-        existing->expires_at = time(NULL) + ttl;
-    } else if (ttl == 0 && storage->default_ttl > 0) {
-        existing->expires_at = time(NULL) + storage->default_ttl;
-    } else {
-        existing->expires_at = 0;
+    if (pthread_rwlock_wrlock(&shard->rwlock) != 0) {
+        return -1;
     }
 
-    kv_entry_touch(existing);
-    lru_move_to_head(storage, existing);
+    rehash_step(storage, shard, STORAGE_REHASH_STEP);
+    kv_entry_t *existing = lookup_live(storage, shard, key, key_len, hash);
 
-    if (storage->stats) {
-        stats_set_memory(storage->stats, storage->memory_used);
+    int64_t current = 0;
+    if (existing && kv_entry_to_int(existing, &current) != 0) {
+        pthread_rwlock_unlock(&shard->rwlock);
+        return STORAGE_NOT_NUMBER;
     }
 
-    return 0;
-}
+    int64_t value;
+    if (__builtin_add_overflow(current, delta, &value)) {
+        pthread_rwlock_unlock(&shard->rwlock);
+        return STORAGE_OVERFLOW;
+    }
 
-static int check_and_evict_memory(storage_t *storage, const size_t key_len, const size_t value_len) {
-    const size_t new_memory = storage->memory_used + key_len + value_len;
-    if (storage->max_memory > 0 && new_memory > storage->max_memory) {
-        const size_t needed = new_memory - storage->max_memory;
-        lru_evict(storage, needed);
+    int status = 0;
+    if (existing) {
+        record_access(storage, hash);
+    }
+    if (existing && existing->encoding == KV_ENCODING_INT && !storage->lockfree_reads &&
+        !kv_entry_is_shared(existing) && kv_entry_fits(existing, kv_int_width(value))) {
+        const size_t old_len = existing->value_len;
+        kv_entry_set_int(existing, value);
+        account_dataset(storage, existing->value_len, old_len);
+        kv_entry_touch(existing, counts_frequency(storage));
+    } else {
+        const uint64_t expires_at = existing ? kv_entry_expires_at(existing) : entry_deadline(storage, 0);
+        const size_t memory = kv_entry_alloc_size_for(key_len, kv_int_width(value));
+        kv_entry_t *entry = reserve_entry(storage, shard, &existing, memory, hash) == 0
+                                ? kv_entry_create_int(key, key_len, value, expires_at)
+                                : NULL;
+        status = entry ? put_entry(storage, shard, existing, entry, hash) : -1;
+    }
 
-        if (storage->memory_used + key_len + value_len > storage->max_memory) {
-            return -1;
-        }
+    pthread_rwlock_unlock(&shard->rwlock);
+    if (status == 0 && result) {
+        *result = value;
     }
-    return 0;
+    return status;
 }
 
-static void insert_new_entry(storage_t *storage, kv_entry_t *new_entry, const char *key) {
-    const uint32_t hash = hash_function(key);
-    const size_t index = hash % storage->bucket_count;
-
-    new_entry->next = storage->buckets[index];
-    if (storage->buckets[index]) {
-        storage->buckets[index]->prev = new_entry;
+static size_t format_float(const long double value, char *buffer) {
+    size_t len = (size_t) snprintf(buffer, KV_FLOAT_TEXT_SIZE, "%.17Lf", value);
+    if (memchr(buffer, '.', len)) {
+        while (buffer[len - 1] == '0') {
+            len--;
+        }
+        if (buffer[len - 1] == '.') {
+            len--;
+        }
     }
-    storage->buckets[index] = new_entry;
-
-    lru_add_to_head(storage, new_entry);
-
-    const size_t key_len = strlen(key);
-    storage->entry_count++;
-    storage->memory_used += key_len + new_entry->value_len;
-
-    if (storage->stats) {
-        stats_set_memory(storage->stats, storage->memory_used);
+    if (len == 2 && buffer[0] == '-' && buffer[1] == '0') {
+        buffer[0] = '0';
+        len = 1;
     }
+    buffer[len] = '\0';
+    return len;
 }
 
-int storage_set(storage_t *storage, const char *key, const char *value,
-                const size_t value_len, const time_t ttl) {
-    if (!storage || !key || !value) {
+/*
+ * INCRBYFLOAT: the sum is stored as text, like Redis, so the key reads back
+ * exactly as it was replied. result must hold KV_FLOAT_TEXT_SIZE bytes.
+ */
+int storage_incr_float(storage_t *storage, const char *key, const size_t key_len, const long double delta,
+                       char *result, size_t *result_len) {
+    if (!storage || !key || !result) {
         return -1;
     }
 
-    if (pthread_rwlock_wrlock(&storage->rwlock) != 0) {
+    const uint64_t hash = key_hash(storage, key, key_len);
+    storage_shard_t *shard = shard_for_hash(storage, hash);
+
+    if (pthread_rwlock_wrlock(&shard->rwlock) != 0) {
         return -1;
     }
 
-    kv_entry_t *existing = find_entry(storage, key);
+    rehash_step(storage, shard, STORAGE_REHASH_STEP);
+    kv_entry_t *existing = lookup_live(storage, shard, key, key_len, hash);
+
+    long double current = 0;
     if (existing) {
-        const int result = update_existing_entry(storage, existing, value, value_len, ttl);
-        pthread_rwlock_unlock(&storage->rwlock);
-        return result;
+        char buffer[KV_INT_TEXT_SIZE];
+        size_t len;
+        const char *text = kv_entry_text(existing, buffer, &len);
+        if (kv_parse_float(text, len, &current) != 0) {
+            pthread_rwlock_unlock(&shard->rwlock);
+            return STORAGE_NOT_NUMBER;
+        }
     }
 
-    const time_t entry_ttl = ttl > 0 ? ttl : storage->default_ttl;
-    kv_entry_t *new_entry = kv_entry_create(key, value, value_len, entry_ttl);
-    if (!new_entry) {
-        pthread_rwlock_unlock(&storage->rwlock);
-        return -1;
+    const long double value = current + delta;
+    if (isnan(value) || isinf(value)) {
+        pthread_rwlock_unlock(&shard->rwlock);
+        return STORAGE_OVERFLOW;
     }
 
-    const size_t key_len = strlen(key);
-    if (check_and_evict_memory(storage, key_len, value_len) != 0) {
-        kv_entry_free(new_entry);
-        pthread_rwlock_unlock(&storage->rwlock);
-        return -1;
+    const size_t len = format_float(value, result);
+    const uint64_t expires_at = existing ? kv_entry_expires_at(existing) : entry_deadline(storage, 0);
+    if (existing) {
+        record_access(storage, hash);
     }
-
-    insert_new_entry(storage, new_entry, key);
-
-    pthread_rwlock_unlock(&storage->rwlock);
-    return 0;
+    kv_entry_t *entry = reserve_entry(storage, shard, &existing, kv_entry_alloc_size_for(key_len, len), hash) == 0
+                            ? kv_entry_create(key, key_len, result, len, expires_at)
+                            : NULL;
+    const int status = entry ? put_entry(storage, shard, existing, entry, hash) : -1;
+
+    pthread_rwlock_unlock(&shard->rwlock);
+    if (status == 0 && result_len) {
+        *result_len = len;
+    }
+    return status;
 }
 
-int storage_del(storage_t *storage, const char *key) {
+int storage_del(storage_t *storage, const char *key, const size_t key_len) {
     if (!storage || !key) {
         return 0;
     }
 
-    if (pthread_rwlock_wrlock(&storage->rwlock) != 0) {
+    const uint64_t hash = key_hash(storage, key, key_len);
+    storage_shard_t *shard = shard_for_hash(storage, hash);
+
+    if (pthread_rwlock_wrlock(&shard->rwlock) != 0) {
         return 0;
     }
 
-    const uint32_t hash = hash_function(key);
-    const size_t index = hash % storage->bucket_count;
-
-    kv_entry_t *entry = storage->buckets[index];
-    while (entry) {
-        if (strcmp(entry->key, key) == 0) {
-            lru_remove(storage, entry);
-
-            if (entry->prev) {
-                entry->prev->next = entry->next;
-            } else {
-                storage->buckets[index] = entry->next;
-            }
-            if (entry->next) {
-                entry->next->prev = entry->prev;
-            }
-
-            storage->memory_used -= strlen(entry->key) + entry->value_len;
-            storage->entry_count--;
+    rehash_step(storage, shard, STORAGE_REHASH_STEP);
 
-            if (storage->stats) {
-                stats_set_memory(storage->stats, storage->memory_used);
-            }
-
-            kv_entry_free(entry);
-            pthread_rwlock_unlock(&storage->rwlock);
-            return 1;
-        }
-        entry = entry->next;
+    kv_entry_t *entry = lookup_entry(storage, shard, key, key_len, hash);
+    if (!entry) {
+        pthread_rwlock_unlock(&shard->rwlock);
+        return 0;
     }
 
-    pthread_rwlock_unlock(&storage->rwlock);
-    return 0;
+    remove_entry(storage, shard, entry, hash);
+    shrink_if_needed(storage, shard);
+
+    pthread_rwlock_unlock(&shard->rwlock);
+    return 1;
 }
 
-int storage_exists(storage_t *storage, const char *key) {
+int storage_exists(storage_t *storage, const char *key, const size_t key_len) {
     if (!storage || !key) {
         return 0;
     }
 
-    if (pthread_rwlock_rdlock(&storage->rwlock) != 0) {
+    const uint64_t hash = key_hash(storage, key, key_len);
+    storage_shard_t *shard = shard_for_hash(storage, hash);
+
+    if (storage->lockfree_reads) {
+        kv_entry_t *entry;
+        epoch_enter();
+        const int found = find_entry_lockfree(storage, shard, key, key_len, hash, &entry);
+        epoch_exit();
+        if (found == 0) {
+            return entry != NULL;
+        }
+    }
+
+    if (pthread_rwlock_rdlock(&shard->rwlock) != 0) {
         return 0;
     }
-    const kv_entry_t *entry = find_entry(storage, key);
+    const kv_entry_t *entry = find_entry(storage, shard, key, key_len, hash);
     const int exists = entry != NULL;
-    pthread_rwlock_unlock(&storage->rwlock);
+    pthread_rwlock_unlock(&shard->rwlock);
 
     return exists;
 }
 
-int storage_expire(storage_t *storage, const char *key, const time_t ttl) {
+/*
+ * A deadline that has already passed deletes the key right away, as Redis
+ * does for a non-positive TTL or a past timestamp, and still counts as set.
+ */
+static int set_deadline(storage_t *storage, const char *key, const size_t key_len, const uint64_t expires_at) {
     if (!storage || !key) {
         return 0;
     }
 
-    if (pthread_rwlock_wrlock(&storage->rwlock) != 0) {
+    const uint64_t hash = key_hash(storage, key, key_len);
+    storage_shard_t *shard = shard_for_hash(storage, hash);
+
+    if (pthread_rwlock_wrlock(&shard->rwlock) != 0) {
         return 0;
     }
 
-    kv_entry_t *entry = find_entry(storage, key);
+    rehash_step(storage, shard, STORAGE_REHASH_STEP);
+
+    kv_entry_t *entry = find_entry(storage, shard, key, key_len, hash);
     if (!entry) {
-        pthread_rwlock_unlock(&storage->rwlock);
+        pthread_rwlock_unlock(&shard->rwlock);
         return 0;
     }
 
-    if (ttl > 0) {
-        entry->expires_at = time(NULL) + ttl;
-    } else {
-        entry->expires_at = 0;
+    if (expires_at <= kv_expiry_clock()) {
+        remove_entry(storage, shard, entry, hash);
+        shrink_if_needed(storage, shard);
+        pthread_rwlock_unlock(&shard->rwlock);
+        return 1;
     }
 
-    pthread_rwlock_unlock(&storage->rwlock);
+    const uint64_t old_expires_at = kv_entry_expires_at(entry);
+    kv_entry_set_expires_at(entry, expires_at);
+    schedule_expiry(storage, shard, entry, hash, old_expires_at);
+
+    pthread_rwlock_unlock(&shard->rwlock);
     return 1;
 }
 
-int64_t storage_ttl(storage_t *storage, const char *key) {
+int storage_expire(storage_t *storage, const char *key, const size_t key_len, const int64_t ttl_ms) {
+    return set_deadline(storage, key, key_len, ttl_ms > 0 ? kv_expiry_deadline(ttl_ms) : 1);
+}
+
+int storage_expire_at(storage_t *storage, const char *key, const size_t key_len, const int64_t unix_ms) {
+    return set_deadline(storage, key, key_len, unix_ms > 0 ? (uint64_t) unix_ms : 1);
+}
+
+static int64_t lookup_pttl(storage_t *storage, const char *key, const size_t key_len) {
     if (!storage || !key) {
-        return -1;
+        return -2;
     }
 
-    if (pthread_rwlock_rdlock(&storage->rwlock) != 0) {
-        return -1;
-    }
+    const uint64_t hash = key_hash(storage, key, key_len);
+    storage_shard_t *shard = shard_for_hash(storage, hash);
 
-    kv_entry_t *entry = find_entry(storage, key);
-    if (!entry) {
-        pthread_rwlock_unlock(&storage->rwlock);
-        return -1;
+    if (storage->lockfree_reads) {
+        kv_entry_t *entry;
+        epoch_enter();
+        if (find_entry_lockfree(storage, shard, key, key_len, hash, &entry) == 0) {
+            const int64_t ttl = entry_pttl(entry);
+            epoch_exit();
+            return ttl;
+        }
+        epoch_exit();
     }
 
-    if (entry->expires_at == 0) {
-        pthread_rwlock_unlock(&storage->rwlock);
+    if (pthread_rwlock_rdlock(&shard->rwlock) != 0) {
         return -2;
     }
 
-    const time_t now = time(NULL);
-    const int64_t ttl = entry->expires_at - now;
+    const int64_t ttl = entry_pttl(find_entry(storage, shard, key, key_len, hash));
+
+    pthread_rwlock_unlock(&shard->rwlock);
+    return ttl;
+}
+
+int64_t storage_ttl(storage_t *storage, const char *key, const size_t key_len) {
+    const int64_t ttl = lookup_pttl(storage, key, key_len);
+    return ttl < 0 ? ttl : (ttl + 500) / 1000;
+}
+
+int64_t storage_pttl(storage_t *storage, const char *key, const size_t key_len) {
+    return lookup_pttl(storage, key, key_len);
+}
+
+static long elapsed_us(const struct timespec *start, const struct timespec *now) {
+    return (now->tv_sec - start->tv_sec) * 1000000L + (now->tv_nsec - start->tv_nsec) / 1000;
+}
+
+static void record_expire_cycle(storage_t *storage, const struct timespec *start, const size_t removed) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    atomic_store_explicit(&storage->expire_cycle_us, elapsed_us(start, &now), memory_order_relaxed);
+
+    stats_add_expired(storage->stats, removed);
+
+    const long interval_us = elapsed_us(&storage->expire_last_cycle, start);
+    storage->expire_last_cycle = *start;
+    if (interval_us <= 0) {
+        return;
+    }
 
-    pthread_rwlock_unlock(&storage->rwlock);
-    return ttl > 0 ? ttl : -1;
+    const size_t instant = (size_t) ((double) removed * 1000000.0 / (double) interval_us);
+    const size_t rate = atomic_load_explicit(&storage->expire_rate, memory_order_relaxed);
+    atomic_store_explicit(&storage->expire_rate, (rate * 3 + instant) / 4, memory_order_relaxed);
 }
 
+/*
+ * One active expiry cycle. Shards are visited round-robin starting where the
+ * previous cycle stopped, and a shard is revisited in 64-key rounds for as
+ * long as its rounds come back full, so the cycle spends its time where keys
+ * are actually due and idles through the rest after one heap peek each. The
+ * shard lock is released between rounds and the cycle stops as soon as the
+ * configured budget is spent, leaving the backlog to the next tick.
+ */
 size_t storage_cleanup_expired(storage_t *storage) {
     if (!storage) {
         return 0;
     }
 
-    if (pthread_rwlock_wrlock(&storage->rwlock) != 0) {
-        return 0;
-    }
+    const long budget_us = atomic_load_explicit(&storage->expire_budget_us, memory_order_relaxed);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
     size_t removed = 0;
-    const time_t now = time(NULL);
+    for (size_t visited = 0; visited < storage->shard_count; visited++) {
+        const size_t cursor = atomic_fetch_add_explicit(&storage->expiry_cursor, 1, memory_order_relaxed);
+        storage_shard_t *shard = &storage->shards[cursor % storage->shard_count];
+
+        int more = 0;
+        do {
+            if (pthread_rwlock_wrlock(&shard->rwlock) != 0) {
+                break;
+            }
 
-    for (size_t i = 0; i < storage->bucket_count; i++) {
-        kv_entry_t *entry = storage->buckets[i];
-        while (entry) {
-            kv_entry_t *next = entry->next;
+            removed += shard_expire_due(storage, shard, kv_expiry_clock(), &more);
 
-            if (entry->expires_at > 0 && now >= entry->expires_at) {
-                lru_remove(storage, entry);
+            pthread_rwlock_unlock(&shard->rwlock);
 
-                if (entry->prev) {
-                    entry->prev->next = entry->next;
-                } else {
-                    storage->buckets[i] = entry->next;
-                }
-                if (entry->next) {
-                    entry->next->prev = entry->prev;
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (elapsed_us(&start, &now) >= budget_us) {
+                if (more) {
+                    atomic_fetch_sub_explicit(&storage->expiry_cursor, 1, memory_order_relaxed);
                 }
+                record_expire_cycle(storage, &start, removed);
+                return removed;
+            }
+        } while (more);
+    }
+
+    record_expire_cycle(storage, &start, removed);
+    return removed;
+}
+
+static int rehash_shards_for(storage_t *storage, const long budget_us) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-                storage->memory_used -= strlen(entry->key) + entry->value_len;
-                storage->entry_count--;
+    int rehashing = 0;
+    for (size_t visited = 0; visited < storage->shard_count; visited++) {
+        const size_t cursor = atomic_fetch_add_explicit(&storage->maintenance_cursor, 1, memory_order_relaxed);
+        storage_shard_t *shard = &storage->shards[cursor % storage->shard_count];
 
-                kv_entry_free(entry);
-                removed++;
+        int shard_rehashing = 0;
+        do {
+            if (pthread_rwlock_wrlock(&shard->rwlock) != 0) {
+                break;
             }
 
-            entry = next;
+            expand_if_needed(storage, shard);
+            shrink_if_needed(storage, shard);
+            shard_rehashing = rehash_step(storage, shard, 100);
+
+            pthread_rwlock_unlock(&shard->rwlock);
+
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (elapsed_us(&start, &now) >= budget_us) {
+                return 1;
+            }
+        } while (shard_rehashing);
+
+        rehashing |= shard_rehashing;
+    }
+
+    return rehashing;
+}
+
+/*
+ * The maintenance tick is also where entries retired by workers that have
+ * gone quiet get freed, so the collection runs even when the rehash budget
+ * runs out, and where the slab memory held but unused by entries is
+ * sampled for the max_memory check.
+ */
+int storage_rehash_for(storage_t *storage, const long budget_us) {
+    if (!storage) {
+        return 0;
+    }
+
+    const int rehashing = rehash_shards_for(storage, budget_us);
+    if (storage->lockfree_reads) {
+        epoch_collect();
+    }
+
+    slab_stats_t slab;
+    slab_get_stats(&slab);
+    atomic_store_explicit(&storage->slab_idle_bytes,
+                          slab.held_bytes > slab.used_bytes ? (size_t) (slab.held_bytes - slab.used_bytes) : 0,
+                          memory_order_relaxed);
+
+    return rehashing;
+}
+
+char *storage_format_info(storage_t *storage) {
+    if (!storage) {
+        return NULL;
+    }
+
+    size_t keys = 0;
+    size_t encoded_keys[KV_ENCODING_COUNT] = {0};
+    size_t buckets = 0;
+    size_t rehashing_shards = 0;
+    size_t rehash_moved = 0;
+    size_t rehash_total = 0;
+    size_t tombstones = 0;
+    size_t expiry_queue = 0;
+    size_t stale_keys = 0;
+    const uint64_t now = kv_expiry_clock();
+
+    for (size_t i = 0; i < storage->shard_count; i++) {
+        storage_shard_t *shard = &storage->shards[i];
+        if (pthread_rwlock_rdlock(&shard->rwlock) != 0) {
+            return NULL;
         }
+
+        keys += shard->entry_count;
+        for (int e = 0; e < KV_ENCODING_COUNT; e++) {
+            encoded_keys[e] += shard->encoded_keys[e];
+        }
+        expiry_queue += shard->expiry.size;
+        stale_keys += shard_stale_estimate(storage, shard, now);
+        if (shard->swiss) {
+            buckets += shard->swiss->capacity;
+            tombstones += shard->swiss->tombstones;
+        } else if (is_rehashing(shard)) {
+            buckets += shard->tables[1].size;
+            rehashing_shards++;
+            rehash_moved += shard->tables[1].used;
+            rehash_total += shard->entry_count;
+        } else {
+            buckets += shard->tables[0].size;
+        }
+
+        pthread_rwlock_unlock(&shard->rwlock);
     }
 
-    if (removed > 0 && storage->stats) {
-        stats_set_memory(storage->stats, storage->memory_used);
+    char *buffer = malloc(2048);
+    if (!buffer) {
+        return NULL;
     }
 
-    pthread_rwlock_unlock(&storage->rwlock);
-    return removed;
+    slab_stats_t slab;
+    slab_get_stats(&slab);
+    const double utilization = slab.held_bytes > 0 ? (double) slab.used_bytes / (double) slab.held_bytes * 100.0 : 0.0;
+    const double fragmentation = slab.used_bytes > 0 ? (double) slab.held_bytes / (double) slab.used_bytes : 0.0;
+
+    const double load_factor = (double) keys / (double) buckets;
+    const double rehash_progress = rehash_total > 0 ? (double) rehash_moved / (double) rehash_total * 100.0 : 100.0;
+
+    snprintf(buffer, 2048,
+             "5. Keyspace\r\n"
+             "  keys                       %zu  (%s %zu, %s %zu)\r\n"
+             "  shards                     %zu\r\n"
+             "  index                      %s\r\n"
+             "  table_size                 %zu\r\n"
+             "  tombstones                 %zu\r\n"
+             "  load_factor                %.2f\r\n"
+             "  rehashing_shards           %zu\r\n"
+             "  rehash_progress            %.1f%%\r\n"
+             "  expiry_queue               %zu\r\n"
+             "  stale_keys_estimate        %zu\r\n"
+             "  expired_per_sec            %zu\r\n"
+             "  expire_cycle_us            %ld  (budget %ld)\r\n"
+             "  lockfree_reads             %s\r\n"
+             "  eviction_policy            %s\r\n"
+             "  sketch_bytes               %zu\r\n"
+             "  epoch                      %llu  (%zu retired pending)\r\n"
+             "\r\n"
+             "6. Allocator\r\n"
+             "  size_classes               %zu\r\n"
+             "  slab_pages                 %zu  (%.1f MiB)\r\n"
+             "  held_bytes                 %llu  (%llu large)\r\n"
+             "  used_bytes                 %llu\r\n"
+             "  slab_utilization           %.1f%%\r\n"
+             "  fragmentation_ratio        %.2f\r\n",
+             keys,
+             kv_encoding_name(KV_ENCODING_RAW), encoded_keys[KV_ENCODING_RAW],
+             kv_encoding_name(KV_ENCODING_INT), encoded_keys[KV_ENCODING_INT],
+             storage->shard_count,
+             storage_index_name(storage->index),
+             buckets,
+             tombstones,
+             load_factor,
+             rehashing_shards,
+             rehash_progress,
+             expiry_queue,
+             stale_keys,
+             atomic_load_explicit(&storage->expire_rate, memory_order_relaxed),
+             atomic_load_explicit(&storage->expire_cycle_us, memory_order_relaxed),
+             storage_get_expire_budget(storage),
+             storage->lockfree_reads ? "yes" : "no",
+             storage_policy_name(storage_get_policy(storage)),
+             frequency_sketch_memory(atomic_load_explicit(&storage->sketch, memory_order_acquire)),
+             (unsigned long long) epoch_current(),
+             epoch_pending(),
+             slab.classes,
+             slab.pages,
+             (double) slab.mapped_bytes / (1024.0 * 1024.0),
+             (unsigned long long) slab.held_bytes,
+             (unsigned long long) slab.large_bytes,
+             (unsigned long long) slab.used_bytes,
+             utilization,
+             fragmentation
+    );
+
+    return buffer;
 }
 
 size_t storage_get_count(storage_t *storage) {
@@ -469,11 +2124,15 @@ size_t storage_get_count(storage_t *storage) {
         return 0;
     }
 
-    if (pthread_rwlock_rdlock(&storage->rwlock) != 0) {
-        return 0;
+    size_t count = 0;
+    for (size_t i = 0; i < storage->shard_count; i++) {
+        storage_shard_t *shard = &storage->shards[i];
+        if (pthread_rwlock_rdlock(&shard->rwlock) != 0) {
+            continue;
+        }
+        count += shard->entry_count;
+        pthread_rwlock_unlock(&shard->rwlock);
     }
-    const size_t count = storage->entry_count;
-    pthread_rwlock_unlock(&storage->rwlock);
 
     return count;
 }
@@ -483,25 +2142,50 @@ size_t storage_get_memory(storage_t *storage) {
         return 0;
     }
 
-    if (pthread_rwlock_rdlock(&storage->rwlock) != 0) {
+    return atomic_load_explicit(&storage->memory_used, memory_order_relaxed);
+}
+
+size_t storage_get_dataset_memory(storage_t *storage) {
+    if (!storage) {
         return 0;
     }
-    const size_t memory = storage->memory_used;
-    pthread_rwlock_unlock(&storage->rwlock);
 
-    return memory;
+    return atomic_load_explicit(&storage->dataset_bytes, memory_order_relaxed);
 }
 
-void storage_set_max_memory(storage_t *storage, const size_t max_memory) {
+size_t storage_get_shard_count(const storage_t *storage) {
     if (!storage) {
-        return;
+        return 0;
+    }
+
+    return storage->shard_count;
+}
+
+const char *storage_index_name(const storage_index_t index) {
+    return index == STORAGE_INDEX_SWISS ? "swiss" : "chain";
+}
+
+int storage_index_parse(const char *name, storage_index_t *index) {
+    if (!name || !index) {
+        return -1;
+    }
+
+    if (strcasecmp(name, "chain") == 0) {
+        *index = STORAGE_INDEX_CHAIN;
+    } else if (strcasecmp(name, "swiss") == 0) {
+        *index = STORAGE_INDEX_SWISS;
+    } else {
+        return -1;
     }
+    return 0;
+}
 
-    if (pthread_rwlock_wrlock(&storage->rwlock) != 0) {
+void storage_set_max_memory(storage_t *storage, const size_t max_memory) {
+    if (!storage) {
         return;
     }
-    storage->max_memory = max_memory;
-    pthread_rwlock_unlock(&storage->rwlock);
+
+    atomic_store_explicit(&storage->max_memory, max_memory, memory_order_relaxed);
 }
 
 void storage_set_default_ttl(storage_t *storage, const time_t default_ttl) {
@@ -509,9 +2193,111 @@ void storage_set_default_ttl(storage_t *storage, const time_t default_ttl) {
         return;
     }
 
-    if (pthread_rwlock_wrlock(&storage->rwlock) != 0) {
-        return;
+    atomic_store_explicit(&storage->default_ttl, default_ttl, memory_order_relaxed);
+}
+
+unsigned storage_get_eviction_samples(storage_t *storage) {
+    if (!storage) {
+        return 0;
+    }
+
+    return atomic_load_explicit(&storage->eviction_samples, memory_order_relaxed);
+}
+
+int storage_set_eviction_samples(storage_t *storage, const unsigned samples) {
+    if (!storage || samples == 0 || samples > STORAGE_MAX_EVICTION_SAMPLES) {
+        return -1;
+    }
+
+    atomic_store_explicit(&storage->eviction_samples, samples, memory_order_relaxed);
+    return 0;
+}
+
+long storage_get_expire_budget(storage_t *storage) {
+    if (!storage) {
+        return 0;
+    }
+
+    return atomic_load_explicit(&storage->expire_budget_us, memory_order_relaxed);
+}
+
+int storage_set_expire_budget(storage_t *storage, const long budget_us) {
+    if (!storage || budget_us < STORAGE_MIN_EXPIRE_BUDGET_US || budget_us > STORAGE_MAX_EXPIRE_BUDGET_US) {
+        return -1;
     }
-    storage->default_ttl = default_ttl;
-    pthread_rwlock_unlock(&storage->rwlock);
+
+    atomic_store_explicit(&storage->expire_budget_us, budget_us, memory_order_relaxed);
+    return 0;
+}
+
+const char *storage_policy_name(const storage_policy_t policy) {
+    switch (policy) {
+        case STORAGE_POLICY_ALLKEYS_LFU:
+            return "allkeys-lfu";
+        case STORAGE_POLICY_VOLATILE_TTL:
+            return "volatile-ttl";
+        case STORAGE_POLICY_NOEVICTION:
+            return "noeviction";
+        case STORAGE_POLICY_W_TINYLFU:
+            return "w-tinylfu";
+        default:
+            return "allkeys-lru";
+    }
+}
+
+int storage_policy_parse(const char *name, storage_policy_t *policy) {
+    if (!name || !policy) {
+        return -1;
+    }
+
+    if (strcasecmp(name, "allkeys-lru") == 0) {
+        *policy = STORAGE_POLICY_ALLKEYS_LRU;
+    } else if (strcasecmp(name, "allkeys-lfu") == 0) {
+        *policy = STORAGE_POLICY_ALLKEYS_LFU;
+    } else if (strcasecmp(name, "volatile-ttl") == 0) {
+        *policy = STORAGE_POLICY_VOLATILE_TTL;
+    } else if (strcasecmp(name, "noeviction") == 0) {
+        *policy = STORAGE_POLICY_NOEVICTION;
+    } else if (strcasecmp(name, "w-tinylfu") == 0) {
+        *policy = STORAGE_POLICY_W_TINYLFU;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+storage_policy_t storage_get_policy(storage_t *storage) {
+    if (!storage) {
+        return STORAGE_POLICY_ALLKEYS_LRU;
+    }
+
+    return atomic_load_explicit(&storage->policy, memory_order_relaxed);
+}
+
+/*
+ * The frequency sketch is allocated the first time W-TinyLFU is selected and
+ * kept until shutdown, so readers never see it freed under them.
+ */
+int storage_set_policy(storage_t *storage, const storage_policy_t policy) {
+    if (!storage) {
+        return -1;
+    }
+
+    if (policy == STORAGE_POLICY_W_TINYLFU && !atomic_load_explicit(&storage->sketch, memory_order_acquire)) {
+        const size_t max_memory = atomic_load_explicit(&storage->max_memory, memory_order_relaxed);
+        frequency_sketch_t *sketch = frequency_sketch_create(max_memory > 0
+                                                                 ? max_memory / STORAGE_SKETCH_BYTES_PER_KEY
+                                                                 : STORAGE_SKETCH_DEFAULT_KEYS);
+        if (!sketch) {
+            return -1;
+        }
+
+        frequency_sketch_t *expected = NULL;
+        if (!atomic_compare_exchange_strong(&storage->sketch, &expected, sketch)) {
+            frequency_sketch_destroy(sketch);
+        }
+    }
+
+    atomic_store_explicit(&storage->policy, policy, memory_order_relaxed);
+    return 0;
 }
@@ -2,49 +2,203 @@
 
 #include "../model/kv_entry.h"
 #include "../model/stats.h"
+#include "expiry_heap.h"
+#include "frequency_sketch.h"
+#include "swiss_table.h"
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
 
 #define STORAGE_DEFAULT_SIZE 1024
+#define STORAGE_DEFAULT_SHARDS 16
+#define STORAGE_MAX_SHARDS 1024
+#define STORAGE_REHASH_STEP 1
+#define STORAGE_MAX_LOAD_FACTOR 1
+#define STORAGE_MIN_FILL_PERCENT 10
+#define STORAGE_EVICTION_SAMPLES 5
+#define STORAGE_MAX_EVICTION_SAMPLES 64
+#define STORAGE_EVICTION_POOL 16
+#define STORAGE_TINYLFU_WINDOW 16
+#define STORAGE_SKETCH_BYTES_PER_KEY 128
+#define STORAGE_SKETCH_DEFAULT_KEYS (1024 * 1024)
+#define STORAGE_EXPIRE_BATCH 64
+#define STORAGE_EXPIRY_SLACK 1024
+#define STORAGE_EXPIRE_BUDGET_US 25000
+#define STORAGE_MIN_EXPIRE_BUDGET_US 100
+#define STORAGE_MAX_EXPIRE_BUDGET_US 100000
+#define STORAGE_STALE_SAMPLES 16
+#define STORAGE_BATCH_PREFETCH 4
+
+#define STORAGE_SET_NX 0x1u
+#define STORAGE_SET_XX 0x2u
+
+#define STORAGE_NOT_NUMBER 1
+#define STORAGE_OVERFLOW 2
 
 typedef struct {
     kv_entry_t **buckets;
-    size_t bucket_count;
-    size_t entry_count;
-    size_t memory_used;
+    size_t size;
+    size_t mask;
+    size_t used;
+} storage_table_t;
+
+typedef enum {
+    STORAGE_INDEX_CHAIN,
+    STORAGE_INDEX_SWISS
+} storage_index_t;
+
+typedef enum {
+    STORAGE_POLICY_ALLKEYS_LRU,
+    STORAGE_POLICY_ALLKEYS_LFU,
+    STORAGE_POLICY_VOLATILE_TTL,
+    STORAGE_POLICY_NOEVICTION,
+    STORAGE_POLICY_W_TINYLFU
+} storage_policy_t;
+
+typedef struct {
     size_t max_memory;
     time_t default_ttl;
+    size_t shards;
+    int lockfree_reads;
+    storage_index_t index;
+    unsigned eviction_samples;
+    storage_policy_t policy;
+    long expire_budget_us;
+} storage_options_t;
+
+/*
+ * Entries picked up by eviction keep the full key hash next to them: the
+ * entry itself stores only 32 bits, too few to find it in the swiss index.
+ */
+typedef struct {
+    kv_entry_t *entry;
+    uint64_t hash;
+} storage_entry_ref_t;
 
-    kv_entry_t *lru_head;
-    kv_entry_t *lru_tail;
+typedef struct {
+    kv_entry_t *entry;
+    uint64_t hash;
+    uint32_t score;
+} storage_eviction_candidate_t;
+
+typedef struct {
+    _Alignas(64) pthread_rwlock_t rwlock;
+    atomic_uint table_seq;
 
-    pthread_rwlock_t rwlock;
+    storage_table_t tables[2];
+    long rehash_index;
+    swiss_table_t *swiss;
+    size_t entry_count;
+    size_t memory_used;
+    uint64_t rng;
+
+    storage_eviction_candidate_t eviction_pool[STORAGE_EVICTION_POOL];
+    size_t eviction_pool_size;
+
+    storage_entry_ref_t window[STORAGE_TINYLFU_WINDOW];
+    size_t window_size;
+
+    expiry_heap_t expiry;
+    size_t encoded_keys[KV_ENCODING_COUNT];
+} storage_shard_t;
+
+typedef struct {
+    storage_shard_t *shards;
+    size_t shard_count;
+    unsigned shard_bits;
+    int lockfree_reads;
+    storage_index_t index;
+    uint64_t hash_seed;
+
+    atomic_size_t memory_used;
+    atomic_size_t slab_idle_bytes;
+    atomic_size_t dataset_bytes;
+    atomic_size_t max_memory;
+    _Atomic time_t default_ttl;
+    atomic_uint eviction_samples;
+    _Atomic storage_policy_t policy;
+    _Atomic(frequency_sketch_t *) sketch;
+
+    atomic_size_t maintenance_cursor;
+    atomic_size_t expiry_cursor;
+    atomic_long expire_budget_us;
+    atomic_long expire_cycle_us;
+    atomic_size_t expire_rate;
+    struct timespec expire_last_cycle;
     stats_t *stats;
 } storage_t;
 
-storage_t *storage_create(size_t max_memory, time_t default_ttl, stats_t *stats);
+storage_t *storage_create(const storage_options_t *options, stats_t *stats);
 
 void storage_destroy(storage_t *storage);
 
-char *storage_get(storage_t *storage, const char *key, size_t *value_len);
+char *storage_get(storage_t *storage, const char *key, size_t key_len, size_t *value_len);
+
+kv_entry_t *storage_acquire(storage_t *storage, const char *key, size_t key_len);
+
+int storage_set(storage_t *storage, const char *key, size_t key_len, const char *value,
+                size_t value_len, int64_t ttl_ms);
+
+int storage_set_ex(storage_t *storage, const char *key, size_t key_len, const char *value, size_t value_len,
+                   int64_t ttl_ms, unsigned flags, char **old_value, size_t *old_len);
+
+int storage_mget(storage_t *storage, const char *const *keys, const size_t *key_lens, size_t count,
+                 kv_entry_t **entries);
 
-int storage_set(storage_t *storage, const char *key, const char *value,
-                size_t value_len, time_t ttl);
+int storage_mset(storage_t *storage, const char *const *keys, const size_t *key_lens,
+                 const char *const *values, const size_t *value_lens, size_t count, unsigned flags);
 
-int storage_del(storage_t *storage, const char *key);
+int storage_incr(storage_t *storage, const char *key, size_t key_len, int64_t delta, int64_t *result);
 
-int storage_exists(storage_t *storage, const char *key);
+int storage_incr_float(storage_t *storage, const char *key, size_t key_len, long double delta, char *result,
+                       size_t *result_len);
 
-int storage_expire(storage_t *storage, const char *key, time_t ttl);
+int storage_del(storage_t *storage, const char *key, size_t key_len);
 
-int64_t storage_ttl(storage_t *storage, const char *key);
+int storage_exists(storage_t *storage, const char *key, size_t key_len);
+
+int storage_expire(storage_t *storage, const char *key, size_t key_len, int64_t ttl_ms);
+
+int storage_expire_at(storage_t *storage, const char *key, size_t key_len, int64_t unix_ms);
+
+int64_t storage_ttl(storage_t *storage, const char *key, size_t key_len);
+
+int64_t storage_pttl(storage_t *storage, const char *key, size_t key_len);
 
 size_t storage_cleanup_expired(storage_t *storage);
 
+int storage_rehash_for(storage_t *storage, long budget_us);
+
+char *storage_format_info(storage_t *storage);
+
 size_t storage_get_count(storage_t *storage);
 
 size_t storage_get_memory(storage_t *storage);
 
+size_t storage_get_dataset_memory(storage_t *storage);
+
+size_t storage_get_shard_count(const storage_t *storage);
+
+const char *storage_index_name(storage_index_t index);
+
+int storage_index_parse(const char *name, storage_index_t *index);
+
 void storage_set_max_memory(storage_t *storage, size_t max_memory);
 
 void storage_set_default_ttl(storage_t *storage, time_t default_ttl);
+
+unsigned storage_get_eviction_samples(storage_t *storage);
+
+int storage_set_eviction_samples(storage_t *storage, unsigned samples);
+
+long storage_get_expire_budget(storage_t *storage);
+
+int storage_set_expire_budget(storage_t *storage, long budget_us);
+
+const char *storage_policy_name(storage_policy_t policy);
+
+int storage_policy_parse(const char *name, storage_policy_t *policy);
+
+storage_policy_t storage_get_policy(storage_t *storage);
+
+int storage_set_policy(storage_t *storage, storage_policy_t policy);
@@ -0,0 +1,254 @@
+#include "swiss_table.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static size_t table_bytes(const size_t capacity) {
+    const size_t header = (sizeof(swiss_table_t) + 63) & ~(size_t) 63;
+    const size_t total = header + capacity + capacity * sizeof(swiss_slot_t);
+    return (total + 63) & ~(size_t) 63;
+}
+
+static size_t h1(const uint64_t hash) {
+    return (size_t) (hash >> 7);
+}
+
+static int8_t h2(const uint64_t hash) {
+    return (int8_t) (hash & 0x7f);
+}
+
+#ifdef __SSE2__
+static uint32_t group_match(const int8_t *group, const int8_t tag) {
+    const __m128i ctrl = _mm_load_si128((const __m128i *) group);
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(tag)));
+}
+
+static uint32_t group_match_free(const int8_t *group) {
+    const __m128i ctrl = _mm_load_si128((const __m128i *) group);
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl));
+}
+#else
+static uint32_t group_match(const int8_t *group, const int8_t tag) {
+    uint32_t mask = 0;
+    for (int i = 0; i < SWISS_GROUP_WIDTH; i++) {
+        if (__atomic_load_n(&group[i], __ATOMIC_RELAXED) == tag) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+static uint32_t group_match_free(const int8_t *group) {
+    uint32_t mask = 0;
+    for (int i = 0; i < SWISS_GROUP_WIDTH; i++) {
+        if (__atomic_load_n(&group[i], __ATOMIC_RELAXED) < -1) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+#endif
+
+static uint32_t group_match_empty(const int8_t *group) {
+    return group_match(group, SWISS_CTRL_EMPTY);
+}
+
+static size_t max_load(const size_t capacity) {
+    return capacity - capacity / 8;
+}
+
+swiss_table_t *swiss_table_create(const size_t min_capacity) {
+    size_t capacity = SWISS_GROUP_WIDTH;
+    while (capacity < min_capacity) {
+        capacity <<= 1;
+    }
+
+    swiss_table_t *table = aligned_alloc(64, table_bytes(capacity));
+    if (!table) {
+        return NULL;
+    }
+
+    const size_t header = (sizeof(swiss_table_t) + 63) & ~(size_t) 63;
+    table->ctrl = (int8_t *) ((char *) table + header);
+    table->slots = (swiss_slot_t *) (table->ctrl + capacity);
+    table->capacity = capacity;
+    table->mask = capacity - 1;
+    table->used = 0;
+    table->tombstones = 0;
+    table->growth_left = max_load(capacity);
+
+    memset(table->ctrl, SWISS_CTRL_EMPTY, capacity);
+    memset(table->slots, 0, capacity * sizeof(swiss_slot_t));
+
+    return table;
+}
+
+void swiss_table_destroy(swiss_table_t *table) {
+    free(table);
+}
+
+swiss_table_t *swiss_table_rebuild(const swiss_table_t *table, const size_t min_capacity) {
+    swiss_table_t *rebuilt = swiss_table_create(min_capacity < table->used ? table->used : min_capacity);
+    if (!rebuilt) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->ctrl[i] >= 0 && swiss_table_insert(rebuilt, table->slots[i].entry, table->slots[i].hash) != 0) {
+            swiss_table_destroy(rebuilt);
+            return NULL;
+        }
+    }
+
+    return rebuilt;
+}
+
+/*
+ * Probes whole 16-slot groups with triangular steps, which visits every group
+ * once because the group count is a power of two. Safe against a concurrent
+ * writer: control bytes and slot entries are published with release stores,
+ * and a stale tag match on a reused slot is rejected by the hash and key
+ * compare.
+ */
+kv_entry_t *swiss_table_find(const swiss_table_t *table, const char *key, const size_t key_len,
+                             const uint64_t hash) {
+    const int8_t tag = h2(hash);
+    size_t pos = h1(hash) & table->mask & ~(size_t) (SWISS_GROUP_WIDTH - 1);
+
+    for (size_t step = SWISS_GROUP_WIDTH;; step += SWISS_GROUP_WIDTH) {
+        const int8_t *group = table->ctrl + pos;
+        uint32_t match = group_match(group, tag);
+        const uint32_t empty = group_match_empty(group);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        while (match) {
+            const swiss_slot_t *slot = &table->slots[pos + (size_t) __builtin_ctz(match)];
+            match &= match - 1;
+
+            if (__atomic_load_n(&slot->hash, __ATOMIC_RELAXED) != hash) {
+                continue;
+            }
+            kv_entry_t *entry = __atomic_load_n(&slot->entry, __ATOMIC_ACQUIRE);
+            if (entry && entry->key_len == key_len && memcmp(kv_entry_key(entry), key, key_len) == 0) {
+                return entry;
+            }
+        }
+
+        if (empty || step > table->capacity) {
+            return NULL;
+        }
+        pos = (pos + step) & table->mask;
+    }
+}
+
+void swiss_table_prefetch(const swiss_table_t *table, const uint64_t hash) {
+    const size_t pos = h1(hash) & table->mask & ~(size_t) (SWISS_GROUP_WIDTH - 1);
+    __builtin_prefetch(table->ctrl + pos);
+    __builtin_prefetch(&table->slots[pos]);
+}
+
+static long find_slot(const swiss_table_t *table, const kv_entry_t *entry, const uint64_t hash) {
+    const int8_t tag = h2(hash);
+    size_t pos = h1(hash) & table->mask & ~(size_t) (SWISS_GROUP_WIDTH - 1);
+
+    for (size_t step = SWISS_GROUP_WIDTH; step <= table->capacity + SWISS_GROUP_WIDTH; step += SWISS_GROUP_WIDTH) {
+        const int8_t *group = table->ctrl + pos;
+        uint32_t match = group_match(group, tag);
+
+        while (match) {
+            const size_t index = pos + (size_t) __builtin_ctz(match);
+            match &= match - 1;
+
+            if (table->slots[index].entry == entry) {
+                return (long) index;
+            }
+        }
+
+        if (group_match_empty(group)) {
+            break;
+        }
+        pos = (pos + step) & table->mask;
+    }
+
+    return -1;
+}
+
+static long find_free_slot(const swiss_table_t *table, const uint64_t hash) {
+    size_t pos = h1(hash) & table->mask & ~(size_t) (SWISS_GROUP_WIDTH - 1);
+
+    for (size_t step = SWISS_GROUP_WIDTH; step <= table->capacity + SWISS_GROUP_WIDTH; step += SWISS_GROUP_WIDTH) {
+        const uint32_t free_slots = group_match_free(table->ctrl + pos);
+        if (free_slots) {
+            return (long) (pos + (size_t) __builtin_ctz(free_slots));
+        }
+        pos = (pos + step) & table->mask;
+    }
+
+    return -1;
+}
+
+int swiss_table_insert(swiss_table_t *table, kv_entry_t *entry, const uint64_t hash) {
+    const long index = find_free_slot(table, hash);
+    if (index < 0) {
+        return -1;
+    }
+
+    const int reuses_tombstone = table->ctrl[index] == SWISS_CTRL_DELETED;
+    if (!reuses_tombstone && table->growth_left == 0) {
+        return -1;
+    }
+
+    swiss_slot_t *slot = &table->slots[index];
+    __atomic_store_n(&slot->hash, hash, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->entry, entry, __ATOMIC_RELEASE);
+    __atomic_store_n(&table->ctrl[index], h2(hash), __ATOMIC_RELEASE);
+
+    if (reuses_tombstone) {
+        table->tombstones--;
+    } else {
+        table->growth_left--;
+    }
+    table->used++;
+    return 0;
+}
+
+int swiss_table_replace(swiss_table_t *table, const kv_entry_t *old_entry, kv_entry_t *new_entry,
+                        const uint64_t hash) {
+    const long index = find_slot(table, old_entry, hash);
+    if (index < 0) {
+        return -1;
+    }
+
+    __atomic_store_n(&table->slots[index].entry, new_entry, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int swiss_table_contains(const swiss_table_t *table, const kv_entry_t *entry, const uint64_t hash) {
+    return find_slot(table, entry, hash) >= 0;
+}
+
+int swiss_table_remove(swiss_table_t *table, const kv_entry_t *entry, const uint64_t hash) {
+    const long index = find_slot(table, entry, hash);
+    if (index < 0) {
+        return -1;
+    }
+
+    __atomic_store_n(&table->ctrl[index], SWISS_CTRL_DELETED, __ATOMIC_RELEASE);
+    table->used--;
+    table->tombstones++;
+    return 0;
+}
+
+kv_entry_t *swiss_table_entry_at(const swiss_table_t *table, const size_t index) {
+    if (index >= table->capacity || table->ctrl[index] < 0) {
+        return NULL;
+    }
+    return table->slots[index].entry;
+}
+
+size_t swiss_table_memory(const swiss_table_t *table) {
+    return table ? table_bytes(table->capacity) : 0;
+}
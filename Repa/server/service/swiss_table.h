@@ -0,0 +1,46 @@
+#pragma once
+
+#include "../model/kv_entry.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define SWISS_GROUP_WIDTH 16
+#define SWISS_CTRL_EMPTY ((int8_t) -128)
+#define SWISS_CTRL_DELETED ((int8_t) -2)
+
+typedef struct {
+    uint64_t hash;
+    kv_entry_t *entry;
+} swiss_slot_t;
+
+typedef struct {
+    int8_t *ctrl;
+    swiss_slot_t *slots;
+    size_t capacity;
+    size_t mask;
+    size_t used;
+    size_t tombstones;
+    size_t growth_left;
+} swiss_table_t;
+
+swiss_table_t *swiss_table_create(size_t min_capacity);
+
+void swiss_table_destroy(swiss_table_t *table);
+
+swiss_table_t *swiss_table_rebuild(const swiss_table_t *table, size_t min_capacity);
+
+kv_entry_t *swiss_table_find(const swiss_table_t *table, const char *key, size_t key_len, uint64_t hash);
+
+void swiss_table_prefetch(const swiss_table_t *table, uint64_t hash);
+
+int swiss_table_insert(swiss_table_t *table, kv_entry_t *entry, uint64_t hash);
+
+int swiss_table_replace(swiss_table_t *table, const kv_entry_t *old_entry, kv_entry_t *new_entry, uint64_t hash);
+
+int swiss_table_contains(const swiss_table_t *table, const kv_entry_t *entry, uint64_t hash);
+
+int swiss_table_remove(swiss_table_t *table, const kv_entry_t *entry, uint64_t hash);
+
+kv_entry_t *swiss_table_entry_at(const swiss_table_t *table, size_t index);
+
+size_t swiss_table_memory(const swiss_table_t *table);
@@ -0,0 +1,255 @@
+#include "test.h"
+#include "command_executor.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Runs commands through command_executor_execute against a fresh storage,
+ * the way a session does after parsing a request, and checks the replies.
+ */
+
+#define MAX_ARGS 16
+
+static stats_t g_stats;
+static storage_t *g_storage;
+static auth_service_t *g_auth;
+static runtime_config_t *g_runtime;
+static command_executor_t *g_executor;
+
+static int setup(void) {
+    const storage_options_t options = {
+        .shards = STORAGE_DEFAULT_SHARDS,
+        .index = STORAGE_INDEX_CHAIN,
+        .eviction_samples = STORAGE_EVICTION_SAMPLES,
+        .policy = STORAGE_POLICY_NOEVICTION,
+        .expire_budget_us = STORAGE_EXPIRE_BUDGET_US,
+    };
+    if (stats_init(&g_stats, 0) != 0) {
+        return -1;
+    }
+    g_storage = storage_create(&options, &g_stats);
+    g_auth = auth_service_create("admin", "admin");
+    g_runtime = runtime_config_create(0, 1, 0);
+    if (!g_storage || !g_auth || !g_runtime) {
+        return -1;
+    }
+    g_executor = command_executor_create(g_storage, &g_stats, g_auth, g_runtime);
+    return g_executor ? 0 : -1;
+}
+
+static void teardown(void) {
+    command_executor_destroy(g_executor);
+    runtime_config_destroy(g_runtime);
+    auth_service_destroy(g_auth);
+    storage_destroy(g_storage);
+    stats_destroy(&g_stats);
+}
+
+/*
+ * Executes one command given as arguments; lens may be NULL for arguments
+ * that are C strings. The command goes through resp_parse like a request
+ * read from a socket.
+ */
+static resp_value_t *execute(const int argc, const char **argv, const size_t *lens) {
+    size_t arg_lens[MAX_ARGS];
+    size_t size = 32;
+    for (int i = 0; i < argc; i++) {
+        arg_lens[i] = lens ? lens[i] : strlen(argv[i]);
+        size += arg_lens[i] + 32;
+    }
+
+    char *request = malloc(size);
+    if (!request) {
+        return NULL;
+    }
+    size_t pos = (size_t) snprintf(request, size, "*%d\r\n", argc);
+    for (int i = 0; i < argc; i++) {
+        pos += (size_t) snprintf(request + pos, size - pos, "$%zu\r\n", arg_lens[i]);
+        memcpy(request + pos, argv[i], arg_lens[i]);
+        pos += arg_lens[i];
+        memcpy(request + pos, "\r\n", 2);
+        pos += 2;
+    }
+
+    size_t consumed;
+    resp_value_t *cmd = resp_parse(request, pos, &consumed);
+    free(request);
+    if (!cmd) {
+        return NULL;
+    }
+
+    int authenticated = 1;
+    resp_value_t *reply = command_executor_execute(g_executor, cmd, &authenticated);
+    resp_free(cmd);
+    return reply;
+}
+
+static int expect_bulk(resp_value_t *reply, const char *value, const size_t len) {
+    const int matches = reply && reply->type == RESP_BULK_STRING && reply->value_len == len &&
+                        memcmp(reply->data.str, value, len) == 0;
+    resp_free(reply);
+    CHECK(matches, "reply is not the expected %zu-byte bulk string", len);
+    return 0;
+}
+
+static int expect_simple(resp_value_t *reply, const char *text) {
+    const int matches = reply && reply->type == RESP_SIMPLE_STRING && strcmp(reply->data.str, text) == 0;
+    resp_free(reply);
+    CHECK(matches, "reply is not +%s", text);
+    return 0;
+}
+
+/*
+ * SET ... GET copies the old value out of the entry before replacing it, so
+ * the copy has to keep the bytes after a NUL.
+ */
+static int test_set_get_binary_old_value(void) {
+    const size_t len = 9 + 20000;
+    char *old = malloc(len);
+    CHECK(old, "out of memory");
+    memcpy(old, "AAAAAAAA\0", 9);
+    memset(old + 9, 'B', len - 9);
+
+    const char *set_argv[] = {"SET", "bk", old};
+    const size_t set_lens[] = {3, 2, len};
+    const char *get_argv[] = {"SET", "bk", "x", "GET"};
+
+    int result = expect_simple(execute(3, set_argv, set_lens), "OK");
+    if (result == 0) {
+        result = expect_bulk(execute(4, get_argv, NULL), old, len);
+    }
+    free(old);
+    return result;
+}
+
+/*
+ * Every byte value, NUL and CRLF included, comes back from GET and MGET.
+ */
+static int test_binary_value_round_trip(void) {
+    char value[256];
+    for (size_t i = 0; i < sizeof(value); i++) {
+        value[i] = (char) i;
+    }
+
+    const char *set_argv[] = {"SET", "binary", value};
+    const size_t set_lens[] = {3, 6, sizeof(value)};
+    const char *get_argv[] = {"GET", "binary"};
+    const char *mget_argv[] = {"MGET", "missing", "binary"};
+
+    if (expect_simple(execute(3, set_argv, set_lens), "OK") != 0 ||
+        expect_bulk(execute(2, get_argv, NULL), value, sizeof(value)) != 0) {
+        return -1;
+    }
+
+    resp_value_t *reply = execute(3, mget_argv, NULL);
+    CHECK(reply && reply->type == RESP_ARRAY && reply->data.array.count == 2, "MGET is not a 2-element array");
+    const int missing = reply->data.array.elements[0]->type == RESP_NULL;
+    resp_value_t *element = reply->data.array.elements[1];
+    const int intact = element->type == RESP_BULK_STRING && element->value_len == sizeof(value) &&
+                       memcmp(element->data.str, value, sizeof(value)) == 0;
+    resp_free(reply);
+    CHECK(missing && intact, "MGET did not return the binary value");
+    return 0;
+}
+
+static int expect_error(resp_value_t *reply) {
+    const int matches = reply && reply->type == RESP_ERROR;
+    resp_free(reply);
+    CHECK(matches, "reply is not an error");
+    return 0;
+}
+
+static int expect_integer(resp_value_t *reply, const int64_t min, const int64_t max) {
+    const int matches = reply && reply->type == RESP_INTEGER && reply->data.integer >= min &&
+                        reply->data.integer <= max;
+    const long long value = reply && reply->type == RESP_INTEGER ? (long long) reply->data.integer : -1;
+    resp_free(reply);
+    CHECK(matches, "reply %lld is not an integer in [%lld, %lld]", value, (long long) min, (long long) max);
+    return 0;
+}
+
+/*
+ * A deadline past kv_expiry_max() cannot be stored, so the TTL is refused
+ * instead of being cut short; one well before it is kept in whole seconds.
+ */
+static int test_ttl_limits(void) {
+    const char *set_huge[] = {"SET", "far", "v", "EX", "9223372036854775"};
+    const char *set_far[] = {"SET", "far", "v", "EX", "2000000"};
+    const char *pttl[] = {"PTTL", "far"};
+    const char *expire_huge[] = {"EXPIRE", "far", "9223372036854775"};
+    const char *pexpireat_huge[] = {"PEXPIREAT", "far", "9223372036854775807"};
+    const char *config_huge[] = {"CONFIG", "SET", "default-ttl", "9223372036854775"};
+
+    if (expect_error(execute(5, set_huge, NULL)) != 0 ||
+        expect_simple(execute(5, set_far, NULL), "OK") != 0 ||
+        expect_integer(execute(2, pttl, NULL), 2000000000 - 1000, 2000000000 + 999) != 0 ||
+        expect_error(execute(3, expire_huge, NULL)) != 0 ||
+        expect_error(execute(3, pexpireat_huge, NULL)) != 0 ||
+        expect_error(execute(4, config_huge, NULL)) != 0) {
+        return -1;
+    }
+    return expect_integer(execute(2, pttl, NULL), 2000000000 - 1000, 2000000000 + 999);
+}
+
+/*
+ * Batch commands count under their own names, not as GET and SET.
+ */
+static int test_batch_command_counters(void) {
+    const uint64_t get = g_stats.cmd_get, set = g_stats.cmd_set;
+    const uint64_t mget = g_stats.cmd_mget, mset = g_stats.cmd_mset, msetnx = g_stats.cmd_msetnx;
+
+    const char *mset_argv[] = {"MSET", "a", "1", "b", "2"};
+    const char *msetnx_argv[] = {"MSETNX", "c", "3"};
+    const char *mget_argv[] = {"MGET", "a", "b", "c"};
+    resp_free(execute(5, mset_argv, NULL));
+    resp_free(execute(3, msetnx_argv, NULL));
+    resp_free(execute(4, mget_argv, NULL));
+
+    CHECK(g_stats.cmd_mget == mget + 1 && g_stats.cmd_mset == mset + 1 && g_stats.cmd_msetnx == msetnx + 1,
+          "batch commands were not counted once each");
+    CHECK(g_stats.cmd_get == get && g_stats.cmd_set == set, "batch commands were counted as GET or SET");
+    return 0;
+}
+
+/*
+ * Integer arguments are parsed as strictly as stored integers, so " 5",
+ * "+5" and "5x" are refused everywhere instead of read as 5.
+ */
+static int test_integer_arguments_are_strict(void) {
+    const char *set_argv[] = {"SET", "counter", "10"};
+    if (expect_simple(execute(3, set_argv, NULL), "OK") != 0) {
+        return -1;
+    }
+
+    const char *bad[] = {" 5", "+5", "5x", "5 ", "05", ""};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        const char *incrby[] = {"INCRBY", "counter", bad[i]};
+        const char *set_ex[] = {"SET", "counter", "10", "EX", bad[i]};
+        const char *expire[] = {"EXPIRE", "counter", bad[i]};
+        if (expect_error(execute(3, incrby, NULL)) != 0 || expect_error(execute(5, set_ex, NULL)) != 0 ||
+            expect_error(execute(3, expire, NULL)) != 0) {
+            fprintf(stderr, "accepted \"%s\"\n", bad[i]);
+            return -1;
+        }
+    }
+
+    const char *incrby[] = {"INCRBY", "counter", "-5"};
+    return expect_integer(execute(3, incrby, NULL), 5, 5);
+}
+
+int main(void) {
+    if (setup() != 0) {
+        fprintf(stderr, "setup failed\n");
+        return EXIT_FAILURE;
+    }
+
+    int failures = 0;
+    RUN(test_set_get_binary_old_value());
+    RUN(test_binary_value_round_trip());
+    RUN(test_ttl_limits());
+    RUN(test_batch_command_counters());
+    RUN(test_integer_arguments_are_strict());
+
+    teardown();
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,200 @@
+#include "test.h"
+#include "epoch.h"
+#include "storage.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Epoch-based reclamation: a retired object is freed only once every
+ * thread that was inside an epoch when it was retired has left it, and
+ * lock-free readers of the storage never see an entry that was freed under
+ * them.
+ */
+
+#define READERS 3
+#define KEYS 64
+#define VALUE_LEN 200
+#define WRITES 200000
+#define COLLECT_ROUNDS 4
+
+static atomic_int g_freed;
+
+static void count_free(void *ptr) {
+    free(ptr);
+    atomic_fetch_add(&g_freed, 1);
+}
+
+typedef struct {
+    atomic_int entered;
+    atomic_int leave;
+    atomic_int left;
+} pinned_reader_t;
+
+static void *pin_epoch(void *arg) {
+    pinned_reader_t *reader = arg;
+    epoch_enter();
+    epoch_enter();
+    atomic_store(&reader->entered, 1);
+    while (!atomic_load(&reader->leave)) {
+        sched_yield();
+    }
+    epoch_exit();
+    atomic_store(&reader->left, 1);
+    while (atomic_load(&reader->leave) < 2) {
+        sched_yield();
+    }
+    epoch_exit();
+    atomic_store(&reader->left, 2);
+    return NULL;
+}
+
+static void collect(void) {
+    for (int i = 0; i < COLLECT_ROUNDS; i++) {
+        epoch_collect();
+    }
+}
+
+/*
+ * The reader enters twice; the object stays allocated until its outer
+ * exit, however often the epoch is collected meanwhile.
+ */
+static int test_retired_object_waits_for_reader(void) {
+    pinned_reader_t reader = {0};
+    pthread_t thread;
+    CHECK(pthread_create(&thread, NULL, pin_epoch, &reader) == 0, "pthread_create failed");
+    while (!atomic_load(&reader.entered)) {
+        sched_yield();
+    }
+
+    atomic_store(&g_freed, 0);
+    epoch_retire(malloc(16), count_free);
+    collect();
+    const int freed_while_pinned = atomic_load(&g_freed);
+
+    atomic_store(&reader.leave, 1);
+    while (atomic_load(&reader.left) < 1) {
+        sched_yield();
+    }
+    collect();
+    const int freed_while_nested = atomic_load(&g_freed);
+
+    atomic_store(&reader.leave, 2);
+    pthread_join(thread, NULL);
+    collect();
+    const int freed_after = atomic_load(&g_freed);
+
+    CHECK(freed_while_pinned == 0 && freed_while_nested == 0, "freed while a reader was inside its epoch");
+    CHECK(freed_after == 1, "not freed after the reader left");
+    CHECK(epoch_pending() == 0, "%zu objects still pending", epoch_pending());
+    return 0;
+}
+
+typedef struct {
+    storage_t *storage;
+    atomic_int *stop;
+    size_t reads;
+    int torn;
+} storage_reader_t;
+
+/*
+ * Every value is one byte repeated, and each write picks a new byte: an
+ * entry freed and reused under a reader would show up as a mixed value.
+ */
+static int value_is_whole(const char *value, const size_t len) {
+    if (len != VALUE_LEN) {
+        return 0;
+    }
+    for (size_t i = 1; i < len; i++) {
+        if (value[i] != value[0]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void *read_values(void *arg) {
+    storage_reader_t *reader = arg;
+    char key[16];
+    for (size_t n = 0; !atomic_load_explicit(reader->stop, memory_order_relaxed); n++) {
+        const size_t key_len = (size_t) snprintf(key, sizeof(key), "key:%zu", n % KEYS);
+        kv_entry_t *entry = storage_acquire(reader->storage, key, key_len);
+        if (entry) {
+            reader->torn |= !value_is_whole(kv_entry_value(entry), entry->value_len);
+            kv_entry_release(entry);
+            reader->reads++;
+        }
+    }
+    return NULL;
+}
+
+static int test_lockfree_readers_during_writes(void) {
+    const storage_options_t options = {
+        .shards = STORAGE_DEFAULT_SHARDS,
+        .lockfree_reads = 1,
+        .index = STORAGE_INDEX_CHAIN,
+        .eviction_samples = STORAGE_EVICTION_SAMPLES,
+        .policy = STORAGE_POLICY_NOEVICTION,
+        .expire_budget_us = STORAGE_EXPIRE_BUDGET_US,
+    };
+    storage_t *storage = storage_create(&options, NULL);
+    CHECK(storage, "storage_create failed");
+
+    char key[16];
+    char value[VALUE_LEN];
+    int failed = 0;
+    for (size_t n = 0; n < KEYS; n++) {
+        memset(value, 'a', sizeof(value));
+        failed |= storage_set(storage, key, (size_t) snprintf(key, sizeof(key), "key:%zu", n), value,
+                              sizeof(value), 0) != 0;
+    }
+
+    atomic_int stop = 0;
+    pthread_t threads[READERS];
+    storage_reader_t readers[READERS];
+    int started = 0;
+    for (; started < READERS; started++) {
+        readers[started] = (storage_reader_t) {storage, &stop, 0, 0};
+        if (pthread_create(&threads[started], NULL, read_values, &readers[started]) != 0) {
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < WRITES && !failed; i++) {
+        const size_t n = i % KEYS;
+        memset(value, 'a' + (int) (i / KEYS % 26), sizeof(value));
+        if (i % 7 == 0) {
+            failed |= storage_del(storage, key, (size_t) snprintf(key, sizeof(key), "key:%zu", n)) != 1;
+        }
+        failed |= storage_set(storage, key, (size_t) snprintf(key, sizeof(key), "key:%zu", n), value,
+                              sizeof(value), 0) != 0;
+    }
+
+    atomic_store(&stop, 1);
+    size_t reads = 0;
+    int torn = 0;
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        reads += readers[i].reads;
+        torn |= readers[i].torn;
+    }
+    storage_rehash_for(storage, 0);
+    collect();
+    const size_t pending = epoch_pending();
+    storage_destroy(storage);
+
+    CHECK(started == READERS && !failed, "setup or writes failed");
+    CHECK(reads > 0, "the readers read nothing");
+    CHECK(!torn, "a reader saw an entry that was freed under it");
+    CHECK(pending == 0, "%zu replaced entries were never freed", pending);
+    return 0;
+}
+
+int main(void) {
+    int failures = 0;
+    RUN(test_retired_object_waits_for_reader());
+    RUN(test_lockfree_readers_during_writes());
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
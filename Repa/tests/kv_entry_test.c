@@ -0,0 +1,141 @@
+#include "test.h"
+#include "kv_entry.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The 32-bit deadline packing: exact to the millisecond up to
+ * KV_EXPIRY_NEAR_MS ahead, whole seconds rounded up beyond it, clamped at
+ * kv_expiry_max(). Deadlines are placed a second away from each boundary so
+ * the clock moving during the test cannot carry them across.
+ */
+
+#define MARGIN_MS 1000
+
+static kv_entry_t *entry_with_deadline(const uint64_t expires_at) {
+    return kv_entry_create("key", 3, "value", 5, expires_at);
+}
+
+static int test_near_deadline_is_exact(void) {
+    const uint64_t deadlines[] = {
+        kv_expiry_clock() + 1234,
+        kv_expiry_clock() + KV_EXPIRY_NEAR_MS - MARGIN_MS - 1,
+    };
+
+    for (size_t i = 0; i < sizeof(deadlines) / sizeof(deadlines[0]); i++) {
+        kv_entry_t *entry = entry_with_deadline(deadlines[i]);
+        CHECK(entry, "out of memory");
+        const uint64_t decoded = kv_entry_expires_at(entry);
+        const int matches = kv_entry_has_deadline(entry, decoded);
+        kv_entry_free(entry);
+        CHECK(decoded == deadlines[i], "near deadline %zu decoded %llu ms off", i,
+              (unsigned long long) (decoded - deadlines[i]));
+        CHECK(matches, "near entry does not hold its own deadline");
+    }
+    return 0;
+}
+
+static int test_far_deadline_rounds_up_to_a_second(void) {
+    const uint64_t deadline = kv_expiry_clock() + KV_EXPIRY_NEAR_MS + MARGIN_MS + 1;
+    kv_entry_t *entry = entry_with_deadline(deadline);
+    CHECK(entry, "out of memory");
+    const uint64_t decoded = kv_entry_expires_at(entry);
+    const int matches = kv_entry_has_deadline(entry, decoded);
+    const int other = kv_entry_has_deadline(entry, decoded + 1000);
+    kv_entry_free(entry);
+
+    CHECK(decoded >= deadline && decoded - deadline < 1000, "far deadline decoded %lld ms off",
+          (long long) (decoded - deadline));
+    CHECK(decoded % 1000 == 0, "far deadline is not a whole second");
+    CHECK(matches && !other, "far entry does not match exactly its own deadline");
+    return 0;
+}
+
+static int test_deadline_is_clamped_at_the_limit(void) {
+    const uint64_t max = kv_expiry_max();
+    CHECK(max > kv_expiry_clock() + 60ull * 365 * 24 * 3600 * 1000, "the limit is less than 60 years away");
+
+    kv_entry_t *at_limit = entry_with_deadline(max);
+    kv_entry_t *beyond = entry_with_deadline(UINT64_MAX / 2);
+    CHECK(at_limit && beyond, "out of memory");
+    const uint64_t limit_decoded = kv_entry_expires_at(at_limit);
+    const uint64_t beyond_decoded = kv_entry_expires_at(beyond);
+    kv_entry_free(at_limit);
+    kv_entry_free(beyond);
+
+    CHECK(limit_decoded == max, "the limit itself does not round-trip");
+    CHECK(beyond_decoded == max, "a later deadline is not clamped to the limit");
+    return 0;
+}
+
+static int test_past_deadline(void) {
+    const uint64_t recent = kv_expiry_clock() - MARGIN_MS;
+    kv_entry_t *entry = entry_with_deadline(recent);
+    CHECK(entry, "out of memory");
+    const uint64_t decoded = kv_entry_expires_at(entry);
+    const int expired = kv_entry_is_expired(entry);
+    kv_entry_free(entry);
+    CHECK(decoded == recent && expired, "a deadline a second ago is not exact and expired");
+
+    entry = entry_with_deadline(kv_expiry_clock() - KV_EXPIRY_NEAR_MS);
+    CHECK(entry, "out of memory");
+    const int long_expired = kv_entry_is_expired(entry);
+    kv_entry_free(entry);
+    CHECK(long_expired, "a deadline ~12 days ago is not expired");
+    return 0;
+}
+
+/*
+ * The expiry heap matches a node by the stored word: a near deadline keeps
+ * matching the value it was decoded as, and no other.
+ */
+static int test_has_deadline(void) {
+    const uint64_t deadline = kv_expiry_clock() + 5000;
+    kv_entry_t *entry = entry_with_deadline(deadline);
+    kv_entry_t *persistent = entry_with_deadline(0);
+    CHECK(entry && persistent, "out of memory");
+
+    const int same = kv_entry_has_deadline(entry, deadline);
+    const int later = kv_entry_has_deadline(entry, deadline + 1);
+    const int none = kv_entry_has_deadline(entry, 0);
+    const int persistent_none = kv_entry_has_deadline(persistent, 0);
+    const int persistent_some = kv_entry_has_deadline(persistent, deadline);
+    kv_entry_free(entry);
+    kv_entry_free(persistent);
+
+    CHECK(same && !later && !none, "near entry matches the wrong deadlines");
+    CHECK(persistent_none && !persistent_some, "entry without a deadline matches the wrong deadlines");
+    return 0;
+}
+
+/*
+ * Replies for 0..KV_SHARED_INTS-1 come from one shared table: the same
+ * pointer every time, with the decimal text of the number.
+ */
+static int test_shared_int_text(void) {
+    size_t len = 0, again_len = 0, outside_len = 0;
+    const char *text = kv_shared_int_text(4096, &len);
+    const char *again = kv_shared_int_text(4096, &again_len);
+    const char *last = kv_shared_int_text(KV_SHARED_INTS - 1, &outside_len);
+
+    CHECK(text && text == again && len == 4 && again_len == 4 && memcmp(text, "4096", 4) == 0,
+          "4096 is not shared as its text");
+    char expected[KV_INT_TEXT_SIZE];
+    const size_t expected_len = (size_t) snprintf(expected, sizeof(expected), "%d", KV_SHARED_INTS - 1);
+    CHECK(last && outside_len == expected_len && memcmp(last, expected, expected_len) == 0,
+          "the last shared number is not %s", expected);
+    CHECK(!kv_shared_int_text(KV_SHARED_INTS, &outside_len) && !kv_shared_int_text(-1, &outside_len),
+          "a number outside the table is shared");
+    return 0;
+}
+
+int main(void) {
+    int failures = 0;
+    RUN(test_near_deadline_is_exact());
+    RUN(test_far_deadline_rounds_up_to_a_second());
+    RUN(test_deadline_is_clamped_at_the_limit());
+    RUN(test_past_deadline());
+    RUN(test_has_deadline());
+    RUN(test_shared_int_text());
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
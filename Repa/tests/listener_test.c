@@ -0,0 +1,294 @@
+#include "test.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+/*
+ * Runs the server binary given as argv[1] with each I/O backend and talks
+ * RESP to it over TCP: values larger than the initial read buffer must go in
+ * and come back intact, and a request above max_request_mb must be answered
+ * with an error instead of stalling the connection.
+ */
+
+#define LARGE_VALUE (64 * 1024)
+#define PIPELINED 16
+#define MAX_REQUEST_MB 1
+
+static int free_port(void) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+        getsockname(fd, (struct sockaddr *) &addr, &len) != 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+static pid_t start_server(const char *binary, const char *config_path) {
+    const pid_t pid = fork();
+    if (pid == 0) {
+        const int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+        }
+        execl(binary, binary, "--config", config_path, (char *) NULL);
+        _exit(127);
+    }
+    return pid;
+}
+
+static void stop_server(const pid_t pid) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+static int connect_server(const int port) {
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons((uint16_t) port),
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    for (int attempt = 0; attempt < 100; attempt++) {
+        const int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+            const struct timeval timeout = {.tv_sec = 10};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            return fd;
+        }
+        close(fd);
+        const struct timespec pause = {.tv_nsec = 50 * 1000 * 1000};
+        nanosleep(&pause, NULL);
+    }
+    return -1;
+}
+
+static int send_all(const int fd, const char *data, size_t len) {
+    while (len > 0) {
+        const ssize_t written = send(fd, data, len, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return -1;
+        }
+        data += written;
+        len -= (size_t) written;
+    }
+    return 0;
+}
+
+static int recv_exact(const int fd, char *data, size_t len) {
+    while (len > 0) {
+        const ssize_t got = recv(fd, data, len, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return -1;
+        }
+        data += got;
+        len -= (size_t) got;
+    }
+    return 0;
+}
+
+/*
+ * Formats a command as a RESP array of bulk strings into a malloc'd buffer.
+ */
+static char *format_command(size_t *out_len, const int argc, const char **argv, const size_t *lens) {
+    size_t size = 32;
+    for (int i = 0; i < argc; i++) {
+        size += lens[i] + 32;
+    }
+    char *buffer = malloc(size);
+    if (!buffer) {
+        return NULL;
+    }
+
+    size_t pos = (size_t) snprintf(buffer, size, "*%d\r\n", argc);
+    for (int i = 0; i < argc; i++) {
+        pos += (size_t) snprintf(buffer + pos, size - pos, "$%zu\r\n", lens[i]);
+        memcpy(buffer + pos, argv[i], lens[i]);
+        pos += lens[i];
+        memcpy(buffer + pos, "\r\n", 2);
+        pos += 2;
+    }
+    *out_len = pos;
+    return buffer;
+}
+
+static int send_command(const int fd, const int argc, const char **argv, const size_t *lens) {
+    size_t len;
+    char *command = format_command(&len, argc, argv, lens);
+    if (!command) {
+        return -1;
+    }
+    const int result = send_all(fd, command, len);
+    free(command);
+    return result;
+}
+
+static int expect_reply(const int fd, const char *expected) {
+    const size_t len = strlen(expected);
+    char reply[256];
+    CHECK(len < sizeof(reply), "expected reply too long");
+    CHECK(recv_exact(fd, reply, len) == 0, "no reply, expected %s", expected);
+    reply[len] = '\0';
+    CHECK(strcmp(reply, expected) == 0, "got '%s', expected '%s'", reply, expected);
+    return 0;
+}
+
+static int expect_bulk(const int fd, const char *value, const size_t value_len, char *scratch) {
+    char header[32];
+    const int header_len = snprintf(header, sizeof(header), "$%zu\r\n", value_len);
+    CHECK(recv_exact(fd, scratch, (size_t) header_len) == 0, "no bulk header");
+    CHECK(memcmp(scratch, header, (size_t) header_len) == 0, "bad bulk header");
+    CHECK(recv_exact(fd, scratch, value_len + 2) == 0, "bulk value cut short");
+    CHECK(memcmp(scratch, value, value_len) == 0, "bulk value corrupted");
+    CHECK(memcmp(scratch + value_len, "\r\n", 2) == 0, "bulk value not terminated");
+    return 0;
+}
+
+static int authenticate(const int fd) {
+    const char *argv[] = {"AUTH", "admin", "admin"};
+    const size_t lens[] = {4, 5, 5};
+    CHECK(send_command(fd, 3, argv, lens) == 0, "AUTH not sent");
+    return expect_reply(fd, "+OK\r\n");
+}
+
+static int test_large_value(const int port, char *value, char *scratch) {
+    const int fd = connect_server(port);
+    CHECK(fd >= 0, "cannot connect to port %d", port);
+    if (authenticate(fd) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    const char *set_argv[] = {"SET", "large", value};
+    const size_t set_lens[] = {3, 5, LARGE_VALUE};
+    const char *get_argv[] = {"GET", "large"};
+    const size_t get_lens[] = {3, 5};
+
+    int result = send_command(fd, 3, set_argv, set_lens) == 0 ? expect_reply(fd, "+OK\r\n") : -1;
+    if (result == 0) {
+        result = send_command(fd, 2, get_argv, get_lens) == 0 ? expect_bulk(fd, value, LARGE_VALUE, scratch) : -1;
+    }
+
+    /* A pipeline of large SETs and GETs arrives split across many reads. */
+    for (int i = 0; result == 0 && i < PIPELINED; i++) {
+        value[0] = (char) ('a' + i);
+        result = send_command(fd, 3, set_argv, set_lens) | send_command(fd, 2, get_argv, get_lens);
+    }
+    for (int i = 0; result == 0 && i < PIPELINED; i++) {
+        value[0] = (char) ('a' + i);
+        result = expect_reply(fd, "+OK\r\n");
+        if (result == 0) {
+            result = expect_bulk(fd, value, LARGE_VALUE, scratch);
+        }
+    }
+
+    close(fd);
+    CHECK(result == 0, "large SET/GET failed");
+    return 0;
+}
+
+static int test_oversized_request(const int port, char *scratch) {
+    const int fd = connect_server(port);
+    CHECK(fd >= 0, "cannot connect to port %d", port);
+    if (authenticate(fd) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    const size_t value_len = (size_t) MAX_REQUEST_MB * 1024 * 1024;
+    char *value = calloc(1, value_len);
+    if (!value) {
+        close(fd);
+        return -1;
+    }
+    const char *argv[] = {"SET", "oversized", value};
+    const size_t lens[] = {3, 9, value_len};
+    send_command(fd, 3, argv, lens);
+    free(value);
+
+    const int result = expect_reply(fd, "-ERR request exceeds max_request_mb\r\n");
+    const int closed = recv(fd, scratch, 1, 0) <= 0;
+    close(fd);
+    CHECK(result == 0, "oversized request not rejected");
+    CHECK(closed, "connection left open after an oversized request");
+    return 0;
+}
+
+static int run_backend(const char *binary, const char *backend, char *value, char *scratch) {
+    const int port = free_port();
+    CHECK(port > 0, "no free port");
+
+    char config_path[] = "/tmp/repa_listener_test_XXXXXX";
+    const int config_fd = mkstemp(config_path);
+    CHECK(config_fd >= 0, "cannot create config file");
+    FILE *config = fdopen(config_fd, "w");
+    CHECK(config, "cannot open config file");
+    fprintf(config, "port = %d\nworkers = 2\nio_backend = %s\nmax_request_mb = %d\n"
+                    "log_output = %s.log\n", port, backend, MAX_REQUEST_MB, config_path);
+    fclose(config);
+
+    const pid_t pid = start_server(binary, config_path);
+    int result = pid > 0 ? 0 : -1;
+    if (result == 0) {
+        result = test_large_value(port, value, scratch);
+    }
+    if (result == 0) {
+        result = test_oversized_request(port, scratch);
+    }
+    if (pid > 0) {
+        stop_server(pid);
+    }
+
+    char log_path[sizeof(config_path) + 4];
+    snprintf(log_path, sizeof(log_path), "%s.log", config_path);
+    unlink(log_path);
+    unlink(config_path);
+
+    CHECK(result == 0, "%s backend failed", backend);
+    printf("%s: ok\n", backend);
+    return 0;
+}
+
+int main(const int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <path to repa>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    char *value = malloc(LARGE_VALUE);
+    char *scratch = malloc(LARGE_VALUE + 64);
+    if (!value || !scratch) {
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < LARGE_VALUE; i++) {
+        value[i] = (char) ('0' + i % 64);
+    }
+
+    int result = run_backend(argv[1], "epoll", value, scratch);
+    if (result == 0) {
+        result = run_backend(argv[1], "io_uring", value, scratch);
+    }
+
+    free(value);
+    free(scratch);
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
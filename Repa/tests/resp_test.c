@@ -0,0 +1,94 @@
+#include "test.h"
+#include "resp.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Bulk strings are binary: every byte, NUL and CRLF included, has to survive
+ * the constructors, resp_serialize and resp_parse.
+ */
+
+#define BINARY_LEN 1024
+
+static void fill_binary(char *value, const size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        value[i] = (char) (i * 7 % 256);
+    }
+    memcpy(value + 100, "\r\n\0\r\n", 5);
+}
+
+static resp_value_t *round_trip(const resp_value_t *value) {
+    char *output;
+    size_t output_len;
+    if (resp_serialize(value, &output, &output_len) != 0) {
+        return NULL;
+    }
+    size_t consumed = 0;
+    resp_value_t *parsed = resp_parse(output, output_len, &consumed);
+    if (parsed && consumed != output_len) {
+        resp_free(parsed);
+        parsed = NULL;
+    }
+    free(output);
+    return parsed;
+}
+
+static int test_bulk_string_copies_every_byte(void) {
+    char value[BINARY_LEN];
+    fill_binary(value, sizeof(value));
+
+    resp_value_t *bulk = resp_create_bulk_string(value, sizeof(value));
+    CHECK(bulk && bulk->type == RESP_BULK_STRING, "no bulk string");
+    const int copied = bulk->value_len == sizeof(value) && memcmp(bulk->data.str, value, sizeof(value)) == 0 &&
+                       bulk->data.str[sizeof(value)] == '\0';
+    resp_free(bulk);
+    CHECK(copied, "bulk string lost bytes after a NUL");
+    return 0;
+}
+
+static int test_bulk_string_round_trip(void) {
+    char value[BINARY_LEN];
+    fill_binary(value, sizeof(value));
+
+    resp_value_t *bulk = resp_create_bulk_string(value, sizeof(value));
+    CHECK(bulk, "no bulk string");
+    resp_value_t *parsed = round_trip(bulk);
+    resp_free(bulk);
+
+    const int intact = parsed && parsed->type == RESP_BULK_STRING && parsed->value_len == sizeof(value) &&
+                       memcmp(parsed->data.str, value, sizeof(value)) == 0;
+    resp_free(parsed);
+    CHECK(intact, "bulk string changed on the way through serialize and parse");
+    return 0;
+}
+
+static int test_array_round_trip(void) {
+    char value[BINARY_LEN];
+    fill_binary(value, sizeof(value));
+
+    resp_value_t *array = resp_create_array(3);
+    CHECK(array, "no array");
+    resp_array_set(array, 0, resp_create_bulk_string(value, sizeof(value)));
+    resp_array_set(array, 1, resp_create_bulk_string("", 0));
+    resp_array_set(array, 2, resp_create_bulk_string("\0", 1));
+    resp_value_t *parsed = round_trip(array);
+    resp_free(array);
+
+    const int intact = parsed && parsed->type == RESP_ARRAY && parsed->data.array.count == 3 &&
+                       parsed->data.array.elements[0]->value_len == sizeof(value) &&
+                       memcmp(parsed->data.array.elements[0]->data.str, value, sizeof(value)) == 0 &&
+                       parsed->data.array.elements[1]->value_len == 0 &&
+                       parsed->data.array.elements[2]->value_len == 1 &&
+                       parsed->data.array.elements[2]->data.str[0] == '\0';
+    resp_free(parsed);
+    CHECK(intact, "array elements changed on the way through serialize and parse");
+    return 0;
+}
+
+int main(void) {
+    int failures = 0;
+    RUN(test_bulk_string_copies_every_byte());
+    RUN(test_bulk_string_round_trip());
+    RUN(test_array_round_trip());
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
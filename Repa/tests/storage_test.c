@@ -0,0 +1,931 @@
+#include "test.h"
+#include "storage.h"
+#include "swiss_table.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Storage behaviour through its public functions. Where a behaviour only
+ * shows in the layout of a shard (table sizes, rehash progress) the test
+ * looks at the fields storage.h exposes.
+ */
+
+#define KEY_SIZE 32
+#define REHASH_BUDGET_US 100000
+#define REHASH_ROUNDS 1000
+#define THREADS 4
+
+static storage_t *create_storage(const size_t shards, const storage_index_t index, const storage_policy_t policy) {
+    const storage_options_t options = {
+        .shards = shards,
+        .index = index,
+        .eviction_samples = STORAGE_EVICTION_SAMPLES,
+        .policy = policy,
+        .expire_budget_us = STORAGE_EXPIRE_BUDGET_US,
+    };
+    return storage_create(&options, NULL);
+}
+
+static size_t format_key(char *key, const size_t n) {
+    return (size_t) snprintf(key, KEY_SIZE, "key:%zu", n);
+}
+
+static int set_key(storage_t *storage, const size_t n) {
+    char key[KEY_SIZE];
+    const size_t len = format_key(key, n);
+    return storage_set(storage, key, len, key, len, 0);
+}
+
+static int del_key(storage_t *storage, const size_t n) {
+    char key[KEY_SIZE];
+    return storage_del(storage, key, format_key(key, n));
+}
+
+/*
+ * Whether key n reads back with its own name as the value.
+ */
+static int has_key(storage_t *storage, const size_t n) {
+    char key[KEY_SIZE];
+    const size_t len = format_key(key, n);
+    size_t value_len = 0;
+    char *value = storage_get(storage, key, len, &value_len);
+    const int found = value && value_len == len && memcmp(value, key, len) == 0;
+    free(value);
+    return found;
+}
+
+/*
+ * Keys first..last-1 all read back, or none of them does.
+ */
+static int check_keys(storage_t *storage, const size_t first, const size_t last, const int present) {
+    for (size_t n = first; n < last; n++) {
+        CHECK(has_key(storage, n) == present, "key:%zu is %s", n, present ? "missing" : "still there");
+    }
+    return 0;
+}
+
+static void wait_ms(const long ms) {
+    const struct timespec pause = {ms / 1000, ms % 1000 * 1000000L};
+    nanosleep(&pause, NULL);
+}
+
+static int finish_rehash(storage_t *storage) {
+    for (int round = 0; round < REHASH_ROUNDS; round++) {
+        if (!storage_rehash_for(storage, REHASH_BUDGET_US)) {
+            return 0;
+        }
+    }
+    CHECK(0, "rehashing did not finish");
+}
+
+/*
+ * One shard grows well past STORAGE_DEFAULT_SIZE buckets and shrinks again
+ * once most keys are gone, while every key stays readable between the
+ * steps of the move.
+ */
+static int test_rehash_grows_and_shrinks(void) {
+    const size_t count = 8 * STORAGE_DEFAULT_SIZE;
+    const size_t kept = 100;
+    storage_t *storage = create_storage(1, STORAGE_INDEX_CHAIN, STORAGE_POLICY_NOEVICTION);
+    CHECK(storage, "storage_create failed");
+    const storage_shard_t *shard = &storage->shards[0];
+
+    int result = 0;
+    int moved_while_growing = 0;
+    for (size_t n = 0; n < count && result == 0; n++) {
+        result = set_key(storage, n) == 0 ? 0 : -1;
+        if (n % 512 == 511) {
+            moved_while_growing |= shard->rehash_index > 0;
+            result |= check_keys(storage, 0, n + 1, 1);
+        }
+    }
+    result |= finish_rehash(storage);
+    const size_t grown = shard->tables[0].size;
+
+    int moved_while_shrinking = 0;
+    for (size_t n = kept; n < count && result == 0; n++) {
+        result = del_key(storage, n) == 1 ? 0 : -1;
+        if (n % 512 == 511) {
+            moved_while_shrinking |= shard->rehash_index > 0;
+            result |= check_keys(storage, 0, kept, 1);
+        }
+    }
+    result |= finish_rehash(storage);
+    const size_t shrunk = shard->tables[0].size;
+
+    if (result == 0) {
+        result = check_keys(storage, 0, kept, 1) | check_keys(storage, kept, count, 0);
+    }
+    const size_t keys = storage_get_count(storage);
+    storage_destroy(storage);
+
+    CHECK(result == 0, "keys were lost while rehashing");
+    CHECK(grown >= count, "the table grew to %zu buckets for %zu keys", grown, count);
+    CHECK(shrunk <= grown / 8, "the table only shrank from %zu to %zu buckets", grown, shrunk);
+    CHECK(moved_while_growing && moved_while_shrinking, "no check ran in the middle of a rehash");
+    CHECK(keys == kept, "storage counts %zu keys, not %zu", keys, kept);
+    return 0;
+}
+
+static int test_shard_count_must_be_a_power_of_two(void) {
+    storage_t *three = create_storage(3, STORAGE_INDEX_CHAIN, STORAGE_POLICY_NOEVICTION);
+    storage_t *none = create_storage(0, STORAGE_INDEX_CHAIN, STORAGE_POLICY_NOEVICTION);
+    storage_t *too_many = create_storage(2 * STORAGE_MAX_SHARDS, STORAGE_INDEX_CHAIN, STORAGE_POLICY_NOEVICTION);
+    storage_destroy(three);
+    storage_destroy(none);
+    storage_destroy(too_many);
+    CHECK(!three && !none && !too_many, "an invalid shard count was accepted");
+    return 0;
+}
+
+/*
+ * The shard comes from the key hash, so sequential keys land in every
+ * shard in roughly equal numbers.
+ */
+static int test_keys_spread_over_shards(void) {
+    const size_t shards = STORAGE_DEFAULT_SHARDS;
+    const size_t count = 1024 * shards;
+    storage_t *storage = create_storage(shards, STORAGE_INDEX_CHAIN, STORAGE_POLICY_NOEVICTION);
+    CHECK(storage, "storage_create failed");
+
+    int result = 0;
+    for (size_t n = 0; n < count && result == 0; n++) {
+        result = set_key(storage, n);
+    }
+
+    size_t total = 0, fewest = SIZE_MAX, most = 0;
+    for (size_t i = 0; i < shards; i++) {
+        const size_t entries = storage->shards[i].entry_count;
+        total += entries;
+        fewest = entries < fewest ? entries : fewest;
+        most = entries > most ? entries : most;
+    }
+    const size_t keys = storage_get_count(storage);
+    storage_destroy(storage);
+
+    CHECK(result == 0, "storage_set failed");
+    CHECK(total == count && keys == count, "shards hold %zu keys and storage counts %zu, not %zu", total, keys,
+          count);
+    CHECK(fewest > count / shards / 2 && most < count / shards * 2, "shards hold between %zu and %zu keys",
+          fewest, most);
+    return 0;
+}
+
+typedef struct {
+    storage_t *storage;
+    size_t first;
+    size_t count;
+    int failed;
+} writer_t;
+
+/*
+ * Writes its own range of keys, deletes every other one and reads the
+ * rest back while the other writers do the same in other shards.
+ */
+static void *write_range(void *arg) {
+    writer_t *writer = arg;
+    for (size_t n = writer->first; n < writer->first + writer->count; n++) {
+        writer->failed |= set_key(writer->storage, n) != 0;
+    }
+    for (size_t n = writer->first; n < writer->first + writer->count; n += 2) {
+        writer->failed |= del_key(writer->storage, n) != 1;
+    }
+    for (size_t n = writer->first; n < writer->first + writer->count; n++) {
+        writer->failed |= has_key(writer->storage, n) != (int) ((n - writer->first) % 2);
+    }
+    return NULL;
+}
+
+static int test_concurrent_writers(void) {
+    const size_t per_thread = 20000;
+    storage_t *storage = create_storage(STORAGE_DEFAULT_SHARDS, STORAGE_INDEX_CHAIN, STORAGE_POLICY_NOEVICTION);
+    CHECK(storage, "storage_create failed");
+
+    pthread_t threads[THREADS];
+    writer_t writers[THREADS];
+    int started = 0;
+    for (; started < THREADS; started++) {
+        writers[started] = (writer_t) {storage, started * per_thread, per_thread, 0};
+        if (pthread_create(&threads[started], NULL, write_range, &writers[started]) != 0) {
+            break;
+        }
+    }
+
+    int failed = started < THREADS;
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        failed |= writers[i].failed;
+    }
+    const size_t keys = storage_get_count(storage);
+    storage_destroy(storage);
+
+    CHECK(!failed, "a writer lost or resurrected a key");
+    CHECK(keys == THREADS * per_thread / 2, "storage counts %zu keys, not %zu", keys, THREADS * per_thread / 2);
+    return 0;
+}
+
+/*
+ * The swiss index marks deleted slots with tombstones. With the table close
+ * to its load limit probes cross group boundaries, so keys placed past a
+ * tombstone must still be found. Churn on fresh keys reuses tombstones
+ * instead of growing the table, and a rebuild drops whatever is left.
+ */
+static int test_swiss_tombstones(void) {
+    const size_t count = STORAGE_DEFAULT_SIZE * 3 / 4;
+    storage_t *storage = create_storage(1, STORAGE_INDEX_SWISS, STORAGE_POLICY_NOEVICTION);
+    CHECK(storage, "storage_create failed");
+    const storage_shard_t *shard = &storage->shards[0];
+
+    int result = 0;
+    for (size_t n = 0; n < count && result == 0; n++) {
+        result = set_key(storage, n);
+    }
+    for (size_t n = 0; n < count && result == 0; n += 2) {
+        result = del_key(storage, n) == 1 ? 0 : -1;
+    }
+    const size_t tombstones = shard->swiss->tombstones;
+    for (size_t n = 0; n < count && result == 0; n++) {
+        result = has_key(storage, n) == (int) (n % 2) ? 0 : -1;
+    }
+    for (size_t n = 0; n < count && result == 0; n += 2) {
+        result = set_key(storage, n);
+    }
+    if (result == 0) {
+        result = check_keys(storage, 0, count, 1);
+    }
+
+    const size_t capacity = shard->swiss->capacity;
+    for (size_t n = count; n < count + 8 * capacity && result == 0; n++) {
+        result = set_key(storage, n) == 0 && del_key(storage, n) == 1 ? 0 : -1;
+    }
+    if (result == 0) {
+        result = check_keys(storage, 0, count, 1) | check_keys(storage, count, count + 8 * capacity, 0);
+    }
+    const size_t grown = shard->swiss->capacity;
+
+    const swiss_table_t *table = shard->swiss;
+    swiss_table_t *rebuilt = swiss_table_rebuild(table, table->capacity);
+    size_t found = 0;
+    for (size_t i = 0; rebuilt && i < table->capacity; i++) {
+        const kv_entry_t *entry = swiss_table_entry_at(table, i);
+        found += entry && swiss_table_find(rebuilt, kv_entry_key(entry), entry->key_len, table->slots[i].hash) == entry;
+    }
+    const size_t left = table->tombstones;
+    const size_t rebuilt_tombstones = rebuilt ? rebuilt->tombstones : SIZE_MAX;
+    swiss_table_destroy(rebuilt);
+    const size_t keys = storage_get_count(storage);
+    storage_destroy(storage);
+
+    CHECK(result == 0, "keys were lost or resurrected next to tombstones");
+    CHECK(tombstones == count / 2, "%zu tombstones after deleting %zu keys", tombstones, count / 2);
+    CHECK(grown == capacity, "churn grew the table from %zu to %zu slots", capacity, grown);
+    CHECK(left > 0 && rebuilt_tombstones == 0, "a rebuild kept %zu of %zu tombstones", rebuilt_tombstones, left);
+    CHECK(found == count, "the rebuilt table finds %zu of %zu keys", found, count);
+    CHECK(keys == count, "storage counts %zu keys, not %zu", keys, count);
+    return 0;
+}
+
+/*
+ * Eviction tests fill a shard, cap memory at what it uses and then add
+ * fresh keys, so that every further write has to evict one key first.
+ */
+#define EVICTION_KEYS 1000
+#define HOT_KEYS 100
+#define HOT_READS 50
+#define IDLE_SLEEP_MS 300
+
+static void cap_memory(storage_t *storage) {
+    storage_set_max_memory(storage, storage_get_memory(storage));
+}
+
+static void read_keys(storage_t *storage, const size_t first, const size_t last, const int times) {
+    for (int i = 0; i < times; i++) {
+        for (size_t n = first; n < last; n++) {
+            has_key(storage, n);
+        }
+    }
+}
+
+static size_t count_keys(storage_t *storage, const size_t first, const size_t last) {
+    size_t found = 0;
+    for (size_t n = first; n < last; n++) {
+        found += (size_t) has_key(storage, n);
+    }
+    return found;
+}
+
+/*
+ * Fills the shard, reads the first HOT_KEYS keys and writes as many fresh
+ * keys again. Under LRU the read keys are the most recent ones once the
+ * rest has idled for a few clock ticks; under LFU they are the frequent
+ * ones. Either way they all survive.
+ */
+static int test_recent_or_frequent_keys_survive(const storage_policy_t policy) {
+    storage_t *storage = create_storage(1, STORAGE_INDEX_CHAIN, policy);
+    CHECK(storage, "storage_create failed");
+
+    int result = 0;
+    for (size_t n = 0; n < EVICTION_KEYS && result == 0; n++) {
+        result = set_key(storage, n);
+    }
+    wait_ms(IDLE_SLEEP_MS);
+    read_keys(storage, 0, HOT_KEYS, policy == STORAGE_POLICY_ALLKEYS_LFU ? HOT_READS : 1);
+    cap_memory(storage);
+    for (size_t n = EVICTION_KEYS; n < EVICTION_KEYS + EVICTION_KEYS / 2 && result == 0; n++) {
+        result = set_key(storage, n);
+    }
+
+    const size_t hot = count_keys(storage, 0, HOT_KEYS);
+    const size_t keys = storage_get_count(storage);
+    storage_destroy(storage);
+
+    CHECK(result == 0, "storage_set failed while evicting");
+    CHECK(keys < EVICTION_KEYS + EVICTION_KEYS / 2, "nothing was evicted");
+    CHECK(hot == HOT_KEYS, "%s evicted %zu of %d hot keys", storage_policy_name(policy), HOT_KEYS - hot, HOT_KEYS);
+    return 0;
+}
+
+/*
+ * Half the keys have a TTL, the later the higher the key number. Writes
+ * evict those with the soonest deadlines first and never a key without a
+ * TTL, so they start failing once no key with a TTL is left.
+ */
+static int test_volatile_ttl_evicts_only_keys_with_a_ttl(void) {
+    storage_t *storage = create_storage(1, STORAGE_INDEX_CHAIN, STORAGE_POLICY_VOLATILE_TTL);
+    CHECK(storage, "storage_create failed");
+
+    const size_t volatile_keys = EVICTION_KEYS / 2;
+    int result = 0;
+    for (size_t n = 0; n < EVICTION_KEYS && result == 0; n++) {
+        char key[KEY_SIZE];
+        const size_t len = format_key(key, n);
+        const int64_t ttl_ms = n < volatile_keys ? 1000000 + (int64_t) n * 1000 : 0;
+        result = storage_set(storage, key, len, key, len, ttl_ms);
+    }
+    cap_memory(storage);
+
+    size_t n = EVICTION_KEYS;
+    for (; n < EVICTION_KEYS + volatile_keys / 2 && result == 0; n++) {
+        result = set_key(storage, n);
+    }
+    const size_t soonest = count_keys(storage, 0, volatile_keys / 2);
+    const size_t latest = count_keys(storage, volatile_keys / 2, volatile_keys);
+
+    size_t written = 0;
+    for (; n < EVICTION_KEYS + 2 * volatile_keys && set_key(storage, n) == 0; n++) {
+        written++;
+    }
+    const size_t remaining = count_keys(storage, 0, volatile_keys);
+    const size_t persistent = count_keys(storage, volatile_keys, EVICTION_KEYS);
+    storage_destroy(storage);
+
+    CHECK(result == 0, "a write failed while keys with a TTL were left");
+    CHECK(soonest < latest, "%zu of the soonest and %zu of the latest deadlines remain", soonest, latest);
+    CHECK(remaining == 0 && written < 2 * volatile_keys, "%zu writes left %zu keys with a TTL", written, remaining);
+    CHECK(persistent == EVICTION_KEYS - volatile_keys, "%zu keys without a TTL were evicted",
+          EVICTION_KEYS - volatile_keys - persistent);
+    return 0;
+}
+
+static int test_noeviction_rejects_writes(void) {
+    storage_t *storage = create_storage(1, STORAGE_INDEX_CHAIN, STORAGE_POLICY_NOEVICTION);
+    CHECK(storage, "storage_create failed");
+
+    int result = 0;
+    for (size_t n = 0; n < EVICTION_KEYS && result == 0; n++) {
+        result = set_key(storage, n);
+    }
+    cap_memory(storage);
+    const int rejected = set_key(storage, EVICTION_KEYS);
+    const int deleted = del_key(storage, 0);
+    const int after_delete = set_key(storage, EVICTION_KEYS);
+    const size_t kept = count_keys(storage, 1, EVICTION_KEYS + 1);
+    storage_destroy(storage);
+
+    CHECK(result == 0, "storage_set failed");
+    CHECK(rejected != 0, "a write over the limit was accepted");
+    CHECK(deleted == 1 && after_delete == 0, "a write did not fit after a delete made room");
+    CHECK(kept == EVICTION_KEYS, "%zu keys were lost", EVICTION_KEYS - kept);
+    return 0;
+}
+
+/*
+ * Frequently read keys followed by a long scan of keys written once. The
+ * scan flushes them out of an LRU cache, while W-TinyLFU admits scanned
+ * keys only over keys the frequency sketch has seen less often, so it can
+ * lose no more than the hot keys still in its admission window.
+ */
+static size_t hot_keys_after_scan(const storage_policy_t policy) {
+    storage_t *storage = create_storage(1, STORAGE_INDEX_CHAIN, policy);
+    if (!storage) {
+        return 0;
+    }
+
+    for (size_t n = 0; n < EVICTION_KEYS; n++) {
+        set_key(storage, n);
+    }
+    read_keys(storage, 0, EVICTION_KEYS, 4);
+    cap_memory(storage);
+    for (size_t n = EVICTION_KEYS; n < 6 * EVICTION_KEYS; n++) {
+        set_key(storage, n);
+    }
+
+    const size_t hot = count_keys(storage, 0, EVICTION_KEYS);
+    storage_destroy(storage);
+    return hot;
+}
+
+static int test_tinylfu_resists_a_scan(void) {
+    const size_t lru = hot_keys_after_scan(STORAGE_POLICY_ALLKEYS_LRU);
+    const size_t tinylfu = hot_keys_after_scan(STORAGE_POLICY_W_TINYLFU);
+    CHECK(lru < EVICTION_KEYS / 4, "LRU kept %zu of %d hot keys through the scan", lru, EVICTION_KEYS);
+    CHECK(tinylfu + STORAGE_TINYLFU_WINDOW >= EVICTION_KEYS, "W-TinyLFU kept only %zu of %d hot keys", tinylfu,
+          EVICTION_KEYS);
+    return 0;
+}
+
+#define EXPIRY_NODES 1000
+#define EXPIRY_TTL_MS 20
+#define EXPIRY_WAIT_MS 50
+
+static int keep_even(const expiry_node_t *node, void *ctx) {
+    (void) ctx;
+    return node->expires_at % 2 == 0;
+}
+
+static int pop_in_order(expiry_heap_t *heap, const size_t expected) {
+    uint64_t last = 0;
+    size_t popped = 0;
+    for (const expiry_node_t *node; (node = expiry_heap_peek(heap)) != NULL; popped++) {
+        CHECK(node->expires_at >= last, "deadline %llu popped after %llu", (unsigned long long) node->expires_at,
+              (unsigned long long) last);
+        last = node->expires_at;
+        expiry_heap_pop(heap);
+    }
+    CHECK(popped == expected, "popped %zu nodes, not %zu", popped, expected);
+    return 0;
+}
+
+/*
+ * Nodes come out of the heap earliest deadline first, and filtering it
+ * keeps that order.
+ */
+static int test_expiry_heap_order(void) {
+    expiry_heap_t heap;
+    expiry_heap_init(&heap);
+
+    int result = 0;
+    uint64_t x = 88172645463325252ull;
+    for (size_t i = 0; i < 2 * EXPIRY_NODES && result == 0; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        result = expiry_heap_push(&heap, NULL, i, x % 100000);
+    }
+    const size_t dropped = expiry_heap_retain(&heap, keep_even, NULL);
+    const size_t size = heap.size;
+    if (result == 0) {
+        result = pop_in_order(&heap, size);
+    }
+
+    for (size_t i = EXPIRY_NODES; i > 0 && result == 0; i--) {
+        result = expiry_heap_push(&heap, NULL, i, i);
+    }
+    if (result == 0) {
+        result = pop_in_order(&heap, EXPIRY_NODES);
+    }
+    expiry_heap_destroy(&heap);
+
+    CHECK(result == 0, "the heap lost its order");
+    CHECK(dropped + size == 2 * EXPIRY_NODES && size > 0 && dropped > 0, "retain dropped %zu nodes and kept %zu",
+          dropped, size);
+    return 0;
+}
+
+/*
+ * Active expiry removes due keys and nothing else. A key whose TTL was
+ * lifted or pushed back still has its old heap node, which must not take
+ * it down.
+ */
+static int test_cleanup_removes_only_due_keys(void) {
+    storage_t *storage = create_storage(4, STORAGE_INDEX_CHAIN, STORAGE_POLICY_NOEVICTION);
+    CHECK(storage, "storage_create failed");
+
+    int result = 0;
+    for (size_t n = 0; n < 4 * EXPIRY_NODES && result == 0; n++) {
+        char key[KEY_SIZE];
+        const size_t len = format_key(key, n);
+        const int64_t ttl_ms = n < 3 * EXPIRY_NODES ? EXPIRY_TTL_MS : (int64_t) EXPIRY_WAIT_MS * 100;
+        result = storage_set(storage, key, len, key, len, ttl_ms);
+    }
+    for (size_t n = EXPIRY_NODES; n < 2 * EXPIRY_NODES && result == 0; n++) {
+        result = set_key(storage, n);
+    }
+    for (size_t n = 2 * EXPIRY_NODES; n < 3 * EXPIRY_NODES && result == 0; n++) {
+        char key[KEY_SIZE];
+        result = storage_expire(storage, key, format_key(key, n), (int64_t) EXPIRY_WAIT_MS * 100) == 1 ? 0 : -1;
+    }
+    wait_ms(EXPIRY_WAIT_MS);
+
+    size_t removed = 0;
+    for (size_t cleaned; (cleaned = storage_cleanup_expired(storage)) > 0;) {
+        removed += cleaned;
+    }
+    const size_t keys = storage_get_count(storage);
+    if (result == 0) {
+        result = check_keys(storage, EXPIRY_NODES, 4 * EXPIRY_NODES, 1);
+    }
+    storage_destroy(storage);
+
+    CHECK(result == 0, "a key that was not due is gone");
+    CHECK(removed == EXPIRY_NODES, "active expiry removed %zu keys, not %d", removed, EXPIRY_NODES);
+    CHECK(keys == 3 * EXPIRY_NODES, "storage counts %zu keys, not %d", keys, 3 * EXPIRY_NODES);
+    return 0;
+}
+
+/*
+ * With the smallest budget one cycle stops after a few 64-key rounds and
+ * leaves the backlog to the following cycles, which clear it between them.
+ */
+static int test_cleanup_stops_at_its_budget(void) {
+    const size_t count = 100 * EXPIRY_NODES;
+    storage_t *storage = create_storage(4, STORAGE_INDEX_CHAIN, STORAGE_POLICY_NOEVICTION);
+    CHECK(storage, "storage_create failed");
+
+    const int below = storage_set_expire_budget(storage, STORAGE_MIN_EXPIRE_BUDGET_US - 1);
+    const int above = storage_set_expire_budget(storage, STORAGE_MAX_EXPIRE_BUDGET_US + 1);
+    const int smallest = storage_set_expire_budget(storage, STORAGE_MIN_EXPIRE_BUDGET_US);
+
+    int result = 0;
+    for (size_t n = 0; n < count && result == 0; n++) {
+        char key[KEY_SIZE];
+        const size_t len = format_key(key, n);
+        result = storage_set(storage, key, len, key, len, 1);
+    }
+    wait_ms(EXPIRY_WAIT_MS);
+
+    const size_t first = storage_cleanup_expired(storage);
+    size_t removed = first;
+    size_t cycles = 1;
+    for (size_t cleaned; (cleaned = storage_cleanup_expired(storage)) > 0; cycles++) {
+        removed += cleaned;
+    }
+    const size_t keys = storage_get_count(storage);
+    const long budget = storage_get_expire_budget(storage);
+    storage_destroy(storage);
+
+    CHECK(result == 0, "storage_set failed");
+    CHECK(below != 0 && above != 0 && smallest == 0 && budget == STORAGE_MIN_EXPIRE_BUDGET_US,
+          "budget limits not enforced, budget is %ld us", budget);
+    CHECK(first >= STORAGE_EXPIRE_BATCH && first < count, "the first cycle removed %zu of %zu keys", first, count);
+    CHECK(removed == count && keys == 0, "%zu cycles removed %zu of %zu keys, %zu left", cycles, removed, count,
+          keys);
+    return 0;
+}
+
+#define BATCH_KEYS 32
+#define BATCH_ROUNDS 2000
+
+typedef struct {
+    storage_t *storage;
+    atomic_int *stop;
+    int id;
+    int failed;
+} batch_worker_t;
+
+/*
+ * Writes the whole key set in one MSET, each round with its own value and
+ * in an order of its own, starting at a different key every round.
+ */
+static void *write_batches(void *arg) {
+    batch_worker_t *worker = arg;
+    char names[BATCH_KEYS][KEY_SIZE];
+    const char *keys[BATCH_KEYS];
+    size_t key_lens[BATCH_KEYS];
+    const char *values[BATCH_KEYS];
+    size_t value_lens[BATCH_KEYS];
+    char value[KEY_SIZE];
+
+    for (size_t round = 0; round < BATCH_ROUNDS; round++) {
+        const size_t value_len = (size_t) snprintf(value, sizeof(value), "v:%d:%zu", worker->id, round);
+        for (size_t i = 0; i < BATCH_KEYS; i++) {
+            const size_t n = worker->id % 2 ? (round + i) % BATCH_KEYS : (BATCH_KEYS + round - i) % BATCH_KEYS;
+            key_lens[i] = format_key(names[i], n);
+            keys[i] = names[i];
+            values[i] = value;
+            value_lens[i] = value_len;
+        }
+        worker->failed |= storage_mset(worker->storage, keys, key_lens, values, value_lens, BATCH_KEYS, 0) != 0;
+    }
+    return NULL;
+}
+
+/*
+ * Reads the key set in one MGET: a batch is visible whole or not at all,
+ * so every key carries the value of the same MSET.
+ */
+static void *read_batches(void *arg) {
+    batch_worker_t *worker = arg;
+    char names[BATCH_KEYS][KEY_SIZE];
+    const char *keys[BATCH_KEYS];
+    size_t key_lens[BATCH_KEYS];
+    for (size_t i = 0; i < BATCH_KEYS; i++) {
+        key_lens[i] = format_key(names[i], i);
+        keys[i] = names[i];
+    }
+
+    while (!atomic_load_explicit(worker->stop, memory_order_relaxed) && !worker->failed) {
+        kv_entry_t *entries[BATCH_KEYS];
+        if (storage_mget(worker->storage, keys, key_lens, BATCH_KEYS, entries) != 0) {
+            worker->failed = 1;
+            break;
+        }
+
+        char first[KV_INT_TEXT_SIZE];
+        size_t first_len = 0;
+        const char *expected = entries[0] ? kv_entry_text(entries[0], first, &first_len) : NULL;
+        for (size_t i = 0; i < BATCH_KEYS; i++) {
+            char buffer[KV_INT_TEXT_SIZE];
+            size_t len = 0;
+            const char *text = entries[i] ? kv_entry_text(entries[i], buffer, &len) : NULL;
+            worker->failed |= !text != !expected || (text && (len != first_len || memcmp(text, expected, len) != 0));
+        }
+        for (size_t i = 0; i < BATCH_KEYS; i++) {
+            kv_entry_release(entries[i]);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Overlapping batches written in opposite key orders: the shard locks are
+ * taken in one order whatever the key order, so the writers cannot
+ * deadlock, and a reader never sees two batches mixed.
+ */
+static int test_concurrent_mset_is_atomic(void) {
+    storage_t *storage = create_storage(STORAGE_DEFAULT_SHARDS, STORAGE_INDEX_CHAIN, STORAGE_POLICY_NOEVICTION);
+    CHECK(storage, "storage_create failed");
+
+    atomic_int stop = 0;
+    pthread_t threads[THREADS];
+    batch_worker_t workers[THREADS];
+    int started = 0;
+    for (; started < THREADS; started++) {
+        workers[started] = (batch_worker_t) {storage, &stop, started, 0};
+        if (pthread_create(&threads[started], NULL, started == 0 ? read_batches : write_batches,
+                           &workers[started]) != 0) {
+            break;
+        }
+    }
+
+    int failed = started < THREADS;
+    for (int i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        failed |= workers[i].failed;
+    }
+    atomic_store(&stop, 1);
+    int torn = 0;
+    if (started > 0) {
+        pthread_join(threads[0], NULL);
+        torn = workers[0].failed;
+    }
+    const size_t keys = storage_get_count(storage);
+    storage_destroy(storage);
+
+    CHECK(!failed, "MSET failed");
+    CHECK(!torn, "MGET saw keys from different MSET batches");
+    CHECK(keys == BATCH_KEYS, "storage counts %zu keys, not %d", keys, BATCH_KEYS);
+    return 0;
+}
+
+/*
+ * MSETNX writes nothing when one of its keys exists, even a key in a shard
+ * of its own, and everything otherwise.
+ */
+static int test_msetnx_is_all_or_nothing(void) {
+    storage_t *storage = create_storage(STORAGE_DEFAULT_SHARDS, STORAGE_INDEX_CHAIN, STORAGE_POLICY_NOEVICTION);
+    CHECK(storage, "storage_create failed");
+
+    char names[BATCH_KEYS][KEY_SIZE];
+    const char *keys[BATCH_KEYS];
+    size_t key_lens[BATCH_KEYS];
+    for (size_t i = 0; i < BATCH_KEYS; i++) {
+        key_lens[i] = format_key(names[i], i);
+        keys[i] = names[i];
+    }
+
+    const size_t existing = BATCH_KEYS - 1;
+    int result = set_key(storage, existing);
+    const int blocked = storage_mset(storage, keys, key_lens, keys, key_lens, BATCH_KEYS, STORAGE_SET_NX);
+    const size_t after_blocked = storage_get_count(storage);
+
+    result |= del_key(storage, existing) == 1 ? 0 : -1;
+    const int written = storage_mset(storage, keys, key_lens, keys, key_lens, BATCH_KEYS, STORAGE_SET_NX);
+    if (result == 0) {
+        result = check_keys(storage, 0, BATCH_KEYS, 1);
+    }
+    storage_destroy(storage);
+
+    CHECK(result == 0, "set, del or MSETNX lost a key");
+    CHECK(blocked == 1 && after_blocked == 1, "MSETNX returned %d and left %zu keys over an existing key", blocked,
+          after_blocked);
+    CHECK(written == 0, "MSETNX returned %d with no key existing", written);
+    return 0;
+}
+
+#define COUNTER_KEYS 4
+#define COUNTER_INCRS 20000
+
+static size_t count_encoded(const storage_t *storage, const uint8_t encoding) {
+    size_t keys = 0;
+    for (size_t i = 0; i < storage->shard_count; i++) {
+        keys += storage->shards[i].encoded_keys[encoding];
+    }
+    return keys;
+}
+
+/*
+ * Whether the key reads back as exactly the given text.
+ */
+static int reads_as(storage_t *storage, const char *key, const char *expected) {
+    size_t len = 0;
+    char *value = storage_get(storage, key, strlen(key), &len);
+    const int same = value && len == strlen(expected) && memcmp(value, expected, len) == 0;
+    free(value);
+    return same;
+}
+
+static int incr_reads_as(storage_t *storage, const char *key, const int64_t delta, const int64_t expected) {
+    char text[KV_INT_TEXT_SIZE];
+    snprintf(text, sizeof(text), "%lld", (long long) expected);
+    int64_t result = 0;
+    const int status = storage_incr(storage, key, strlen(key), delta, &result);
+    CHECK(status == 0 && result == expected, "INCRBY %lld gave %lld with status %d, not %s", (long long) delta,
+          (long long) result, status, text);
+    CHECK(reads_as(storage, key, text), "the counter does not read back as %s", text);
+    return 0;
+}
+
+/*
+ * A counter starts from 0, is stored as an integer in whatever width its
+ * value needs, keeps its TTL, and refuses to overflow or to count text.
+ */
+static int test_incr_keeps_an_int_encoded_counter(void) {
+    storage_t *storage = create_storage(STORAGE_DEFAULT_SHARDS, STORAGE_INDEX_CHAIN, STORAGE_POLICY_NOEVICTION);
+    CHECK(storage, "storage_create failed");
+
+    const int64_t steps[] = {5, 200, 40000, 3000000000, -6000000000, 6000000000};
+    int64_t expected = 0;
+    int result = 0;
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]) && result == 0; i++) {
+        expected += steps[i];
+        result = incr_reads_as(storage, "counter", steps[i], expected);
+    }
+    if (result == 0) {
+        result = incr_reads_as(storage, "counter", INT64_MAX - expected, INT64_MAX);
+    }
+    const size_t ints = count_encoded(storage, KV_ENCODING_INT);
+
+    int64_t unchanged = 0;
+    const int overflow = storage_incr(storage, "counter", 7, 1, &unchanged);
+    const int expire = storage_expire(storage, "counter", 7, 100000);
+    if (result == 0) {
+        result = incr_reads_as(storage, "counter", -INT64_MAX, 0);
+    }
+    const int64_t pttl = storage_pttl(storage, "counter", 7);
+
+    storage_set(storage, "text", 4, "abc", 3, 0);
+    const int not_number = storage_incr(storage, "text", 4, 1, NULL);
+    storage_set(storage, "float", 5, "10.5", 4, 0);
+    char sum[KV_FLOAT_TEXT_SIZE];
+    size_t sum_len = 0;
+    const int float_status = storage_incr_float(storage, "float", 5, 0.25L, sum, &sum_len);
+    const int float_reads = reads_as(storage, "float", "10.75");
+    storage_destroy(storage);
+
+    CHECK(result == 0, "a counter step went wrong");
+    CHECK(ints == 1, "%zu int-encoded keys, not 1", ints);
+    CHECK(overflow == STORAGE_OVERFLOW && unchanged == 0, "INCR past INT64_MAX returned %d", overflow);
+    CHECK(expire == 1 && pttl > 0, "INCR dropped the TTL, PTTL is %lld", (long long) pttl);
+    CHECK(not_number == STORAGE_NOT_NUMBER, "INCR on text returned %d", not_number);
+    CHECK(float_status == 0 && sum_len == 5 && memcmp(sum, "10.75", 5) == 0 && float_reads,
+          "INCRBYFLOAT 10.5 + 0.25 gave %.*s", (int) sum_len, sum);
+    return 0;
+}
+
+typedef struct {
+    storage_t *storage;
+    int failed;
+} counter_worker_t;
+
+static void *increment_counters(void *arg) {
+    counter_worker_t *worker = arg;
+    for (size_t i = 0; i < COUNTER_INCRS; i++) {
+        char key[KEY_SIZE];
+        worker->failed |= storage_incr(worker->storage, key, format_key(key, i % COUNTER_KEYS), 1, NULL) != 0;
+    }
+    return NULL;
+}
+
+static int test_concurrent_incr_loses_no_update(void) {
+    storage_t *storage = create_storage(STORAGE_DEFAULT_SHARDS, STORAGE_INDEX_CHAIN, STORAGE_POLICY_NOEVICTION);
+    CHECK(storage, "storage_create failed");
+
+    pthread_t threads[THREADS];
+    counter_worker_t workers[THREADS];
+    int started = 0;
+    for (; started < THREADS; started++) {
+        workers[started] = (counter_worker_t) {storage, 0};
+        if (pthread_create(&threads[started], NULL, increment_counters, &workers[started]) != 0) {
+            break;
+        }
+    }
+
+    int failed = started < THREADS;
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        failed |= workers[i].failed;
+    }
+
+    char expected[KV_INT_TEXT_SIZE];
+    snprintf(expected, sizeof(expected), "%d", THREADS * COUNTER_INCRS / COUNTER_KEYS);
+    int counted = 1;
+    for (size_t n = 0; n < COUNTER_KEYS; n++) {
+        char key[KEY_SIZE];
+        format_key(key, n);
+        counted &= reads_as(storage, key, expected);
+    }
+    storage_destroy(storage);
+
+    CHECK(!failed, "INCR failed");
+    CHECK(counted, "a counter is not at %s", expected);
+    return 0;
+}
+
+/*
+ * SET keeps a value as an integer only when it is a number of at least
+ * KV_INT_MIN_DIGITS characters that formats back to the same text; anything
+ * else, however numeric it looks, stays raw. The per-shard counts follow
+ * overwrites and deletes.
+ */
+static int test_set_int_encodes_long_numbers(void) {
+    static const char *const ints[] = {"12345678", "-1234567", "9223372036854775807", "-9223372036854775808"};
+    static const char *const raws[] = {"1234567", "012345678", "+12345678", "9223372036854775808", " 12345678",
+                                       "12345678 ", "-0000000", "1234.5678"};
+    const size_t int_count = sizeof(ints) / sizeof(ints[0]);
+    const size_t raw_count = sizeof(raws) / sizeof(raws[0]);
+    storage_t *storage = create_storage(STORAGE_DEFAULT_SHARDS, STORAGE_INDEX_CHAIN, STORAGE_POLICY_NOEVICTION);
+    CHECK(storage, "storage_create failed");
+
+    int result = 0;
+    char key[KEY_SIZE];
+    for (size_t i = 0; i < int_count + raw_count && result == 0; i++) {
+        const char *value = i < int_count ? ints[i] : raws[i - int_count];
+        format_key(key, i);
+        result = storage_set(storage, key, strlen(key), value, strlen(value), 0) == 0 && reads_as(storage, key, value)
+                     ? 0
+                     : -1;
+    }
+    const size_t int_keys = count_encoded(storage, KV_ENCODING_INT);
+    const size_t raw_keys = count_encoded(storage, KV_ENCODING_RAW);
+
+    format_key(key, 0);
+    result |= storage_set(storage, key, strlen(key), "text", 4, 0);
+    result |= del_key(storage, 1) == 1 ? 0 : -1;
+    const size_t int_after = count_encoded(storage, KV_ENCODING_INT);
+    const size_t raw_after = count_encoded(storage, KV_ENCODING_RAW);
+    storage_destroy(storage);
+
+    CHECK(result == 0, "a value did not read back as itself, or del failed");
+    CHECK(int_keys == int_count && raw_keys == raw_count, "%zu int and %zu raw keys, not %zu and %zu", int_keys,
+          raw_keys, int_count, raw_count);
+    CHECK(int_after == int_count - 2 && raw_after == raw_count + 1, "after overwrite and del: %zu int, %zu raw",
+          int_after, raw_after);
+    return 0;
+}
+
+int main(void) {
+    int failures = 0;
+    RUN(test_rehash_grows_and_shrinks());
+    RUN(test_shard_count_must_be_a_power_of_two());
+    RUN(test_keys_spread_over_shards());
+    RUN(test_concurrent_writers());
+    RUN(test_swiss_tombstones());
+    RUN(test_recent_or_frequent_keys_survive(STORAGE_POLICY_ALLKEYS_LRU));
+    RUN(test_recent_or_frequent_keys_survive(STORAGE_POLICY_ALLKEYS_LFU));
+    RUN(test_volatile_ttl_evicts_only_keys_with_a_ttl());
+    RUN(test_noeviction_rejects_writes());
+    RUN(test_tinylfu_resists_a_scan());
+    RUN(test_expiry_heap_order());
+    RUN(test_cleanup_removes_only_due_keys());
+    RUN(test_cleanup_stops_at_its_budget());
+    RUN(test_concurrent_mset_is_atomic());
+    RUN(test_msetnx_is_all_or_nothing());
+    RUN(test_incr_keeps_an_int_encoded_counter());
+    RUN(test_concurrent_incr_loses_no_update());
+    RUN(test_set_int_encodes_long_numbers());
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
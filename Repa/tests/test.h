@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdio.h>
+
+/*
+ * Shared by the tests in this directory: every test function returns 0 on
+ * success, and CHECK makes it return -1 after printing where and why it
+ * failed.
+ */
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        return -1; \
+    } \
+} while (0)
+
+#define RUN(test) do { \
+    if ((test) != 0) { \
+        fprintf(stderr, "%s failed\n", #test); \
+        failures++; \
+    } \
+} while (0)